@@ -0,0 +1,82 @@
+#include <vban/vbanstreamencoder.h>
+#include <vban/vbanstreamdecoder.h>
+#include <vban/vbanudptransport.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Streams audio over the loopback interface through VBANUdpSender and VBANUdpReceiver, once with segmentation offload and once without.
+ * Prints the packets per second and the number of system calls on both sides, so the gain of GSO and GRO on a machine can be measured.
+ * Usage: vbanudpbenchmark [port] [blocks]
+ */
+int main(int argc, char* argv[])
+{
+	const int port = argc > 1 ? std::atoi(argv[1]) : 16980;
+	const int blockCount = argc > 2 ? std::atoi(argv[2]) : 5000;
+	const int channelCount = 8;
+	const int bufferSize = 2048;
+
+	for (auto isSegmenting : { false, true })
+	{
+		std::string error;
+		vban::VBANUdpReceiver receiver;
+		if (!receiver.open(port, error, 50))
+		{
+			std::printf("%s\n", error.c_str());
+			return 1;
+		}
+		vban::VBANUdpSender sender;
+		if (!sender.open("127.0.0.1", port, error))
+		{
+			std::printf("%s\n", error.c_str());
+			return 1;
+		}
+		sender.setSegmentationOffload(isSegmenting);
+
+		// The network thread decodes the packets as a receiver would
+		vban::VBANStreamDecoder decoder;
+		std::atomic<int> decodedCount = { 0 };
+		std::atomic<bool> isRunning = { true };
+		std::thread network([&]()
+		{
+			while (isRunning.load())
+				receiver.receive([&](const char* data, int size)
+				{
+					if (decoder.receivePacket(data, size))
+						decodedCount++;
+				});
+		});
+
+		vban::VBANStreamEncoder<vban::VBANUdpSender> encoder(sender);
+		encoder.setChannelCount(channelCount);
+		encoder.setBufferSize(bufferSize);
+		encoder.setActive(true);
+		std::vector<std::vector<float>> input(channelCount, std::vector<float>(bufferSize, 0.1f));
+
+		auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < blockCount; ++i)
+		{
+			encoder.process(input, channelCount, bufferSize);
+
+			// Give the receiver a chance to keep up, so the socket buffer does not overflow
+			if (i % 32 == 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		isRunning.store(false);
+		network.join();
+
+		std::printf("%s: %d packets in %.3f s, %.0f packets/s, %d send calls, %d receive calls (coalescing %s), %d decoded, %d errors\n",
+			isSegmenting ? "GSO" : "no GSO", sender.getPacketCount(), seconds, sender.getPacketCount() / seconds, sender.getSendCallCount(),
+			receiver.getReceiveCallCount(), receiver.isCoalescing() ? "on" : "off", decodedCount.load(), sender.getErrorCount());
+	}
+	return 0;
+}
@@ -0,0 +1,31 @@
+#include <vban/vbanpacketvalidator.h>
+#include <vban/vbanstreamdecoder.h>
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+/**
+ * libFuzzer entry point: feeds every input to the packet validator and to a decoder, which has to reject or play it without reading past the packet.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	// A copy of exactly the input size, so the address sanitizer catches reads past the end of the packet
+	std::vector<char> packet(data, data + size);
+	auto length = static_cast<int>(size < INT_MAX ? size : INT_MAX);
+
+	// The single and the batch validation have to agree
+	auto isValid = vban::validatePacket(packet.data(), length);
+	const char* packets[] = { packet.data() };
+	uint64_t acceptMask = 0;
+	vban::validatePackets(packets, &length, 1, &acceptMask);
+	if (isValid != (acceptMask == 1))
+		__builtin_trap();
+
+	// The decoder keeps its state between inputs, so sequences of packets are played as well
+	static vban::VBANStreamDecoder decoder;
+	static std::vector<std::vector<float>> output(8, std::vector<float>(256));
+	decoder.receivePacket(packet.data(), length);
+	decoder.process(output, 8, 256);
+	return 0;
+}
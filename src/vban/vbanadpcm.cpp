@@ -0,0 +1,99 @@
+#include "vbanadpcm.h"
+#include "vban.h"
+
+#include <algorithm>
+
+namespace vban
+{
+
+	// Change of the step index for every code, the sign bit is ignored
+	static constexpr int32_t indexTable[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+	static constexpr int32_t stepTable[89] = {
+		7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+		50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+		337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+		2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+		15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 };
+
+
+	/**
+	 * Applies a code to the state of a channel, shared by the encoder and the decoder so they stay in step.
+	 */
+	static inline void update(int32_t code, int32_t step, int32_t& predictor, int32_t& index)
+	{
+		auto delta = (step >> 3) + ((code & 4) ? step : 0) + ((code & 2) ? step >> 1 : 0) + ((code & 1) ? step >> 2 : 0);
+		predictor = std::max(-32768, std::min(predictor + ((code & 8) ? -delta : delta), 32767));
+		index = std::max(0, std::min(index + indexTable[code], 88));
+	}
+
+
+	void adpcmWriteState(const int32_t* predictors, const int32_t* indices, int channelCount, unsigned char* output)
+	{
+		for (auto channel = 0; channel < channelCount; ++channel)
+		{
+			auto state = output + channel * VBAN_ADPCM_STATE_SIZE;
+			state[0] = static_cast<unsigned char>(predictors[channel]);
+			state[1] = static_cast<unsigned char>(predictors[channel] >> 8);
+			state[2] = static_cast<unsigned char>(indices[channel]);
+			state[3] = 0;
+		}
+	}
+
+
+	void adpcmEncode(const int16_t* input, int channelCount, int32_t* predictors, int32_t* indices, unsigned char* output)
+	{
+		uint8_t codes[VBAN_CHANNELS_MAX_NB + 1];
+		for (auto channel = 0; channel < channelCount; ++channel)
+		{
+			// Successive approximation of the difference with the step, one bit at a time
+			auto step = stepTable[indices[channel]];
+			auto difference = input[channel] - predictors[channel];
+			int32_t code = difference < 0 ? 8 : 0;
+			difference = difference < 0 ? -difference : difference;
+			int32_t bit = difference >= step;
+			code |= bit << 2;
+			difference -= bit ? step : 0;
+			bit = difference >= (step >> 1);
+			code |= bit << 1;
+			difference -= bit ? step >> 1 : 0;
+			code |= difference >= (step >> 2);
+
+			update(code, step, predictors[channel], indices[channel]);
+			codes[channel] = static_cast<uint8_t>(code);
+		}
+
+		codes[channelCount] = 0;
+		for (auto i = 0; i < getAdpcmFrameSize(channelCount); ++i)
+			output[i] = static_cast<unsigned char>(codes[2 * i] | (codes[2 * i + 1] << 4));
+	}
+
+
+	void adpcmDecode(const unsigned char* input, int sampleCount, int channelCount, char* output)
+	{
+		int32_t predictors[VBAN_CHANNELS_MAX_NB];
+		int32_t indices[VBAN_CHANNELS_MAX_NB];
+		for (auto channel = 0; channel < channelCount; ++channel)
+		{
+			auto state = input + channel * VBAN_ADPCM_STATE_SIZE;
+			predictors[channel] = static_cast<int16_t>(state[0] | (state[1] << 8));
+			indices[channel] = std::min<int32_t>(state[2], 88);
+		}
+
+		auto frameSize = getAdpcmFrameSize(channelCount);
+		auto codes = input + channelCount * VBAN_ADPCM_STATE_SIZE;
+		for (auto i = 0; i < sampleCount; ++i)
+		{
+			for (auto channel = 0; channel < channelCount; ++channel)
+			{
+				auto code = (codes[channel / 2] >> ((channel & 1) * 4)) & 15;
+				update(code, stepTable[indices[channel]], predictors[channel], indices[channel]);
+				output[2 * channel] = static_cast<char>(predictors[channel]);
+				output[2 * channel + 1] = static_cast<char>(predictors[channel] >> 8);
+			}
+			codes += frameSize;
+			output += 2 * channelCount;
+		}
+	}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vban
+{
+
+	// Bytes of the coder state of a channel at the start of a packet: the predicted sample as 16 bit little endian, the step index and a reserved byte
+	static constexpr int VBAN_ADPCM_STATE_SIZE = 4;
+
+	/**
+	 * @return Number of bytes of one sample of every channel, two 4 bit codes per byte
+	 */
+	inline int getAdpcmFrameSize(int channelCount) { return (channelCount + 1) / 2; }
+
+	/**
+	 * @return Size of the payload of an IMA-ADPCM packet after the user header
+	 */
+	inline int getAdpcmPayloadSize(int sampleCount, int channelCount) { return channelCount * VBAN_ADPCM_STATE_SIZE + sampleCount * getAdpcmFrameSize(channelCount); }
+
+	/**
+	 * Writes the coder state of every channel, every packet starts with it so it can be decoded without the previous packets.
+	 * @param predictors Predicted sample of every channel
+	 * @param indices Step index of every channel
+	 * @param output Receives channelCount * VBAN_ADPCM_STATE_SIZE bytes
+	 */
+	void adpcmWriteState(const int32_t* predictors, const int32_t* indices, int channelCount, unsigned char* output);
+
+	/**
+	 * Codes one sample of every channel into 4 bits with IMA-ADPCM.
+	 * The state is kept per channel in separate arrays so the loop runs over the channels without branches and vectorizes.
+	 * @param input One sample of every channel
+	 * @param predictors Predicted sample of every channel, updated
+	 * @param indices Step index of every channel, updated
+	 * @param output Receives getAdpcmFrameSize() bytes, the first channel in the low bits of the first byte.
+	 */
+	void adpcmEncode(const int16_t* input, int channelCount, int32_t* predictors, int32_t* indices, unsigned char* output);
+
+	/**
+	 * Decodes the payload of an IMA-ADPCM packet, starting from the state at the start of the payload.
+	 * @param input The payload after the user header
+	 * @param sampleCount Number of samples per channel
+	 * @param channelCount Number of channels
+	 * @param output Receives the interleaved 16 bit little endian samples
+	 */
+	void adpcmDecode(const unsigned char* input, int sampleCount, int channelCount, char* output);
+
+}
@@ -0,0 +1,260 @@
+#include "vbanaead.h"
+
+#include <cstring>
+
+namespace vban
+{
+
+	static inline uint32_t load32(const uint8_t* data)
+	{
+		return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+	}
+
+
+	static inline void store32(uint8_t* data, uint32_t value)
+	{
+		data[0] = value;
+		data[1] = value >> 8;
+		data[2] = value >> 16;
+		data[3] = value >> 24;
+	}
+
+
+	static inline uint32_t rotate(uint32_t value, int count)
+	{
+		return (value << count) | (value >> (32 - count));
+	}
+
+
+	// Number of ChaCha20 blocks computed side by side
+	static constexpr int lanes = 4;
+
+
+	/**
+	 * Applies a ChaCha20 quarter round to the same words of all lanes
+	 */
+	static inline void quarterRound(uint32_t (&x)[16][lanes], int a, int b, int c, int d)
+	{
+		for (auto l = 0; l < lanes; ++l) { x[a][l] += x[b][l]; x[d][l] = rotate(x[d][l] ^ x[a][l], 16); }
+		for (auto l = 0; l < lanes; ++l) { x[c][l] += x[d][l]; x[b][l] = rotate(x[b][l] ^ x[c][l], 12); }
+		for (auto l = 0; l < lanes; ++l) { x[a][l] += x[b][l]; x[d][l] = rotate(x[d][l] ^ x[a][l], 8); }
+		for (auto l = 0; l < lanes; ++l) { x[c][l] += x[d][l]; x[b][l] = rotate(x[b][l] ^ x[c][l], 7); }
+	}
+
+
+	/**
+	 * Computes four consecutive ChaCha20 key stream blocks starting at counter
+	 */
+	static void chachaBlocks(const uint32_t (&input)[16], uint32_t counter, uint8_t (&output)[64 * lanes])
+	{
+		uint32_t x[16][lanes];
+		for (auto i = 0; i < 16; ++i)
+			for (auto l = 0; l < lanes; ++l)
+				x[i][l] = input[i];
+		for (auto l = 0; l < lanes; ++l)
+			x[12][l] = counter + l;
+
+		for (auto round = 0; round < 10; ++round)
+		{
+			quarterRound(x, 0, 4, 8, 12);
+			quarterRound(x, 1, 5, 9, 13);
+			quarterRound(x, 2, 6, 10, 14);
+			quarterRound(x, 3, 7, 11, 15);
+			quarterRound(x, 0, 5, 10, 15);
+			quarterRound(x, 1, 6, 11, 12);
+			quarterRound(x, 2, 7, 8, 13);
+			quarterRound(x, 3, 4, 9, 14);
+		}
+
+		for (auto l = 0; l < lanes; ++l)
+			for (auto i = 0; i < 16; ++i)
+				store32(output + l * 64 + i * 4, x[i][l] + (i == 12 ? counter + l : input[i]));
+	}
+
+
+	static void chachaSetup(const uint8_t* key, const uint8_t* nonce, uint32_t (&state)[16])
+	{
+		state[0] = 0x61707865;
+		state[1] = 0x3320646e;
+		state[2] = 0x79622d32;
+		state[3] = 0x6b206574;
+		for (auto i = 0; i < 8; ++i)
+			state[4 + i] = load32(key + i * 4);
+		state[12] = 0;
+		for (auto i = 0; i < 3; ++i)
+			state[13 + i] = load32(nonce + i * 4);
+	}
+
+
+	/**
+	 * XORs data with the ChaCha20 key stream starting at block counter 1, as used for the AEAD ciphertext
+	 */
+	static void chachaXor(const uint32_t (&state)[16], uint8_t* data, size_t size)
+	{
+		uint8_t stream[64 * lanes];
+		uint32_t counter = 1;
+		while (size > 0)
+		{
+			chachaBlocks(state, counter, stream);
+			auto count = size < sizeof(stream) ? size : sizeof(stream);
+			for (size_t i = 0; i < count; ++i)
+				data[i] ^= stream[i];
+			data += count;
+			size -= count;
+			counter += lanes;
+		}
+	}
+
+
+	/**
+	 * Poly1305 with 26 bit limbs
+	 */
+	class Poly1305
+	{
+	public:
+		explicit Poly1305(const uint8_t* key)
+		{
+			r[0] = load32(key) & 0x3ffffff;
+			r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+			r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+			r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+			r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+			for (auto i = 0; i < 4; ++i)
+				pad[i] = load32(key + 16 + i * 4);
+		}
+
+		/**
+		 * Processes data, zero padded to a multiple of 16 bytes
+		 */
+		void updatePadded(const uint8_t* data, size_t size)
+		{
+			while (size >= 16)
+			{
+				block(data);
+				data += 16;
+				size -= 16;
+			}
+			if (size > 0)
+			{
+				uint8_t last[16] = { };
+				std::memcpy(last, data, size);
+				block(last);
+			}
+		}
+
+		void finish(uint8_t* tag)
+		{
+			uint32_t c;
+			c = h[1] >> 26; h[1] &= 0x3ffffff;
+			h[2] += c; c = h[2] >> 26; h[2] &= 0x3ffffff;
+			h[3] += c; c = h[3] >> 26; h[3] &= 0x3ffffff;
+			h[4] += c; c = h[4] >> 26; h[4] &= 0x3ffffff;
+			h[0] += c * 5; c = h[0] >> 26; h[0] &= 0x3ffffff;
+			h[1] += c;
+
+			// compute h - p and select it when it is not negative
+			uint32_t g[5];
+			g[0] = h[0] + 5; c = g[0] >> 26; g[0] &= 0x3ffffff;
+			g[1] = h[1] + c; c = g[1] >> 26; g[1] &= 0x3ffffff;
+			g[2] = h[2] + c; c = g[2] >> 26; g[2] &= 0x3ffffff;
+			g[3] = h[3] + c; c = g[3] >> 26; g[3] &= 0x3ffffff;
+			g[4] = h[4] + c - (1 << 26);
+			uint32_t mask = (g[4] >> 31) - 1;
+			for (auto i = 0; i < 5; ++i)
+				h[i] = (h[i] & ~mask) | (g[i] & mask);
+
+			// h mod 2^128 + pad
+			uint32_t words[4];
+			words[0] = h[0] | (h[1] << 26);
+			words[1] = (h[1] >> 6) | (h[2] << 20);
+			words[2] = (h[2] >> 12) | (h[3] << 14);
+			words[3] = (h[3] >> 18) | (h[4] << 8);
+			uint64_t f = 0;
+			for (auto i = 0; i < 4; ++i)
+			{
+				f = uint64_t(words[i]) + pad[i] + (f >> 32);
+				store32(tag + i * 4, static_cast<uint32_t>(f));
+			}
+		}
+
+	private:
+		void block(const uint8_t* data)
+		{
+			h[0] += load32(data) & 0x3ffffff;
+			h[1] += (load32(data + 3) >> 2) & 0x3ffffff;
+			h[2] += (load32(data + 6) >> 4) & 0x3ffffff;
+			h[3] += (load32(data + 9) >> 6) & 0x3ffffff;
+			h[4] += (load32(data + 12) >> 8) | (1 << 24);
+
+			uint64_t s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+			uint64_t d0 = uint64_t(h[0]) * r[0] + uint64_t(h[1]) * s4 + uint64_t(h[2]) * s3 + uint64_t(h[3]) * s2 + uint64_t(h[4]) * s1;
+			uint64_t d1 = uint64_t(h[0]) * r[1] + uint64_t(h[1]) * r[0] + uint64_t(h[2]) * s4 + uint64_t(h[3]) * s3 + uint64_t(h[4]) * s2;
+			uint64_t d2 = uint64_t(h[0]) * r[2] + uint64_t(h[1]) * r[1] + uint64_t(h[2]) * r[0] + uint64_t(h[3]) * s4 + uint64_t(h[4]) * s3;
+			uint64_t d3 = uint64_t(h[0]) * r[3] + uint64_t(h[1]) * r[2] + uint64_t(h[2]) * r[1] + uint64_t(h[3]) * r[0] + uint64_t(h[4]) * s4;
+			uint64_t d4 = uint64_t(h[0]) * r[4] + uint64_t(h[1]) * r[3] + uint64_t(h[2]) * r[2] + uint64_t(h[3]) * r[1] + uint64_t(h[4]) * r[0];
+
+			uint32_t c;
+			c = static_cast<uint32_t>(d0 >> 26); h[0] = static_cast<uint32_t>(d0) & 0x3ffffff;
+			d1 += c; c = static_cast<uint32_t>(d1 >> 26); h[1] = static_cast<uint32_t>(d1) & 0x3ffffff;
+			d2 += c; c = static_cast<uint32_t>(d2 >> 26); h[2] = static_cast<uint32_t>(d2) & 0x3ffffff;
+			d3 += c; c = static_cast<uint32_t>(d3 >> 26); h[3] = static_cast<uint32_t>(d3) & 0x3ffffff;
+			d4 += c; c = static_cast<uint32_t>(d4 >> 26); h[4] = static_cast<uint32_t>(d4) & 0x3ffffff;
+			h[0] += c * 5; c = h[0] >> 26; h[0] &= 0x3ffffff;
+			h[1] += c;
+		}
+
+		uint32_t r[5];
+		uint32_t h[5] = { };
+		uint32_t pad[4];
+	};
+
+
+	static void computeTag(const uint32_t (&state)[16], const uint8_t* additionalData, size_t additionalDataSize, const uint8_t* data, size_t size, uint8_t* tag)
+	{
+		// The one time Poly1305 key is the first half of key stream block 0
+		uint8_t stream[64 * lanes];
+		chachaBlocks(state, 0, stream);
+
+		Poly1305 poly(stream);
+		poly.updatePadded(additionalData, additionalDataSize);
+		poly.updatePadded(data, size);
+		uint8_t lengths[16];
+		for (auto i = 0; i < 8; ++i)
+		{
+			lengths[i] = static_cast<uint64_t>(additionalDataSize) >> (i * 8);
+			lengths[8 + i] = static_cast<uint64_t>(size) >> (i * 8);
+		}
+		poly.updatePadded(lengths, sizeof(lengths));
+		poly.finish(tag);
+	}
+
+
+	void aeadEncrypt(const uint8_t* key, const uint8_t* nonce, const uint8_t* additionalData, size_t additionalDataSize, uint8_t* data, size_t size, uint8_t* tag)
+	{
+		uint32_t state[16];
+		chachaSetup(key, nonce, state);
+		chachaXor(state, data, size);
+		computeTag(state, additionalData, additionalDataSize, data, size, tag);
+	}
+
+
+	bool aeadDecrypt(const uint8_t* key, const uint8_t* nonce, const uint8_t* additionalData, size_t additionalDataSize, uint8_t* data, size_t size, const uint8_t* tag)
+	{
+		uint32_t state[16];
+		chachaSetup(key, nonce, state);
+
+		uint8_t expected[VBAN_AEAD_TAG_SIZE];
+		computeTag(state, additionalData, additionalDataSize, data, size, expected);
+
+		// Compare in constant time
+		uint8_t difference = 0;
+		for (auto i = 0; i < VBAN_AEAD_TAG_SIZE; ++i)
+			difference |= expected[i] ^ tag[i];
+		if (difference != 0)
+			return false;
+
+		chachaXor(state, data, size);
+		return true;
+	}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace vban
+{
+
+	static constexpr int VBAN_AEAD_KEY_SIZE = 32;
+	static constexpr int VBAN_AEAD_NONCE_SIZE = 12;
+	static constexpr int VBAN_AEAD_TAG_SIZE = 16;
+
+	/**
+	 * Encrypts data in place with ChaCha20-Poly1305 (RFC 8439) and computes the authentication tag over the additional data and the ciphertext.
+	 * Four ChaCha20 blocks are computed side by side so the compiler can vectorize the rounds.
+	 * @param key Key of VBAN_AEAD_KEY_SIZE bytes
+	 * @param nonce Nonce of VBAN_AEAD_NONCE_SIZE bytes, must never be used twice with the same key.
+	 * @param additionalData Data that is authenticated but not encrypted
+	 * @param additionalDataSize Size of additionalData in bytes
+	 * @param data Data to be encrypted in place
+	 * @param size Size of data in bytes
+	 * @param tag Receives the authentication tag of VBAN_AEAD_TAG_SIZE bytes
+	 */
+	void aeadEncrypt(const uint8_t* key, const uint8_t* nonce, const uint8_t* additionalData, size_t additionalDataSize, uint8_t* data, size_t size, uint8_t* tag);
+
+	/**
+	 * Verifies the authentication tag and decrypts data in place with ChaCha20-Poly1305 (RFC 8439).
+	 * The data is left untouched when the tag does not match.
+	 * @param key Key of VBAN_AEAD_KEY_SIZE bytes
+	 * @param nonce Nonce of VBAN_AEAD_NONCE_SIZE bytes
+	 * @param additionalData Data that is authenticated but not encrypted
+	 * @param additionalDataSize Size of additionalData in bytes
+	 * @param data Data to be decrypted in place
+	 * @param size Size of data in bytes
+	 * @param tag Authentication tag of VBAN_AEAD_TAG_SIZE bytes
+	 * @return True if the tag matched and the data has been decrypted
+	 */
+	bool aeadDecrypt(const uint8_t* key, const uint8_t* nonce, const uint8_t* additionalData, size_t additionalDataSize, uint8_t* data, size_t size, const uint8_t* tag);
+
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "vban.h"
+#include "vbannuma.h"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+#ifdef __linux__
+#include <time.h>
+#include <cerrno>
+#endif
+
+namespace vban
+{
+
+	/**
+	 * Drives a VBANStreamEncoder without a sound card, for senders that render their audio on a server.
+	 * A thread calls the render function and the encoder once per buffer at exactly the nominal sample rate of the stream.
+	 * Deadlines are computed from the start time and the number of samples rendered so far, so the timing does not drift.
+	 * The thread sleeps until shortly before each deadline and busy waits the remainder to reduce the scheduling jitter, which is measured and reported.
+	 * @tparam EncoderType The encoder type, usually VBANStreamEncoder<SenderType>
+	 */
+	template <typename EncoderType>
+	class VBANEncoderPump
+	{
+	public:
+		/**
+		 * Function that renders the audio for one buffer.
+		 * Receives the multichannel buffer to fill and the number of samples to render in each channel.
+		 */
+		using RenderFunction = std::function<void(std::vector<std::vector<float>>& buffer, int sampleCount)>;
+
+		/**
+		 * Constructor
+		 * @param encoder The encoder that is fed with the rendered audio
+		 * @param render Called on the pump thread to render each buffer
+		 */
+		VBANEncoderPump(EncoderType& encoder, RenderFunction render) : mEncoder(encoder), mRender(std::move(render)) { }
+
+		// Stops the pump
+		virtual ~VBANEncoderPump() { stop(); }
+
+		/**
+		 * Starts the pump thread. The settings can not be changed while the pump is running.
+		 */
+		void start();
+
+		/**
+		 * Stops the pump thread and waits for it to finish.
+		 */
+		void stop();
+
+		/**
+		 * Sets the sample rate at which the pump runs. Also configures the encoder.
+		 * @param format Index to one of the sample rate formats specified in VBanSRList
+		 */
+		void setSampleRateFormat(int format);
+
+		/**
+		 * Sets the number of samples rendered per call. Also configures the encoder.
+		 * @param bufferSize in samples
+		 */
+		void setBufferSize(int bufferSize);
+
+		/**
+		 * Sets the number of channels rendered. Also configures the encoder.
+		 * @param value
+		 */
+		void setChannelCount(int value);
+
+		/**
+		 * Sets how long before each deadline the thread stops sleeping and starts busy waiting.
+		 * Higher values reduce jitter at the cost of CPU time.
+		 * @param microseconds Busy wait duration
+		 */
+		void setSpinTime(int microseconds);
+
+		/**
+		 * Restricts the pump thread to the cpus of a NUMA node, usually the node of the network interface the encoder sends through.
+		 * @param node Index of the node, or -1 to let the thread run anywhere.
+		 */
+		void setNumaNode(int node);
+
+		/**
+		 * @return Whether the pump thread is running.
+		 */
+		bool isRunning() const { return mIsRunning.load(); }
+
+		/**
+		 * @return Highest delay between a deadline and the moment the buffer was rendered since the last reset, in microseconds.
+		 */
+		double getMaxJitter() const { return mMaxJitter.load() / 1000.0; }
+
+		/**
+		 * @return Average delay between a deadline and the moment the buffer was rendered since the last reset, in microseconds.
+		 */
+		double getMeanJitter() const { auto count = mJitterCount.load(); return count > 0 ? mJitterSum.load() / 1000.0 / count : 0.0; }
+
+		/**
+		 * @return Number of buffers that were rendered more than a full buffer period late.
+		 */
+		int getOverrunCount() const { return mOverrunCount.load(); }
+
+		/**
+		 * Resets the jitter statistics.
+		 */
+		void resetStatistics();
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * Runs on the pump thread
+		 */
+		void run();
+
+		/**
+		 * Sleeps until shortly before the deadline and busy waits the rest.
+		 */
+		void waitUntil(Clock::time_point deadline);
+
+		EncoderType& mEncoder;
+		RenderFunction mRender;
+
+		// Settings
+		int mSampleRateFormat = 3; // 48kHz
+		int mBufferSize = 256;
+		int mChannelCount = 2;
+		int mSpinTime = 200; // Microseconds of busy waiting before each deadline
+		int mNumaNode = -1;
+
+		// State
+		std::thread mThread;
+		std::atomic<bool> mIsRunning = { false };
+		std::vector<std::vector<float>> mBuffer;
+
+		// Statistics in nanoseconds
+		std::atomic<int64_t> mMaxJitter = { 0 };
+		std::atomic<int64_t> mJitterSum = { 0 };
+		std::atomic<int64_t> mJitterCount = { 0 };
+		std::atomic<int> mOverrunCount = { 0 };
+	};
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::start()
+	{
+		if (mIsRunning.load())
+			return;
+
+		mBuffer.resize(mChannelCount);
+		for (auto& channel : mBuffer)
+			channel.resize(mBufferSize);
+
+		mEncoder.setSampleRateFormat(mSampleRateFormat);
+		mEncoder.setBufferSize(mBufferSize);
+		mEncoder.setChannelCount(mChannelCount);
+
+		mIsRunning.store(true);
+		mThread = std::thread([&](){ run(); });
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::stop()
+	{
+		mIsRunning.store(false);
+		if (mThread.joinable())
+			mThread.join();
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::setSampleRateFormat(int format)
+	{
+		assert(!mIsRunning.load());
+		assert(format < VBAN_SR_MAXNUMBER);
+		mSampleRateFormat = format;
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::setBufferSize(int bufferSize)
+	{
+		assert(!mIsRunning.load());
+		assert(bufferSize > 0);
+		mBufferSize = bufferSize;
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::setChannelCount(int value)
+	{
+		assert(!mIsRunning.load());
+		assert(value <= VBAN_CHANNELS_MAX_NB);
+		mChannelCount = value;
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::setSpinTime(int microseconds)
+	{
+		assert(microseconds >= 0);
+		mSpinTime = microseconds;
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::setNumaNode(int node)
+	{
+		assert(!mIsRunning.load());
+		assert(node < getNumaNodeCount());
+		mNumaNode = node;
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::resetStatistics()
+	{
+		mMaxJitter.store(0);
+		mJitterSum.store(0);
+		mJitterCount.store(0);
+		mOverrunCount.store(0);
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::run()
+	{
+		if (mNumaNode >= 0)
+			bindThreadToNumaNode(mNumaNode);
+
+		const int64_t sampleRate = VBanSRList[mSampleRateFormat];
+		const int64_t period = mBufferSize * 1000000000ll / sampleRate;
+		auto start = Clock::now();
+		int64_t samplesRendered = 0;
+
+		while (mIsRunning.load())
+		{
+			// The deadline is derived from the total number of samples so rounding errors do not accumulate
+			// Whole seconds and the remainder are converted apart, the product of the sample count and a billion overflows after a few days
+			auto deadline = start + std::chrono::seconds(samplesRendered / sampleRate) + std::chrono::nanoseconds((samplesRendered % sampleRate) * 1000000000ll / sampleRate);
+			waitUntil(deadline);
+
+			auto jitter = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - deadline).count();
+			if (jitter > mMaxJitter.load())
+				mMaxJitter.store(jitter);
+			mJitterSum += jitter;
+			mJitterCount++;
+			if (jitter > period)
+				mOverrunCount++;
+
+			mRender(mBuffer, mBufferSize);
+			mEncoder.process(mBuffer, mChannelCount, mBufferSize);
+			samplesRendered += mBufferSize;
+		}
+	}
+
+
+	template <typename EncoderType>
+	void VBANEncoderPump<EncoderType>::waitUntil(Clock::time_point deadline)
+	{
+		auto wakeup = deadline - std::chrono::microseconds(mSpinTime);
+		if (Clock::now() < wakeup)
+		{
+#ifdef __linux__
+			// steady_clock is CLOCK_MONOTONIC on linux, sleep on an absolute deadline so the time to set up the sleep is not added
+			auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeup.time_since_epoch()).count();
+			timespec time;
+			time.tv_sec = nanoseconds / 1000000000ll;
+			time.tv_nsec = nanoseconds % 1000000000ll;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) == EINTR);
+#else
+			std::this_thread::sleep_until(wakeup);
+#endif
+		}
+
+		while (Clock::now() < deadline);
+	}
+
+}
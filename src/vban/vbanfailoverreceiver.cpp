@@ -0,0 +1,45 @@
+#include "vbanfailoverreceiver.h"
+
+#include <cassert>
+
+namespace vban
+{
+
+	VBANFailoverReceiver::VBANFailoverReceiver(VBANStreamDecoder& primary, VBANStreamDecoder& backup) : mPrimary(primary), mBackup(backup)
+	{
+		update();
+	}
+
+
+	void VBANFailoverReceiver::setBufferSize(int bufferSize)
+	{
+		mBufferSize.store(bufferSize);
+		mIsDirty.set();
+	}
+
+
+	void VBANFailoverReceiver::setChannelCount(int value)
+	{
+		assert(value <= VBAN_CHANNELS_MAX_NB);
+		mChannelCount.store(value);
+		mIsDirty.set();
+	}
+
+
+	void VBANFailoverReceiver::setCrossfadeTime(int sampleCount)
+	{
+		assert(sampleCount > 0);
+		mCrossfadeTime.store(sampleCount);
+		mIsDirty.set();
+	}
+
+
+	void VBANFailoverReceiver::update()
+	{
+		mBackupBuffer.resize(mChannelCount.load());
+		for (auto& channel : mBackupBuffer)
+			channel.resize(mBufferSize.load());
+		mFadeStep = 1.f / mCrossfadeTime.load();
+	}
+
+}
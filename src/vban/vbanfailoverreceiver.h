@@ -0,0 +1,132 @@
+#pragma once
+
+#include "vbanstreamdecoder.h"
+
+#include <atomic>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+namespace vban
+{
+
+	/**
+	 * Plays a primary VBAN stream and automatically switches over to a backup stream of the same format when the primary stream goes down.
+	 * Both decoders are processed on every call so the backup stream is always up to date and ready to take over.
+	 * The switch is detected by the watchdog of the decoders, see VBANStreamDecoder::setTimeout(), and performed with a short linear crossfade.
+	 * When the primary stream comes back the receiver fades back to it.
+	 */
+	class VBANFailoverReceiver
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param primary Decoder of the stream that is played by default.
+		 * @param backup Decoder of the stream that is played while the primary stream is down.
+		 */
+		VBANFailoverReceiver(VBANStreamDecoder& primary, VBANStreamDecoder& backup);
+
+		// Default destructor
+		virtual ~VBANFailoverReceiver() = default;
+
+		/**
+		 * Call this method from the audio thread to fill the output with decoded samples.
+		 * @tparam T Type for the multichannel audio data, see VBANStreamDecoder::process().
+		 * @param output Multichannel audio data to be filled.
+		 * @param channelCount Number of channels in output. Has to be smaller than or equal to the channel count set by setChannelCount().
+		 * @param sampleCount Number of samples to fill. Has to be smaller than or equal to the buffer size set by setBufferSize().
+		 */
+		template <typename T>
+		void process(T& output, int channelCount, int sampleCount);
+
+		/**
+		 * Sets the maximum buffer size of the calling audio processing system.
+		 * @param bufferSize in samples
+		 */
+		void setBufferSize(int bufferSize);
+
+		/**
+		 * Sets the maximum number of channels that will be processed.
+		 * @param value
+		 */
+		void setChannelCount(int value);
+
+		/**
+		 * Sets the duration of the crossfade between the primary and the backup stream.
+		 * @param sampleCount Duration in samples
+		 */
+		void setCrossfadeTime(int sampleCount);
+
+		/**
+		 * @return Whether the receiver is currently playing, or fading to, the backup stream.
+		 */
+		bool isOnBackup() const { return mIsOnBackup.load(); }
+
+		/**
+		 * @return Number of times the receiver switched from the primary to the backup stream.
+		 */
+		int getFailoverCount() const { return mFailoverCount.load(); }
+
+	private:
+		/**
+		 * Updates the internal state from the current settings
+		 */
+		void update();
+
+		// Settings
+		std::atomic<int> mBufferSize = { 256 };
+		std::atomic<int> mChannelCount = { 2 };
+		std::atomic<int> mCrossfadeTime = { 64 };
+		DirtyFlag mIsDirty;
+
+		// State
+		VBANStreamDecoder& mPrimary;
+		VBANStreamDecoder& mBackup;
+		std::vector<std::vector<float>> mBackupBuffer; // Output of the backup decoder
+		float mFade = 0.f; // Gain of the backup stream, the primary stream gets 1 - mFade
+		float mFadeStep = 1.f / 64.f; // Change of mFade per sample
+		std::atomic<bool> mIsOnBackup = { false };
+		std::atomic<int> mFailoverCount = { 0 };
+	};
+
+
+	template <typename T>
+	void VBANFailoverReceiver::process(T& output, int channelCount, int sampleCount)
+	{
+		if (mIsDirty.check())
+			update();
+
+		assert(channelCount <= static_cast<int>(mBackupBuffer.size()));
+		assert(mBackupBuffer.empty() || sampleCount <= static_cast<int>(mBackupBuffer[0].size()));
+
+		mPrimary.process(output, channelCount, sampleCount);
+		mBackup.process(mBackupBuffer, channelCount, sampleCount);
+
+		// Decide which stream to play
+		auto onBackup = mIsOnBackup.load();
+		if (!onBackup && !mPrimary.isReceiving() && mBackup.isReceiving())
+		{
+			onBackup = true;
+			mFailoverCount++;
+		}
+		else if (onBackup && mPrimary.isReceiving())
+			onBackup = false;
+		mIsOnBackup.store(onBackup);
+
+		auto target = onBackup ? 1.f : 0.f;
+		if (mFade == target && mFade == 0.f)
+			return;
+
+		for (auto i = 0; i < sampleCount; ++i)
+		{
+			if (mFade < target)
+				mFade = std::min(mFade + mFadeStep, target);
+			else if (mFade > target)
+				mFade = std::max(mFade - mFadeStep, target);
+
+			for (auto channel = 0; channel < channelCount; ++channel)
+				output[channel][i] = (1.f - mFade) * output[channel][i] + mFade * mBackupBuffer[channel][i];
+		}
+	}
+
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include "vban.h"
+#include "vbanwavfile.h"
+#include "vbannuma.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+namespace vban
+{
+
+	/**
+	 * Presents interleaved PCM data as multichannel audio data that can be passed to VBANStreamEncoder::process() without copying it into separate channels.
+	 * Samples are converted to floating point when the encoder reads them.
+	 */
+	class VBANInterleavedView
+	{
+	public:
+		/**
+		 * One channel of the interleaved data
+		 */
+		class Channel
+		{
+		public:
+			Channel(const char* data, int frameSize, VBANWavFile::Format format) : mData(reinterpret_cast<const unsigned char*>(data)), mFrameSize(frameSize), mFormat(format) { }
+
+			float operator[](int index) const
+			{
+				auto d = mData + index * mFrameSize;
+				switch (mFormat)
+				{
+					case VBANWavFile::Format::Int16:
+						return static_cast<int16_t>(d[0] | (d[1] << 8)) / 32768.f;
+					case VBANWavFile::Format::Int24:
+						return static_cast<int32_t>((uint32_t(d[0]) << 8) | (uint32_t(d[1]) << 16) | (uint32_t(d[2]) << 24)) / 2147483648.f;
+					case VBANWavFile::Format::Int32:
+						return static_cast<int32_t>(uint32_t(d[0]) | (uint32_t(d[1]) << 8) | (uint32_t(d[2]) << 16) | (uint32_t(d[3]) << 24)) / 2147483648.f;
+					case VBANWavFile::Format::Float32:
+					{
+						float value;
+						std::memcpy(&value, d, sizeof(float));
+						return value;
+					}
+				}
+				return 0.f;
+			}
+
+		private:
+			const unsigned char* mData;
+			int mFrameSize;
+			VBANWavFile::Format mFormat;
+		};
+
+		/**
+		 * Constructor
+		 * @param data Interleaved frames
+		 * @param channelCount Number of channels in a frame
+		 * @param format Format of the samples
+		 */
+		VBANInterleavedView(const char* data, int channelCount, VBANWavFile::Format format) : mData(data), mFormat(format)
+		{
+			mSampleSize = format == VBANWavFile::Format::Int16 ? 2 : (format == VBANWavFile::Format::Int24 ? 3 : 4);
+			mFrameSize = mSampleSize * channelCount;
+		}
+
+		Channel operator[](int channel) const { return Channel(mData + channel * mSampleSize, mFrameSize, mFormat); }
+
+	private:
+		const char* mData;
+		VBANWavFile::Format mFormat;
+		int mSampleSize;
+		int mFrameSize;
+	};
+
+
+	/**
+	 * Streams pre rendered multichannel WAV and RF64 files into VBAN encoders.
+	 * A background thread reads each file ahead into a small ring of blocks, so memory use is bounded by the number of files times the block count and size, regardless of the length of the files.
+	 * The encoders read the samples straight from the blocks through a VBANInterleavedView, without any further copies.
+	 * process() is usually driven by a VBANEncoderPump or another timer at the sample rate of the files.
+	 * @tparam EncoderType The encoder type, usually VBANStreamEncoder<SenderType>
+	 */
+	template <typename EncoderType>
+	class VBANFileStreamer
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param blockSize Number of frames read at once per file
+		 * @param blockCount Number of blocks read ahead per file
+		 */
+		explicit VBANFileStreamer(int blockSize = 8192, int blockCount = 4) : mBlockSize(blockSize), mBlockCount(blockCount) { }
+
+		// Stops the read ahead thread
+		virtual ~VBANFileStreamer() { stop(); }
+
+		/**
+		 * Adds a file to be streamed through an encoder. The channel count and sample rate of the encoder are set to match the file.
+		 * Has to be called before start().
+		 * @param path Path to the WAV or RF64 file
+		 * @param encoder Encoder that sends the audio of the file
+		 * @param error Contains the error message when the file can not be streamed
+		 * @return True on success
+		 */
+		bool addFile(const std::string& path, EncoderType& encoder, std::string& error);
+
+		/**
+		 * Sets whether the files start over when they reach the end.
+		 * @param value True to loop
+		 */
+		void setLooping(bool value) { mIsLooping.store(value); }
+
+		/**
+		 * Restricts the read ahead thread to the cpus of a NUMA node, usually the node of the thread calling process().
+		 * Has to be called before start().
+		 * @param node Index of the node, or -1 to let the thread run anywhere.
+		 */
+		void setNumaNode(int node) { assert(!mIsRunning.load()); mNumaNode = node; }
+
+		/**
+		 * Starts the read ahead thread and waits until the first blocks of all files are read.
+		 */
+		void start();
+
+		/**
+		 * Stops the read ahead thread.
+		 */
+		void stop();
+
+		/**
+		 * Passes the next frames of all files to their encoders.
+		 * When the read ahead thread could not keep up, silence is sent instead and an underrun is counted.
+		 * @param frameCount Number of frames to stream
+		 */
+		void process(int frameCount);
+
+		/**
+		 * @return Whether all files have been streamed until the end.
+		 */
+		bool isFinished() const;
+
+		/**
+		 * @return Number of times a file was not read ahead in time.
+		 */
+		int getUnderrunCount() const { return mUnderrunCount.load(); }
+
+	private:
+		struct Stream
+		{
+			Stream(EncoderType& encoder) : mEncoder(encoder) { }
+
+			VBANWavFile mFile;
+			EncoderType& mEncoder;
+			std::vector<std::vector<char>> mBlocks; // Ring of blocks read ahead
+			std::vector<int> mBlockFrames; // Number of valid frames in each block
+			std::vector<char> mSilence; // One block of silence sent on underruns
+			std::atomic<int64_t> mBlocksWritten = { 0 }; // Number of blocks read from the file by the read ahead thread
+			std::atomic<int64_t> mBlocksRead = { 0 }; // Number of blocks consumed by process()
+			std::atomic<bool> mIsEndOfFile = { false }; // Whether the read ahead thread reached the end of the file
+			int mReadFrame = 0; // Read position within the current block
+		};
+
+		/**
+		 * Runs on the read ahead thread
+		 */
+		void run();
+
+		/**
+		 * Reads blocks until the ring of the stream is full.
+		 */
+		void readAhead(Stream& stream);
+
+		int mBlockSize;
+		int mBlockCount;
+		std::atomic<bool> mIsLooping = { false };
+		int mNumaNode = -1;
+		std::vector<std::unique_ptr<Stream>> mStreams;
+
+		std::thread mThread;
+		std::mutex mMutex;
+		std::condition_variable mCondition;
+		std::atomic<bool> mIsRunning = { false };
+		std::atomic<int> mUnderrunCount = { 0 };
+	};
+
+
+	template <typename EncoderType>
+	bool VBANFileStreamer<EncoderType>::addFile(const std::string& path, EncoderType& encoder, std::string& error)
+	{
+		assert(!mIsRunning.load());
+
+		auto stream = std::make_unique<Stream>(encoder);
+		if (!stream->mFile.open(path, error))
+			return false;
+
+		auto& file = stream->mFile;
+		if (file.getChannelCount() > VBAN_CHANNELS_MAX_NB)
+		{
+			error = path + " has more channels than VBAN supports";
+			return false;
+		}
+		auto format = std::find(VBanSRList, VBanSRList + VBAN_SR_MAXNUMBER, file.getSampleRate()) - VBanSRList;
+		if (format == VBAN_SR_MAXNUMBER)
+		{
+			error = path + " has a sample rate that VBAN does not support";
+			return false;
+		}
+
+		stream->mBlocks.resize(mBlockCount);
+		for (auto& block : stream->mBlocks)
+			block.resize(static_cast<size_t>(mBlockSize) * file.getFrameSize());
+		stream->mBlockFrames.resize(mBlockCount, 0);
+		stream->mSilence.resize(static_cast<size_t>(mBlockSize) * file.getFrameSize(), 0);
+
+		encoder.setChannelCount(file.getChannelCount());
+		encoder.setSampleRateFormat(format);
+		mStreams.emplace_back(std::move(stream));
+		return true;
+	}
+
+
+	template <typename EncoderType>
+	void VBANFileStreamer<EncoderType>::start()
+	{
+		if (mIsRunning.load())
+			return;
+
+		for (auto& stream : mStreams)
+			readAhead(*stream);
+
+		mIsRunning.store(true);
+		mThread = std::thread([&](){ run(); });
+	}
+
+
+	template <typename EncoderType>
+	void VBANFileStreamer<EncoderType>::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mIsRunning.store(false);
+		}
+		mCondition.notify_one();
+		if (mThread.joinable())
+			mThread.join();
+	}
+
+
+	template <typename EncoderType>
+	void VBANFileStreamer<EncoderType>::process(int frameCount)
+	{
+		auto isBlockConsumed = false;
+		for (auto& streamPtr : mStreams)
+		{
+			auto& stream = *streamPtr;
+			auto& file = stream.mFile;
+			auto remaining = frameCount;
+			while (remaining > 0)
+			{
+				auto blocksRead = stream.mBlocksRead.load();
+				if (blocksRead == stream.mBlocksWritten.load(std::memory_order_acquire))
+				{
+					if (stream.mIsEndOfFile.load())
+						break;
+
+					// The read ahead thread did not keep up
+					mUnderrunCount++;
+					auto count = std::min(remaining, mBlockSize);
+					stream.mEncoder.process(VBANInterleavedView(stream.mSilence.data(), file.getChannelCount(), file.getFormat()), file.getChannelCount(), count);
+					remaining -= count;
+					continue;
+				}
+
+				auto index = blocksRead % mBlockCount;
+				auto count = std::min(remaining, stream.mBlockFrames[index] - stream.mReadFrame);
+				auto data = stream.mBlocks[index].data() + static_cast<size_t>(stream.mReadFrame) * file.getFrameSize();
+				stream.mEncoder.process(VBANInterleavedView(data, file.getChannelCount(), file.getFormat()), file.getChannelCount(), count);
+				stream.mReadFrame += count;
+				remaining -= count;
+
+				if (stream.mReadFrame >= stream.mBlockFrames[index])
+				{
+					stream.mReadFrame = 0;
+					stream.mBlocksRead.store(blocksRead + 1, std::memory_order_release);
+					isBlockConsumed = true;
+				}
+			}
+		}
+
+		if (isBlockConsumed)
+			mCondition.notify_one();
+	}
+
+
+	template <typename EncoderType>
+	bool VBANFileStreamer<EncoderType>::isFinished() const
+	{
+		for (auto& stream : mStreams)
+			if (!stream->mIsEndOfFile.load() || stream->mBlocksRead.load() != stream->mBlocksWritten.load())
+				return false;
+		return true;
+	}
+
+
+	template <typename EncoderType>
+	void VBANFileStreamer<EncoderType>::run()
+	{
+		if (mNumaNode >= 0)
+			bindThreadToNumaNode(mNumaNode);
+
+		while (mIsRunning.load())
+		{
+			for (auto& stream : mStreams)
+				readAhead(*stream);
+
+			// Wait until process() consumed a block, with a timeout in case a notification came in before waiting
+			std::unique_lock<std::mutex> lock(mMutex);
+			if (mIsRunning.load())
+				mCondition.wait_for(lock, std::chrono::milliseconds(10));
+		}
+	}
+
+
+	template <typename EncoderType>
+	void VBANFileStreamer<EncoderType>::readAhead(Stream& stream)
+	{
+		while (!stream.mIsEndOfFile.load() && stream.mBlocksWritten.load() - stream.mBlocksRead.load(std::memory_order_acquire) < mBlockCount)
+		{
+			auto written = stream.mBlocksWritten.load();
+			auto index = written % mBlockCount;
+			auto& block = stream.mBlocks[index];
+			auto frames = stream.mFile.read(block.data(), mBlockSize);
+			if (frames < mBlockSize && mIsLooping.load() && stream.mFile.getFrameCount() > 0)
+			{
+				// Continue from the start of the file to fill the block, a file that yields nothing after rewinding ends the stream
+				while (frames < mBlockSize)
+				{
+					stream.mFile.rewind();
+					auto read = stream.mFile.read(block.data() + static_cast<size_t>(frames) * stream.mFile.getFrameSize(), mBlockSize - frames);
+					if (read <= 0)
+						break;
+					frames += read;
+				}
+			}
+
+			if (frames > 0)
+			{
+				stream.mBlockFrames[index] = frames;
+				stream.mBlocksWritten.store(written + 1, std::memory_order_release);
+			}
+
+			// Set after publishing the last block, so process() does not stop before it
+			if (frames < mBlockSize)
+				stream.mIsEndOfFile.store(true);
+		}
+	}
+
+}
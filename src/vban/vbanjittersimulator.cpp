@@ -0,0 +1,364 @@
+#include "vbanjittersimulator.h"
+#include "vbanstreamdecoder.h"
+#include "vban.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace vban
+{
+
+	static uint32_t readUnsigned(const unsigned char* data, int size, bool bigEndian)
+	{
+		uint32_t value = 0;
+		for (auto i = 0; i < size; ++i)
+			value |= uint32_t(data[bigEndian ? i : size - 1 - i]) << ((size - 1 - i) * 8);
+		return value;
+	}
+
+
+	/**
+	 * Finds the UDP payload in a captured frame.
+	 * @return The payload, or nullptr when the frame is not a complete unfragmented UDP datagram.
+	 */
+	static const unsigned char* findUdpPayload(const unsigned char* frame, int size, uint32_t linkType, int& payloadSize)
+	{
+		// Skip the link layer and find the network protocol
+		int offset = 0;
+		uint32_t protocol = 0;
+		switch (linkType)
+		{
+			case 0: // BSD loopback, address family in host order
+				if (size < 4)
+					return nullptr;
+				offset = 4;
+				protocol = (frame[0] == 2 || frame[3] == 2) ? 0x0800 : 0x86DD;
+				break;
+			case 1: // Ethernet, possibly with VLAN tags
+				offset = 12;
+				if (size < offset + 2)
+					return nullptr;
+				protocol = readUnsigned(frame + offset, 2, true);
+				offset += 2;
+				while ((protocol == 0x8100 || protocol == 0x88A8) && size >= offset + 4)
+				{
+					protocol = readUnsigned(frame + offset + 2, 2, true);
+					offset += 4;
+				}
+				break;
+			case 101: // Raw IP
+				if (size < 1)
+					return nullptr;
+				protocol = (frame[0] >> 4) == 4 ? 0x0800 : 0x86DD;
+				break;
+			case 113: // Linux cooked capture
+				if (size < 16)
+					return nullptr;
+				protocol = readUnsigned(frame + 14, 2, true);
+				offset = 16;
+				break;
+			case 276: // Linux cooked capture version 2
+				if (size < 20)
+					return nullptr;
+				protocol = readUnsigned(frame, 2, true);
+				offset = 20;
+				break;
+			default:
+				return nullptr;
+		}
+
+		// IP header, without IPv6 extension headers
+		auto ip = frame + offset;
+		auto ipSize = size - offset;
+		int udpOffset = 0;
+		if (protocol == 0x0800)
+		{
+			if (ipSize < 20 || (ip[0] >> 4) != 4 || ip[9] != 17)
+				return nullptr;
+			if ((readUnsigned(ip + 6, 2, true) & 0x3FFF) != 0)
+				return nullptr; // fragment
+			udpOffset = (ip[0] & 15) * 4;
+		}
+		else if (protocol == 0x86DD)
+		{
+			if (ipSize < 40 || (ip[0] >> 4) != 6 || ip[6] != 17)
+				return nullptr;
+			udpOffset = 40;
+		}
+		else
+			return nullptr;
+
+		if (ipSize < udpOffset + 8)
+			return nullptr;
+		auto udp = ip + udpOffset;
+		payloadSize = static_cast<int>(readUnsigned(udp + 4, 2, true)) - 8;
+		if (payloadSize < 0 || payloadSize > ipSize - udpOffset - 8)
+			return nullptr; // truncated by the capture
+		return udp + 8;
+	}
+
+
+	bool VBANJitterSimulator::loadCapture(const std::string& path, const std::string& streamName, std::string& error)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			error = "Failed to open " + path;
+			return false;
+		}
+
+		// The magic number gives the byte order and the resolution of the timestamps
+		unsigned char header[24];
+		if (!file.read(reinterpret_cast<char*>(header), sizeof(header)))
+		{
+			error = path + " is not a pcap file";
+			return false;
+		}
+		auto magic = readUnsigned(header, 4, false);
+		bool bigEndian;
+		double fractionScale;
+		if (magic == 0xA1B2C3D4 || magic == 0xD4C3B2A1)
+		{
+			bigEndian = magic == 0xD4C3B2A1;
+			fractionScale = 1e-6;
+		}
+		else if (magic == 0xA1B23C4D || magic == 0x4D3CB2A1)
+		{
+			bigEndian = magic == 0x4D3CB2A1;
+			fractionScale = 1e-9;
+		}
+		else {
+			error = path + " is not a pcap file, pcapng captures have to be converted first";
+			return false;
+		}
+		auto linkType = readUnsigned(header + 20, 4, bigEndian) & 0xFFFF;
+
+		char name[VBAN_STREAM_NAME_SIZE] = { };
+		std::memcpy(name, streamName.c_str(), std::min<size_t>(streamName.size(), VBAN_STREAM_NAME_SIZE));
+		auto hasStream = !streamName.empty();
+		std::vector<Arrival> arrivals;
+		std::vector<unsigned char> frame;
+		unsigned char record[16];
+		while (file.read(reinterpret_cast<char*>(record), sizeof(record)))
+		{
+			auto time = readUnsigned(record, 4, bigEndian) + readUnsigned(record + 4, 4, bigEndian) * fractionScale;
+			auto capturedSize = readUnsigned(record + 8, 4, bigEndian);
+			if (capturedSize > 0x40000)
+			{
+				error = path + " is corrupt";
+				return false;
+			}
+			frame.resize(capturedSize);
+			if (!file.read(reinterpret_cast<char*>(frame.data()), capturedSize))
+				break;
+
+			int size = 0;
+			auto payload = findUdpPayload(frame.data(), static_cast<int>(capturedSize), linkType, size);
+			if (payload == nullptr || size < VBAN_HEADER_SIZE)
+				continue;
+			VBanHeader packet;
+			std::memcpy(&packet, payload, VBAN_HEADER_SIZE);
+			if (std::memcmp(payload, "VBAN", 4) != 0 || (packet.format_SR & VBAN_PROTOCOL_MASK) != VBAN_PROTOCOL_AUDIO)
+				continue;
+
+			// The first audio packet picks the stream when no name is given
+			if (!hasStream)
+			{
+				std::memcpy(name, packet.streamname, VBAN_STREAM_NAME_SIZE);
+				hasStream = true;
+			}
+			if (std::strncmp(name, packet.streamname, VBAN_STREAM_NAME_SIZE) != 0)
+				continue;
+
+			if (arrivals.empty())
+			{
+				auto rateIndex = packet.format_SR & VBAN_SR_MASK;
+				if (rateIndex >= VBAN_SR_MAXNUMBER)
+				{
+					error = path + " holds a stream with an unknown sample rate";
+					return false;
+				}
+				mSamplesPerPacket = packet.format_nbs + 1;
+				mSampleRate = static_cast<int>(VBanSRList[rateIndex]);
+			}
+			arrivals.push_back({ time, packet.nuFrame });
+		}
+
+		if (arrivals.empty())
+		{
+			error = path + " holds no packets of the stream";
+			return false;
+		}
+		mArrivals = std::move(arrivals);
+		return true;
+	}
+
+
+	bool VBANJitterSimulator::loadTrace(const std::string& path, int samplesPerPacket, int sampleRate, std::string& error)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			error = "Failed to open " + path;
+			return false;
+		}
+
+		std::vector<Arrival> arrivals;
+		std::string line;
+		auto lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			if (line.empty() || line[0] == '#')
+				continue;
+			std::istringstream stream(line);
+			Arrival arrival;
+			int64_t frame = 0;
+			if (!(stream >> arrival.mTime >> frame))
+			{
+				error = path + " has an invalid line " + std::to_string(lineNumber);
+				return false;
+			}
+			arrival.mFrame = static_cast<uint32_t>(frame);
+			arrivals.push_back(arrival);
+		}
+
+		if (arrivals.empty())
+		{
+			error = path + " holds no arrivals";
+			return false;
+		}
+		setArrivals(arrivals, samplesPerPacket, sampleRate);
+		return true;
+	}
+
+
+	void VBANJitterSimulator::setArrivals(const std::vector<Arrival>& arrivals, int samplesPerPacket, int sampleRate)
+	{
+		assert(samplesPerPacket > 0 && samplesPerPacket <= 256 && sampleRate > 0);
+		mArrivals = arrivals;
+		mSamplesPerPacket = samplesPerPacket;
+		mSampleRate = sampleRate;
+	}
+
+
+	std::vector<VBANJitterSimulator::Result> VBANJitterSimulator::run(const std::vector<Config>& configs, int threadCount) const
+	{
+		if (threadCount <= 0)
+			threadCount = std::max<int>(1, std::thread::hardware_concurrency());
+		threadCount = std::min<int>(threadCount, configs.size());
+
+		// Every thread takes the next configuration that has not been simulated yet
+		std::vector<Result> results(configs.size());
+		std::atomic<size_t> next = { 0 };
+		auto work = [&]()
+		{
+			for (auto index = next++; index < configs.size(); index = next++)
+				results[index] = simulate(configs[index]);
+		};
+
+		std::vector<std::thread> threads;
+		for (auto i = 1; i < threadCount; ++i)
+			threads.emplace_back(work);
+		work();
+		for (auto& thread : threads)
+			thread.join();
+		return results;
+	}
+
+
+	VBANJitterSimulator::Result VBANJitterSimulator::simulate(const Config& config) const
+	{
+		Result result;
+		result.mConfig = config;
+		if (mArrivals.empty())
+			return result;
+
+		// Stand-in packet of a single 8 bit channel, only the frame number changes
+		char packet[VBAN_HEADER_SIZE + 256] = { };
+		auto header = reinterpret_cast<VBanHeader*>(packet);
+		header->vban = *(int32_t*)("VBAN");
+		header->format_SR = 3; // 48kHz, the decoder does not depend on the rate
+		header->format_nbs = static_cast<uint8_t>(mSamplesPerPacket - 1);
+		header->format_nbc = 0;
+		header->format_bit = VBAN_BITFMT_8_INT;
+		auto packetSize = VBAN_HEADER_SIZE + mSamplesPerPacket;
+
+		VBANStreamDecoder decoder(nullptr, config.mSlotCount);
+		decoder.setLatency(config.mLatency);
+		std::vector<std::vector<float>> output(1, std::vector<float>(config.mBufferSize));
+
+		// The sender sends frame f at (f - first) * packetDuration on its own timeline, the fastest packet of the trace sets the offset to the receiver.
+		// Positions are counted in samples from the first frame, so frame numbers that wrap around do not matter.
+		auto packetDuration = static_cast<double>(mSamplesPerPacket) / mSampleRate;
+		auto blockDuration = static_cast<double>(config.mBufferSize) / mSampleRate;
+		auto firstFrame = mArrivals.front().mFrame;
+		auto offset = mArrivals.front().mTime;
+		int64_t lastPosition = 0;
+		for (auto& arrival : mArrivals)
+		{
+			auto frame = static_cast<int32_t>(arrival.mFrame - firstFrame);
+			offset = std::min(offset, arrival.mTime - frame * packetDuration);
+			lastPosition = std::max<int64_t>(lastPosition, (static_cast<int64_t>(frame) + 1) * mSamplesPerPacket);
+		}
+
+		// The audio thread runs from the first arrival until the last packet has been played
+		auto time = mArrivals.front().mTime;
+		size_t arrival = 0;
+		auto hasStarted = false;
+		double playingTime = 0.0;
+		double refillTime = 0.0;
+		double latencySum = 0.0;
+		int64_t latencyCount = 0;
+		while (true)
+		{
+			// Deliver the packets that arrived before this call of the audio thread
+			for (; arrival < mArrivals.size() && mArrivals[arrival].mTime <= time; ++arrival)
+			{
+				header->nuFrame = mArrivals[arrival].mFrame;
+				if (!decoder.receivePacket(packet, packetSize))
+					result.mLatePacketCount++;
+			}
+
+			decoder.process(output, 1, config.mBufferSize);
+			time += blockDuration;
+
+			auto position = decoder.getPlayPosition();
+			if (position >= 0)
+			{
+				auto readFrame = decoder.getReadFrame();
+				position += (static_cast<int32_t>(static_cast<uint32_t>(readFrame) - firstFrame) - readFrame) * mSamplesPerPacket;
+			}
+			if (arrival == mArrivals.size() && (position < 0 || position >= lastPosition))
+				break;
+
+			if (position >= 0)
+			{
+				// The last sample of the block plays at the end of the block
+				auto sendTime = static_cast<double>(position) / mSampleRate;
+				auto latency = time - offset - sendTime;
+				latencySum += latency;
+				latencyCount++;
+				result.mMaxLatency = std::max(result.mMaxLatency, latency * 1000.0);
+				playingTime += blockDuration;
+				hasStarted = true;
+			}
+			else if (hasStarted)
+				refillTime += blockDuration;
+		}
+
+		auto lostPacketCount = decoder.getLostPacketCount();
+		result.mLostPacketCount = lostPacketCount;
+		result.mUnderrunCount = decoder.getUnderrunCount();
+		result.mMeanLatency = latencyCount > 0 ? latencySum / latencyCount * 1000.0 : 0.0;
+		result.mLossRatio = playingTime > 0.0 ? std::min(1.0, lostPacketCount * packetDuration / playingTime) : 0.0;
+		result.mConcealmentTime = (lostPacketCount * packetDuration + refillTime) * 1000.0;
+		return result;
+	}
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vban
+{
+
+	/**
+	 * Replays the arrival times of a recorded stream through VBANStreamDecoder with many jitter buffer configurations, to choose the settings of a receiver from measurements.
+	 * The arrivals are loaded from a packet capture of the stream or from a text trace, then every configuration is simulated on its own decoder fed with small stand-in packets at the recorded times.
+	 * The decoder is the one used on the receiver, so the results follow its buffering, loss and refill behaviour exactly. The configurations are spread over a number of threads.
+	 * Lost packets are concealed with silence by the decoder, so the concealment time is the time the output was silent after playback started.
+	 */
+	class VBANJitterSimulator
+	{
+	public:
+		/**
+		 * Arrival of a packet
+		 */
+		struct Arrival
+		{
+			double mTime = 0.0; // Arrival time in seconds
+			uint32_t mFrame = 0; // Frame number of the packet
+		};
+
+		/**
+		 * Settings of the receiver to simulate
+		 */
+		struct Config
+		{
+			int mLatency = 3; // Number of packets buffered before playback starts, see VBANStreamDecoder::setLatency()
+			int mSlotCount = 64; // Number of packets the jitter buffer can hold, a power of two larger than twice the latency
+			int mBufferSize = 256; // Number of samples the audio thread reads per call
+		};
+
+		/**
+		 * Outcome of a configuration
+		 */
+		struct Result
+		{
+			Config mConfig;
+			double mMeanLatency = 0.0; // Average time in ms between the arrival of the fastest packet of the trace and playback, on the timeline of the sender
+			double mMaxLatency = 0.0; // Highest latency in ms
+			int mLostPacketCount = 0; // Packets that were not in the jitter buffer when they had to be played
+			int mLatePacketCount = 0; // Packets that arrived but were rejected because their turn had passed
+			double mLossRatio = 0.0; // Share of the played packets that were lost
+			int mUnderrunCount = 0; // Number of times the jitter buffer ran empty and had to fill up again
+			double mConcealmentTime = 0.0; // Time in ms the output was silent after playback started, for lost packets and refills
+		};
+
+		/**
+		 * Reads the arrivals of a stream from a capture in the classic pcap format, with ethernet, linux cooked, loopback or raw IP link layers.
+		 * The packet size and sample rate are taken from the first packet of the stream.
+		 * @param path Path to the capture
+		 * @param streamName Name of the stream to read, or empty to take the stream of the first VBAN audio packet.
+		 * @param error Contains the error message when reading fails
+		 * @return True on success
+		 */
+		bool loadCapture(const std::string& path, const std::string& streamName, std::string& error);
+
+		/**
+		 * Reads the arrivals from a text file with a line per packet, holding the arrival time in seconds and the frame number. Lines starting with # are skipped.
+		 * @param path Path to the trace
+		 * @param samplesPerPacket Number of samples per packet of the recorded stream
+		 * @param sampleRate Sample rate of the recorded stream
+		 * @param error Contains the error message when reading fails
+		 * @return True on success
+		 */
+		bool loadTrace(const std::string& path, int samplesPerPacket, int sampleRate, std::string& error);
+
+		/**
+		 * Sets the arrivals directly.
+		 * @param arrivals Arrivals in the order they were received
+		 * @param samplesPerPacket Number of samples per packet of the stream
+		 * @param sampleRate Sample rate of the stream
+		 */
+		void setArrivals(const std::vector<Arrival>& arrivals, int samplesPerPacket, int sampleRate);
+
+		/**
+		 * Simulates all configurations.
+		 * @param configs Configurations to simulate
+		 * @param threadCount Number of threads to use, or 0 for one per cpu core.
+		 * @return A result for every configuration, in the same order.
+		 */
+		std::vector<Result> run(const std::vector<Config>& configs, int threadCount = 0) const;
+
+		/**
+		 * Simulates a single configuration on the calling thread.
+		 */
+		Result simulate(const Config& config) const;
+
+		/**
+		 * @return The loaded arrivals
+		 */
+		const std::vector<Arrival>& getArrivals() const { return mArrivals; }
+
+		/**
+		 * @return Number of samples per packet of the loaded stream
+		 */
+		int getSamplesPerPacket() const { return mSamplesPerPacket; }
+
+		/**
+		 * @return Sample rate of the loaded stream
+		 */
+		int getSampleRate() const { return mSampleRate; }
+
+	private:
+		std::vector<Arrival> mArrivals;
+		int mSamplesPerPacket = 256;
+		int mSampleRate = 48000;
+	};
+
+}
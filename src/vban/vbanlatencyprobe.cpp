@@ -0,0 +1,167 @@
+#include "vbanlatencyprobe.h"
+
+#include <algorithm>
+
+namespace vban
+{
+
+	VBANLatencyMonitor::VBANLatencyMonitor()
+	{
+		reset();
+	}
+
+
+	void VBANLatencyMonitor::receivePacket(const char* data, int size, int64_t now)
+	{
+		if (size < VBAN_HEADER_SIZE || std::memcmp(data, "VBAN", 4) != 0)
+			return;
+
+		auto header = reinterpret_cast<const VBanHeader*>(data);
+		if (!mHasStream)
+		{
+			std::memcpy(mStreamName, header->streamname, VBAN_STREAM_NAME_SIZE);
+			mHasStream = true;
+		}
+		if (std::strncmp(mStreamName, header->streamname, VBAN_STREAM_NAME_SIZE) != 0)
+			return;
+
+		auto isUserCodec = (header->format_bit & VBAN_CODEC_MASK) == VBAN_CODEC_USER && size > VBAN_HEADER_SIZE;
+		if (isUserCodec && data[VBAN_HEADER_SIZE] == VBAN_USER_CODEC_TIMESTAMPS)
+		{
+			auto recordCount = header->format_nbs + 1;
+			if (size != VBAN_TIMESTAMP_OFFSET + recordCount * VBAN_TIMESTAMP_RECORD_SIZE)
+				return;
+			for (auto i = 0; i < recordCount; ++i)
+			{
+				auto record = data + VBAN_TIMESTAMP_OFFSET + i * VBAN_TIMESTAMP_RECORD_SIZE;
+				auto& slot = getSlot(header->nuFrame + i);
+				std::memcpy(&slot.mStartTime, record, 8);
+				std::memcpy(&slot.mEnqueueTime, record + 8, 8);
+				std::memcpy(&slot.mSendTime, record + 16, 8);
+				combine(slot);
+			}
+		}
+		else if (!isUserCodec || data[VBAN_HEADER_SIZE] != VBAN_USER_CODEC_NACK)
+		{
+			// Retransmitted and duplicate packets keep the time of the first arrival
+			auto& slot = getSlot(header->nuFrame);
+			if (slot.mReceiveTime.load(std::memory_order_relaxed) == 0)
+				slot.mReceiveTime.store(now, std::memory_order_release);
+			combine(slot);
+		}
+	}
+
+
+	void VBANLatencyMonitor::endRead(int64_t readFrame, int64_t now)
+	{
+		if (readFrame < 0)
+		{
+			mLastReadFrame = -1;
+			return;
+		}
+		add(Stage::Decode, now - mReadStartTime);
+
+		// The frames the decoder moved on to during this read started playing at its start, the first frame after a start is skipped as it started earlier
+		if (mLastReadFrame >= 0)
+		{
+			auto count = std::min<int64_t>(static_cast<int32_t>(readFrame - mLastReadFrame), mSlotCount);
+			for (auto i = count - 1; i >= 0; --i)
+			{
+				auto frame = static_cast<uint32_t>(readFrame - i);
+				auto& slot = mSlots[frame % mSlotCount];
+				if (slot.mFrame.load(std::memory_order_acquire) != frame)
+					continue;
+				auto receiveTime = slot.mReceiveTime.load(std::memory_order_acquire);
+				if (receiveTime != 0 && slot.mFrame.load(std::memory_order_relaxed) == frame)
+					add(Stage::JitterBuffer, mReadStartTime - receiveTime);
+			}
+		}
+		mLastReadFrame = readFrame;
+	}
+
+
+	void VBANLatencyMonitor::reset()
+	{
+		for (auto stage = 0; stage < static_cast<int>(Stage::Count); ++stage)
+		{
+			for (auto& count : mHistograms[stage])
+				count.store(0);
+			mCounts[stage].store(0);
+			mSums[stage].store(0);
+			mMaxima[stage].store(0);
+		}
+	}
+
+
+	double VBANLatencyMonitor::getMean(Stage stage) const
+	{
+		auto count = mCounts[static_cast<int>(stage)].load();
+		return count > 0 ? static_cast<double>(mSums[static_cast<int>(stage)].load()) / count : 0.0;
+	}
+
+
+	VBANLatencyMonitor::Slot& VBANLatencyMonitor::getSlot(uint32_t frame)
+	{
+		auto& slot = mSlots[frame % mSlotCount];
+		if (slot.mFrame.load(std::memory_order_relaxed) != frame)
+		{
+			// The audio thread checks the frame before and after reading the receive time
+			slot.mFrame.store(-1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.mReceiveTime.store(0, std::memory_order_relaxed);
+			slot.mStartTime = 0;
+			slot.mEnqueueTime = 0;
+			slot.mSendTime = 0;
+			slot.mIsCombined = false;
+			slot.mFrame.store(frame, std::memory_order_release);
+		}
+		return slot;
+	}
+
+
+	void VBANLatencyMonitor::combine(Slot& slot)
+	{
+		auto receiveTime = slot.mReceiveTime.load(std::memory_order_relaxed);
+		if (slot.mIsCombined || receiveTime == 0 || slot.mSendTime == 0)
+			return;
+		slot.mIsCombined = true;
+
+		// The smallest difference between receive and send time over the last window, taken as the offset between the clocks
+		auto difference = receiveTime - slot.mSendTime;
+		if (mOffsetCount == 0 || difference < mOffsetMinimum)
+			mOffsetMinimum = difference;
+		if (++mOffsetCount == mOffsetWindow)
+		{
+			mPreviousOffsetMinimum = mOffsetMinimum;
+			mHasPreviousOffset = true;
+			mOffsetCount = 0;
+		}
+		auto offset = mHasPreviousOffset ? std::min(mOffsetMinimum, mPreviousOffsetMinimum) : mOffsetMinimum;
+		if (!mIsEstimatingOffset.load())
+			offset = 0;
+		mClockOffset.store(offset);
+
+		// The start time is 0 when the probe is not told when the encoder starts a block
+		if (slot.mStartTime != 0)
+			add(Stage::Encode, slot.mEnqueueTime - slot.mStartTime);
+		add(Stage::SendQueue, slot.mSendTime - slot.mEnqueueTime);
+		add(Stage::Network, difference - offset);
+	}
+
+
+	void VBANLatencyMonitor::add(Stage stage, int64_t duration)
+	{
+		auto microseconds = std::max<int64_t>(0, duration / 1000);
+		auto bucket = 0;
+		while (bucket < mBucketCount - 1 && microseconds >= getBucketLimit(bucket))
+			bucket++;
+
+		auto index = static_cast<int>(stage);
+		mHistograms[index][bucket]++;
+		mCounts[index]++;
+		mSums[index] += microseconds;
+		auto maximum = mMaxima[index].load();
+		while (microseconds > maximum && !mMaxima[index].compare_exchange_weak(maximum, microseconds));
+	}
+
+}
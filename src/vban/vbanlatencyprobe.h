@@ -0,0 +1,307 @@
+#pragma once
+
+#include "vban.h"
+#include "vbanusercodec.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace vban
+{
+
+	/**
+	 * @return The current time of the steady clock in nanoseconds, the time base of the latency measurements.
+	 */
+	inline int64_t getLatencyTime() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+
+	/**
+	 * Optional instrumentation of a sender to find out where the latency of a stream goes, together with VBANLatencyMonitor on the receiver.
+	 * The probe is used as the SenderType of a VBANStreamEncoder. It notes when the encoder starts a block, when each packet is handed to the sender and when the sender has sent it.
+	 * After every batch these times are sent as a timestamp packet alongside the audio, keyed by the frame numbers of the packets, so the audio packets themselves are not changed.
+	 * The send time is taken when flush() of the sender returns, senders without flush() are taken to send in sendPacket().
+	 * When disabled the probe only forwards the packets.
+	 * @tparam SenderType The sender the packets are forwarded to, see VBANStreamEncoder.
+	 */
+	template <typename SenderType>
+	class VBANLatencyProbe
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param sender The sender the packets of the encoder are forwarded to
+		 */
+		explicit VBANLatencyProbe(SenderType& sender) : mSender(sender) { mTimestampPacket.reserve(VBAN_TIMESTAMP_OFFSET + VBAN_TIMESTAMP_MAX_RECORDS * VBAN_TIMESTAMP_RECORD_SIZE); }
+
+		// Default destructor
+		virtual ~VBANLatencyProbe() = default;
+
+		/**
+		 * Enables or disables sending the timestamps.
+		 */
+		void setEnabled(bool enabled) { mIsEnabled.store(enabled); }
+
+		/**
+		 * Called by the encoder on the audio thread at the start of every process() call, notes the time and forwards the call to the sender when it implements beginProcess().
+		 */
+		void beginProcess()
+		{
+			mStartTime = getLatencyTime();
+			beginProcess(mSender, 0);
+		}
+
+		/**
+		 * Called by the encoder on the audio thread at the end of every process() call, forwarded to the sender when it implements endProcess().
+		 */
+		void endProcess() { endProcess(mSender, 0); }
+
+		/**
+		 * Called by the encoder on the audio thread, notes the time and forwards the packet to the sender.
+		 * @param data The vban packet to be sent.
+		 */
+		void sendPacket(const std::vector<char>& data);
+
+		/**
+		 * Called by the encoder on the audio thread after a batch of packets. Flushes the sender, then sends the timestamps of the batch.
+		 */
+		void flush();
+
+	private:
+		// Times of a packet of the current batch
+		struct Record
+		{
+			uint32_t mFrame;
+			int64_t mStartTime;
+			int64_t mEnqueueTime;
+		};
+
+		template <typename T>
+		static auto flush(T& sender, int) -> decltype(sender.flush(), void()) { sender.flush(); }
+		template <typename T>
+		static void flush(T&, long) { }
+		template <typename T>
+		static auto beginProcess(T& sender, int) -> decltype(sender.beginProcess(), void()) { sender.beginProcess(); }
+		template <typename T>
+		static void beginProcess(T&, long) { }
+		template <typename T>
+		static auto endProcess(T& sender, int) -> decltype(sender.endProcess(), void()) { sender.endProcess(); }
+		template <typename T>
+		static void endProcess(T&, long) { }
+
+		SenderType& mSender;
+		std::atomic<bool> mIsEnabled = { true };
+		int64_t mStartTime = 0; // 0 while the encoder does not call beginProcess()
+		Record mRecords[VBAN_TIMESTAMP_MAX_RECORDS];
+		int mRecordCount = 0;
+		char mStreamName[VBAN_STREAM_NAME_SIZE] = { };
+		uint8_t mSampleRateFormat = 0;
+		std::vector<char> mTimestampPacket;
+	};
+
+
+	/**
+	 * Breaks down the latency of a stream into the stages it passes, from the timestamps sent by a VBANLatencyProbe on the sender and the times the receiver gets and plays the packets.
+	 * Every stage is collected in a histogram with logarithmic buckets:
+	 * Encode, from the start of the block on the encoder until the packet is handed to the sender. Only measured when the encoder calls beginProcess() of the probe, also through a VBANRetransmitCache or VBANSenderHandle.
+	 * SendQueue, until the sender has sent the packet.
+	 * Network, until the packet is received, on top of the smallest transit time seen, see below.
+	 * JitterBuffer, until the decoder starts playing the packet.
+	 * Decode, the duration of a read of the decoder.
+	 * The sender and the receiver can be different processes. Their steady clocks are aligned by a running minimum of the difference between receive and send time over the last packets, which takes the smallest transit as the offset between the clocks.
+	 * On one host the steady clocks of processes are the same, the estimation can then be disabled to also measure the smallest transit.
+	 * The network thread passes the packets of the stream in with receivePacket(), the audio thread surrounds the reads of the decoder with beginRead() and endRead().
+	 */
+	class VBANLatencyMonitor
+	{
+	public:
+		/**
+		 * Stages of the path from the sender to the output
+		 */
+		enum class Stage
+		{
+			Encode = 0,
+			SendQueue,
+			Network,
+			JitterBuffer,
+			Decode,
+			Count
+		};
+
+		// Bucket 0 holds durations below 1 microsecond, bucket b durations from 2^(b-1) up to 2^b microseconds, the last bucket everything longer
+		static constexpr int mBucketCount = 24;
+
+		// Number of frames the monitor keeps the times of
+		static constexpr int mSlotCount = 256;
+
+		// Number of packets the clock offset is the minimum over, at least
+		static constexpr int mOffsetWindow = 1024;
+
+		// Constructor
+		VBANLatencyMonitor();
+
+		/**
+		 * Enables the estimation of the clock offset between sender and receiver. When disabled the clocks are taken to be the same.
+		 */
+		void setClockOffsetEstimation(bool enabled) { mIsEstimatingOffset.store(enabled); }
+
+		/**
+		 * Call this method from the network thread for every received packet of the stream, the audio packets and the timestamp packets.
+		 * The stream is the one of the first packet.
+		 * @param data The packet
+		 * @param size Size of the packet in bytes
+		 * @param now Time of arrival, see getLatencyTime()
+		 */
+		void receivePacket(const char* data, int size, int64_t now);
+
+		/**
+		 * Call this method from the audio thread right before VBANStreamDecoder::process().
+		 * @param now Current time, see getLatencyTime()
+		 */
+		void beginRead(int64_t now) { mReadStartTime = now; }
+
+		/**
+		 * Call this method from the audio thread right after VBANStreamDecoder::process().
+		 * @param readFrame Frame the decoder is playing, see VBANStreamDecoder::getReadFrame()
+		 * @param now Current time, see getLatencyTime()
+		 */
+		void endRead(int64_t readFrame, int64_t now);
+
+		/**
+		 * Clears the histograms.
+		 */
+		void reset();
+
+		/**
+		 * @return Number of measurements of a stage in a bucket
+		 */
+		int getCount(Stage stage, int bucket) const { return mHistograms[static_cast<int>(stage)][bucket].load(); }
+
+		/**
+		 * @return Total number of measurements of a stage
+		 */
+		int getTotalCount(Stage stage) const { return mCounts[static_cast<int>(stage)].load(); }
+
+		/**
+		 * @return Average duration of a stage in microseconds
+		 */
+		double getMean(Stage stage) const;
+
+		/**
+		 * @return Longest duration of a stage in microseconds
+		 */
+		int64_t getMax(Stage stage) const { return mMaxima[static_cast<int>(stage)].load(); }
+
+		/**
+		 * @return Estimated time of the receiver minus the time of the sender in nanoseconds, including the smallest transit.
+		 */
+		int64_t getClockOffset() const { return mClockOffset.load(); }
+
+		/**
+		 * @return Upper limit of the durations in a bucket in microseconds
+		 */
+		static int64_t getBucketLimit(int bucket) { return int64_t(1) << bucket; }
+
+	private:
+		// Times of a frame, 0 when unknown
+		struct Slot
+		{
+			std::atomic<int64_t> mFrame = { -1 }; // -1 while empty or being reset
+			std::atomic<int64_t> mReceiveTime = { 0 };
+			int64_t mStartTime = 0;
+			int64_t mEnqueueTime = 0;
+			int64_t mSendTime = 0;
+			bool mIsCombined = false; // Whether the sender stages have been added
+		};
+
+		/**
+		 * @return The slot of a frame, reset when it held another frame. Network thread only.
+		 */
+		Slot& getSlot(uint32_t frame);
+
+		/**
+		 * Adds the stages of the sender and the network once both the timestamps and the packet of a frame have arrived.
+		 */
+		void combine(Slot& slot);
+
+		/**
+		 * Adds a measurement to the histogram of a stage.
+		 */
+		void add(Stage stage, int64_t duration);
+
+		Slot mSlots[mSlotCount];
+		std::atomic<bool> mIsEstimatingOffset = { true };
+		bool mHasStream = false;
+		char mStreamName[VBAN_STREAM_NAME_SIZE] = { };
+
+		// Clock offset, the minimum of the current and the previous window
+		std::atomic<int64_t> mClockOffset = { 0 };
+		int64_t mOffsetMinimum = 0;
+		int64_t mPreviousOffsetMinimum = 0;
+		bool mHasPreviousOffset = false;
+		int mOffsetCount = 0;
+
+		// Audio thread
+		int64_t mReadStartTime = 0;
+		int64_t mLastReadFrame = -1;
+
+		std::atomic<int> mHistograms[static_cast<int>(Stage::Count)][mBucketCount];
+		std::atomic<int> mCounts[static_cast<int>(Stage::Count)];
+		std::atomic<int64_t> mSums[static_cast<int>(Stage::Count)];
+		std::atomic<int64_t> mMaxima[static_cast<int>(Stage::Count)];
+	};
+
+
+	template <typename SenderType>
+	void VBANLatencyProbe<SenderType>::sendPacket(const std::vector<char>& data)
+	{
+		if (!mIsEnabled.load() || data.size() < VBAN_HEADER_SIZE)
+		{
+			mSender.sendPacket(data);
+			return;
+		}
+
+		// Frames that do not follow the batch start a new one
+		auto header = reinterpret_cast<const VBanHeader*>(data.data());
+		if (mRecordCount == VBAN_TIMESTAMP_MAX_RECORDS || (mRecordCount > 0 && header->nuFrame != mRecords[mRecordCount - 1].mFrame + 1))
+			flush();
+		mSender.sendPacket(data);
+		std::memcpy(mStreamName, header->streamname, VBAN_STREAM_NAME_SIZE);
+		mSampleRateFormat = header->format_SR;
+		mRecords[mRecordCount++] = { header->nuFrame, mStartTime, getLatencyTime() };
+	}
+
+
+	template <typename SenderType>
+	void VBANLatencyProbe<SenderType>::flush()
+	{
+		flush(mSender, 0);
+		if (mRecordCount == 0)
+			return;
+
+		// Every packet of the batch has been sent now
+		auto sendTime = getLatencyTime();
+		mTimestampPacket.assign(VBAN_TIMESTAMP_OFFSET + mRecordCount * VBAN_TIMESTAMP_RECORD_SIZE, 0);
+		auto header = reinterpret_cast<VBanHeader*>(mTimestampPacket.data());
+		header->vban = *(int32_t*)("VBAN");
+		header->format_SR = mSampleRateFormat;
+		header->format_nbs = static_cast<uint8_t>(mRecordCount - 1);
+		header->format_bit = VBAN_CODEC_USER;
+		std::memcpy(header->streamname, mStreamName, VBAN_STREAM_NAME_SIZE);
+		header->nuFrame = mRecords[0].mFrame;
+		mTimestampPacket[VBAN_HEADER_SIZE] = VBAN_USER_CODEC_TIMESTAMPS;
+		for (auto i = 0; i < mRecordCount; ++i)
+		{
+			auto record = mTimestampPacket.data() + VBAN_TIMESTAMP_OFFSET + i * VBAN_TIMESTAMP_RECORD_SIZE;
+			std::memcpy(record, &mRecords[i].mStartTime, 8);
+			std::memcpy(record + 8, &mRecords[i].mEnqueueTime, 8);
+			std::memcpy(record + 16, &sendTime, 8);
+		}
+		mRecordCount = 0;
+
+		mSender.sendPacket(mTimestampPacket);
+		flush(mSender, 0);
+	}
+
+}
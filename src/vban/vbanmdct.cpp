@@ -0,0 +1,379 @@
+#include "vbanmdct.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace vban
+{
+
+	static constexpr int frameSize = VBAN_MDCT_FRAME_SIZE;
+	static constexpr int halfFrameSize = VBAN_MDCT_FRAME_SIZE / 2;
+
+	// Number of coefficients in each band, narrow at low frequencies
+	static constexpr int bandWidths[VBAN_MDCT_BAND_COUNT] = { 2, 2, 2, 2, 4, 4, 4, 4, 6, 6, 8, 8, 12, 16, 20, 28 };
+
+	// Bonus of the low bands in the bit allocation, in sixteenths of a bit per coefficient
+	static constexpr int bandTilt[VBAN_MDCT_BAND_COUNT] = { 8, 8, 8, 8, 6, 6, 6, 6, 4, 4, 2, 2, 0, 0, 0, 0 };
+
+	// Range of the scale factors, the coefficients of a band are at most 2 to the power of its scale factor
+	static constexpr int minExponent = -24; // The band is silent
+	static constexpr int maxExponent = 7;
+
+	// Largest number of bits per coefficient
+	static constexpr int maxBits = 12;
+
+
+	/**
+	 * Complex multiplication without the checks for infinities of the operator of std::complex, which is not inlined.
+	 */
+	static inline std::complex<float> multiply(const std::complex<float>& a, const std::complex<float>& b)
+	{
+		return std::complex<float>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+	}
+
+
+	/**
+	 * Writes values of up to 24 bits into a byte buffer, most significant bit first.
+	 */
+	class BitWriter
+	{
+	public:
+		BitWriter(unsigned char* data, int size) : mData(data), mSize(size) { }
+
+		void write(uint32_t value, int count)
+		{
+			mAccumulator = (mAccumulator << count) | value;
+			mCount += count;
+			while (mCount >= 8)
+			{
+				mCount -= 8;
+				if (mPosition < mSize)
+					mData[mPosition++] = static_cast<unsigned char>(mAccumulator >> mCount);
+			}
+		}
+
+		// Writes the remaining bits and pads the buffer with zeros
+		void flush()
+		{
+			if (mCount > 0)
+				write(0, 8 - mCount);
+			while (mPosition < mSize)
+				mData[mPosition++] = 0;
+		}
+
+	private:
+		unsigned char* mData;
+		int mSize;
+		int mPosition = 0;
+		uint64_t mAccumulator = 0;
+		int mCount = 0;
+	};
+
+
+	/**
+	 * Reads values written by BitWriter, reading past the end returns zeros.
+	 */
+	class BitReader
+	{
+	public:
+		BitReader(const unsigned char* data, int size) : mData(data), mSize(size) { }
+
+		uint32_t read(int count)
+		{
+			while (mCount < count)
+			{
+				mAccumulator = (mAccumulator << 8) | (mPosition < mSize ? mData[mPosition] : 0);
+				mPosition++;
+				mCount += 8;
+			}
+			mCount -= count;
+			return static_cast<uint32_t>(mAccumulator >> mCount) & ((1u << count) - 1);
+		}
+
+	private:
+		const unsigned char* mData;
+		int mSize;
+		int mPosition = 0;
+		uint64_t mAccumulator = 0;
+		int mCount = 0;
+	};
+
+
+	/**
+	 * Allocates the bits of a coded channel to the bands, from the scale factors only.
+	 * Every halving of the level of a band costs one bit per coefficient, which minimizes the quantization noise power for the available bits.
+	 * The allocation threshold is searched in sixteenths of a bit, leftover bits go to the lowest bands.
+	 * @param exponents Scale factor of every band
+	 * @param budget Number of bits available for the coefficients
+	 * @param bits Receives the number of bits per coefficient of every band
+	 */
+	static void allocateBits(const int* exponents, int budget, int* bits)
+	{
+		auto allocate = [&](int threshold)
+		{
+			int total = 0;
+			for (auto band = 0; band < VBAN_MDCT_BAND_COUNT; ++band)
+			{
+				auto level = 16 * (exponents[band] - minExponent) + bandTilt[band] - threshold;
+				bits[band] = exponents[band] <= minExponent || level <= 0 ? 0 : std::min(level >> 4, maxBits);
+				total += bits[band] * bandWidths[band];
+			}
+			return total;
+		};
+
+		// Smallest threshold that fits the budget
+		int low = 0;
+		int high = 16 * (maxExponent - minExponent + 1) + bandTilt[0];
+		while (low < high)
+		{
+			auto middle = (low + high) / 2;
+			if (allocate(middle) <= budget)
+				high = middle;
+			else
+				low = middle + 1;
+		}
+		auto remaining = budget - allocate(low);
+
+		for (auto band = 0; band < VBAN_MDCT_BAND_COUNT; ++band)
+		{
+			if (bits[band] > 0 && bits[band] < maxBits && bandWidths[band] <= remaining)
+			{
+				bits[band]++;
+				remaining -= bandWidths[band];
+			}
+		}
+	}
+
+
+	VBANMdct::VBANMdct()
+	{
+		const double pi = 3.14159265358979323846;
+		mWindow.resize(2 * frameSize);
+		for (auto n = 0; n < 2 * frameSize; ++n)
+			mWindow[n] = static_cast<float>(std::sin(pi * (n + 0.5) / (2 * frameSize)));
+
+		mPreTwiddle.resize(halfFrameSize);
+		mPostTwiddle.resize(halfFrameSize);
+		for (auto n = 0; n < halfFrameSize; ++n)
+		{
+			mPreTwiddle[n] = std::polar(1.f, static_cast<float>(-pi * (4 * n + 1) / (4 * frameSize)));
+			mPostTwiddle[n] = std::polar(1.f, static_cast<float>(-pi * n / frameSize));
+		}
+
+		mFftTwiddle.resize(halfFrameSize / 2);
+		for (auto k = 0; k < halfFrameSize / 2; ++k)
+			mFftTwiddle[k] = std::polar(1.f, static_cast<float>(-2 * pi * k / halfFrameSize));
+
+		int bitCount = 0;
+		while ((1 << bitCount) < halfFrameSize)
+			bitCount++;
+		mBitReverse.resize(halfFrameSize);
+		for (auto n = 0; n < halfFrameSize; ++n)
+		{
+			int reversed = 0;
+			for (auto bit = 0; bit < bitCount; ++bit)
+				if (n & (1 << bit))
+					reversed |= 1 << (bitCount - 1 - bit);
+			mBitReverse[n] = reversed;
+		}
+
+		mFolded.resize(frameSize);
+		mComplex.resize(halfFrameSize);
+	}
+
+
+	void VBANMdct::forward(const float* input, float* output)
+	{
+		// Fold the windowed quarters a, b, c, d into (-c_r - d, a - b_r)
+		auto quarter = halfFrameSize;
+		auto& w = mWindow;
+		for (auto n = 0; n < quarter; ++n)
+		{
+			auto c = w[frameSize + quarter - 1 - n] * input[frameSize + quarter - 1 - n];
+			auto d = w[frameSize + quarter + n] * input[frameSize + quarter + n];
+			auto a = w[n] * input[n];
+			auto b = w[frameSize - 1 - n] * input[frameSize - 1 - n];
+			output[n] = -c - d;
+			output[quarter + n] = a - b;
+		}
+		dct4(output);
+
+		// Scaled so a full scale sine gives coefficients around 1
+		const float scale = 2.f / frameSize;
+		for (auto k = 0; k < frameSize; ++k)
+			output[k] *= scale;
+	}
+
+
+	void VBANMdct::inverse(const float* input, float* output)
+	{
+		std::copy(input, input + frameSize, mFolded.begin());
+		dct4(mFolded.data());
+
+		// Unfold (u1, u2) into (u2, -u2_r, -u1_r, -u1) and window
+		auto quarter = halfFrameSize;
+		auto& u = mFolded;
+		auto& w = mWindow;
+		for (auto n = 0; n < quarter; ++n)
+		{
+			output[n] = w[n] * u[quarter + n];
+			output[quarter + n] = -w[quarter + n] * u[frameSize - 1 - n];
+			output[frameSize + n] = -w[frameSize + n] * u[quarter - 1 - n];
+			output[frameSize + quarter + n] = -w[frameSize + quarter + n] * u[n];
+		}
+	}
+
+
+	void VBANMdct::dct4(float* data)
+	{
+		// Pairs of values form a complex sequence of half the size, rotated before and after the FFT
+		for (auto n = 0; n < halfFrameSize; ++n)
+			mComplex[mBitReverse[n]] = multiply(std::complex<float>(data[2 * n], data[frameSize - 1 - 2 * n]), mPreTwiddle[n]);
+		fft(mComplex.data());
+		for (auto k = 0; k < halfFrameSize; ++k)
+		{
+			auto value = multiply(mComplex[k], mPostTwiddle[k]);
+			data[2 * k] = value.real();
+			data[frameSize - 1 - 2 * k] = -value.imag();
+		}
+	}
+
+
+	void VBANMdct::fft(std::complex<float>* data)
+	{
+		// The input is in bit reversed order
+		for (auto size = 2; size <= halfFrameSize; size *= 2)
+		{
+			auto half = size / 2;
+			auto step = halfFrameSize / size;
+			for (auto start = 0; start < halfFrameSize; start += size)
+			{
+				for (auto k = 0; k < half; ++k)
+				{
+					auto odd = multiply(data[start + half + k], mFftTwiddle[k * step]);
+					auto even = data[start + k];
+					data[start + k] = even + odd;
+					data[start + half + k] = even - odd;
+				}
+			}
+		}
+	}
+
+
+	void VBANMdctEncoder::setChannelCount(int channelCount)
+	{
+		mHistory.assign(channelCount * frameSize, 0.f);
+	}
+
+
+	void VBANMdctEncoder::encode(int channel, const float* input, unsigned char* output, int size)
+	{
+		assert(size >= VBAN_MDCT_MIN_CHANNEL_SIZE);
+		auto history = mHistory.data() + channel * frameSize;
+		std::copy(history, history + frameSize, mWindow);
+		std::copy(input, input + frameSize, mWindow + frameSize);
+		std::copy(input, input + frameSize, history);
+		mMdct.forward(mWindow, mCoefficients);
+
+		// Scale factor of every band
+		int exponents[VBAN_MDCT_BAND_COUNT];
+		auto coefficient = mCoefficients;
+		for (auto band = 0; band < VBAN_MDCT_BAND_COUNT; ++band)
+		{
+			float peak = 0.f;
+			for (auto i = 0; i < bandWidths[band]; ++i)
+				peak = std::max(peak, std::fabs(coefficient[i]));
+			coefficient += bandWidths[band];
+
+			int exponent = minExponent;
+			if (peak > 0.f)
+				std::frexp(peak, &exponent);
+			exponents[band] = std::max(minExponent, std::min(exponent, maxExponent));
+		}
+
+		// Differences between neighbouring bands are limited to -4..3, raise the scale factors where the difference is larger
+		for (auto band = VBAN_MDCT_BAND_COUNT - 2; band >= 0; --band)
+			exponents[band] = std::max(exponents[band], exponents[band + 1] - 3);
+		for (auto band = 1; band < VBAN_MDCT_BAND_COUNT; ++band)
+			exponents[band] = std::max(exponents[band], exponents[band - 1] - 4);
+
+		BitWriter writer(output, size);
+		writer.write(exponents[0] - minExponent, 5);
+		for (auto band = 1; band < VBAN_MDCT_BAND_COUNT; ++band)
+			writer.write(exponents[band] - exponents[band - 1] + 4, 3);
+
+		int bits[VBAN_MDCT_BAND_COUNT];
+		allocateBits(exponents, size * 8 - VBAN_MDCT_SIDE_BITS, bits);
+
+		// Uniform quantization of the coefficients relative to the scale factor of their band
+		coefficient = mCoefficients;
+		for (auto band = 0; band < VBAN_MDCT_BAND_COUNT; ++band)
+		{
+			if (bits[band] > 0)
+			{
+				auto levels = 1 << bits[band];
+				auto scale = std::ldexp(0.5f * levels, -exponents[band]);
+				for (auto i = 0; i < bandWidths[band]; ++i)
+				{
+					auto level = static_cast<int>(std::floor((coefficient[i] * scale) + 0.5f * levels));
+					writer.write(std::max(0, std::min(level, levels - 1)), bits[band]);
+				}
+			}
+			coefficient += bandWidths[band];
+		}
+		writer.flush();
+	}
+
+
+	void VBANMdctDecoder::setChannelCount(int channelCount)
+	{
+		mChannelCount = channelCount;
+		mOverlap.assign(channelCount * frameSize, 0.f);
+	}
+
+
+	void VBANMdctDecoder::reset()
+	{
+		std::fill(mOverlap.begin(), mOverlap.end(), 0.f);
+	}
+
+
+	void VBANMdctDecoder::decode(int channel, const unsigned char* input, int size, float* output)
+	{
+		BitReader reader(input, size);
+		int exponents[VBAN_MDCT_BAND_COUNT];
+		exponents[0] = static_cast<int>(reader.read(5)) + minExponent;
+		for (auto band = 1; band < VBAN_MDCT_BAND_COUNT; ++band)
+			exponents[band] = exponents[band - 1] + static_cast<int>(reader.read(3)) - 4;
+
+		int bits[VBAN_MDCT_BAND_COUNT];
+		allocateBits(exponents, size * 8 - VBAN_MDCT_SIDE_BITS, bits);
+
+		auto coefficient = mCoefficients;
+		for (auto band = 0; band < VBAN_MDCT_BAND_COUNT; ++band)
+		{
+			if (bits[band] > 0)
+			{
+				// Reconstruct at the centre of the quantization interval
+				auto levels = 1 << bits[band];
+				auto scale = std::ldexp(1.f / levels, exponents[band]);
+				for (auto i = 0; i < bandWidths[band]; ++i)
+					coefficient[i] = (2 * static_cast<int>(reader.read(bits[band])) + 1 - levels) * scale;
+			}
+			else
+				std::fill(coefficient, coefficient + bandWidths[band], 0.f);
+			coefficient += bandWidths[band];
+		}
+
+		// Overlap add with the second half of the previous frame
+		mMdct.inverse(mCoefficients, mWindow);
+		auto overlap = mOverlap.data() + channel * frameSize;
+		for (auto i = 0; i < frameSize; ++i)
+			output[i] = overlap[i] + mWindow[i];
+		std::copy(mWindow + frameSize, mWindow + 2 * frameSize, overlap);
+	}
+
+}
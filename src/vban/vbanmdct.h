@@ -0,0 +1,142 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+namespace vban
+{
+
+	// Number of samples of one frame of the transform codec, every packet holds one frame
+	static constexpr int VBAN_MDCT_FRAME_SIZE = 128;
+
+	// Number of frequency bands that share a scale factor
+	static constexpr int VBAN_MDCT_BAND_COUNT = 16;
+
+	// Bits of side information in a coded channel: the scale factor of the first band and the differences for the others
+	static constexpr int VBAN_MDCT_SIDE_BITS = 5 + 3 * (VBAN_MDCT_BAND_COUNT - 1);
+
+	// Smallest number of bytes of a coded channel
+	static constexpr int VBAN_MDCT_MIN_CHANNEL_SIZE = (VBAN_MDCT_SIDE_BITS + 7) / 8 + 2;
+
+
+	/**
+	 * Transform of the low delay codec: a modified discrete cosine transform with a sine window of twice the frame size.
+	 * Frames overlap by half, giving an algorithmic delay of two frames (5.3 ms at 48 kHz).
+	 * The transform is computed as a DCT-IV through a complex FFT of a quarter of the window size.
+	 */
+	class VBANMdct
+	{
+	public:
+		// Sets up the window and the twiddle factors
+		VBANMdct();
+
+		/**
+		 * Computes the coefficients of a window of 2 * VBAN_MDCT_FRAME_SIZE samples, the previous frame followed by the current one.
+		 * @param input The samples of the window, not windowed yet
+		 * @param output Receives VBAN_MDCT_FRAME_SIZE coefficients
+		 */
+		void forward(const float* input, float* output);
+
+		/**
+		 * Computes the windowed signal of VBAN_MDCT_FRAME_SIZE coefficients, to be overlap added with the neighbouring frames.
+		 * @param input VBAN_MDCT_FRAME_SIZE coefficients
+		 * @param output Receives 2 * VBAN_MDCT_FRAME_SIZE samples
+		 */
+		void inverse(const float* input, float* output);
+
+	private:
+		/**
+		 * DCT-IV of VBAN_MDCT_FRAME_SIZE values, in place
+		 */
+		void dct4(float* data);
+
+		/**
+		 * In place radix 2 FFT of VBAN_MDCT_FRAME_SIZE / 2 values
+		 */
+		void fft(std::complex<float>* data);
+
+		std::vector<float> mWindow;
+		std::vector<std::complex<float>> mPreTwiddle;
+		std::vector<std::complex<float>> mPostTwiddle;
+		std::vector<std::complex<float>> mFftTwiddle;
+		std::vector<int> mBitReverse;
+		std::vector<float> mFolded;
+		std::vector<std::complex<float>> mComplex;
+	};
+
+
+	/**
+	 * Encoder of the low delay lossy codec that is sent through the VBAN_CODEC_USER codec slot.
+	 * Every channel of a frame is coded into a fixed number of bytes: the scale factors of the bands followed by the quantized coefficients.
+	 * Bits are allocated to the bands from the scale factors with integer arithmetic only, so the decoder derives the same allocation without side information.
+	 * A coded frame only depends on the packet it is in, the previous frame is only needed to cancel the aliasing of the overlapping windows.
+	 */
+	class VBANMdctEncoder
+	{
+	public:
+		/**
+		 * Sets the number of channels and clears the history.
+		 */
+		void setChannelCount(int channelCount);
+
+		/**
+		 * Codes one frame of a channel.
+		 * @param channel The channel, its previous frame is kept by the encoder.
+		 * @param input VBAN_MDCT_FRAME_SIZE samples
+		 * @param output Receives the coded frame
+		 * @param size Number of bytes of the coded frame, at least VBAN_MDCT_MIN_CHANNEL_SIZE.
+		 */
+		void encode(int channel, const float* input, unsigned char* output, int size);
+
+	private:
+		VBANMdct mMdct;
+		std::vector<float> mHistory; // Previous frame of every channel
+		float mWindow[2 * VBAN_MDCT_FRAME_SIZE];
+		float mCoefficients[VBAN_MDCT_FRAME_SIZE];
+	};
+
+
+	/**
+	 * Decoder of the low delay lossy codec, see VBANMdctEncoder.
+	 */
+	class VBANMdctDecoder
+	{
+	public:
+		/**
+		 * Sets the number of channels and clears the overlap.
+		 */
+		void setChannelCount(int channelCount);
+
+		/**
+		 * Allocates the overlap for a number of channels up front, so setChannelCount() does not allocate up to that number.
+		 */
+		void reserve(int channelCount) { mOverlap.reserve(channelCount * VBAN_MDCT_FRAME_SIZE); }
+
+		/**
+		 * @return The number of channels
+		 */
+		int getChannelCount() const { return mChannelCount; }
+
+		/**
+		 * Clears the overlap of all channels, call when frames got lost.
+		 */
+		void reset();
+
+		/**
+		 * Decodes one frame of a channel, the output is delayed by one frame.
+		 * @param channel The channel, the second half of its previous frame is kept by the decoder.
+		 * @param input The coded frame
+		 * @param size Number of bytes of the coded frame
+		 * @param output Receives VBAN_MDCT_FRAME_SIZE samples
+		 */
+		void decode(int channel, const unsigned char* input, int size, float* output);
+
+	private:
+		VBANMdct mMdct;
+		int mChannelCount = 0;
+		std::vector<float> mOverlap; // Second half of the previous window of every channel
+		float mWindow[2 * VBAN_MDCT_FRAME_SIZE];
+		float mCoefficients[VBAN_MDCT_FRAME_SIZE];
+	};
+
+}
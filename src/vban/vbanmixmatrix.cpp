@@ -0,0 +1,84 @@
+#include "vbanmixmatrix.h"
+
+namespace vban
+{
+
+	VBANMixMatrix::VBANMixMatrix(int inputChannelCount, int outputChannelCount) :
+		mInputChannelCount(inputChannelCount), mOutputChannelCount(outputChannelCount)
+	{
+		auto size = inputChannelCount * outputChannelCount;
+		mGains.resize(size, 0.f);
+		mCurrentGains.resize(size, 0.f);
+		mTargetGains.resize(size, 0.f);
+		mGainSteps.resize(size, 0.f);
+		mActiveInputs.resize(outputChannelCount);
+		for (auto& inputs : mActiveInputs)
+			inputs.reserve(inputChannelCount);
+	}
+
+
+	void VBANMixMatrix::setGain(int input, int output, float gain)
+	{
+		assert(input < mInputChannelCount && output < mOutputChannelCount);
+		std::lock_guard<std::mutex> lock(mGainsLock);
+		mGains[output * mInputChannelCount + input] = gain;
+		mIsDirty.set();
+	}
+
+
+	void VBANMixMatrix::setGains(const std::vector<float>& gains)
+	{
+		assert(gains.size() == mGains.size());
+		std::lock_guard<std::mutex> lock(mGainsLock);
+		mGains = gains;
+		mIsDirty.set();
+	}
+
+
+	void VBANMixMatrix::setRampTime(int sampleCount)
+	{
+		assert(sampleCount >= 0);
+		mRampTime.store(sampleCount);
+		mIsDirty.set();
+	}
+
+
+	void VBANMixMatrix::update()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mGainsLock);
+			std::copy(mGains.begin(), mGains.end(), mTargetGains.begin());
+		}
+
+		auto rampTime = mRampTime.load();
+		if (rampTime == 0)
+		{
+			std::copy(mTargetGains.begin(), mTargetGains.end(), mCurrentGains.begin());
+			mRampRemaining = 0;
+		}
+		else {
+			for (size_t i = 0; i < mTargetGains.size(); ++i)
+				mGainSteps[i] = (mTargetGains[i] - mCurrentGains[i]) / rampTime;
+			mRampRemaining = rampTime;
+		}
+
+		updateActiveInputs();
+	}
+
+
+	void VBANMixMatrix::updateActiveInputs()
+	{
+		for (auto output = 0; output < mOutputChannelCount; ++output)
+		{
+			auto& inputs = mActiveInputs[output];
+			inputs.clear();
+			for (auto input = 0; input < mInputChannelCount; ++input)
+			{
+				auto index = output * mInputChannelCount + input;
+				if (mCurrentGains[index] != 0.f || (mRampRemaining > 0 && mTargetGains[index] != 0.f))
+					inputs.emplace_back(input);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "dirtyflag.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+namespace vban
+{
+
+	/**
+	 * Mixing matrix to render the decoded channels of a VBAN stream onto a different number of output channels, for example a 64 channel stream onto 8 speakers.
+	 * Gains are set from the control thread and applied on the audio thread in process(). Gain changes are ramped linearly over a configurable time to avoid zipper noise.
+	 * Only the non zero entries of the matrix are processed, so sparse matrices are cheap.
+	 * The inner loops run over contiguous samples of one channel so the compiler can vectorize the multiply-accumulate.
+	 */
+	class VBANMixMatrix
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param inputChannelCount Number of input channels of the matrix
+		 * @param outputChannelCount Number of output channels of the matrix
+		 */
+		VBANMixMatrix(int inputChannelCount, int outputChannelCount);
+
+		// Default destructor
+		virtual ~VBANMixMatrix() = default;
+
+		/**
+		 * Call this method from the audio thread to mix the input into the output.
+		 * @tparam InputType Type for the multichannel input data. Implements a subscript operator that returns contiguous samples of a single channel.
+		 * 	Examples: std::vector<std::vector<float>> or float**
+		 * @tparam OutputType Type for the multichannel output data, same requirements as InputType.
+		 * @param input Multichannel audio data to be mixed.
+		 * @param inputChannelCount Number of channels in input. Matrix inputs beyond this number are ignored.
+		 * @param output Multichannel audio data that will be overwritten with the mix.
+		 * @param outputChannelCount Number of channels in output. Channels beyond the number of matrix outputs are filled with silence.
+		 * @param sampleCount Number of samples to process.
+		 */
+		template <typename InputType, typename OutputType>
+		void process(const InputType& input, int inputChannelCount, OutputType& output, int outputChannelCount, int sampleCount);
+
+		/**
+		 * Sets the gain from one input to one output.
+		 * @param input Index of the input channel
+		 * @param output Index of the output channel
+		 * @param gain Linear gain
+		 */
+		void setGain(int input, int output, float gain);
+
+		/**
+		 * Sets all gains at once, all changes are ramped together.
+		 * @param gains Linear gains, indexed by output * inputChannelCount + input.
+		 */
+		void setGains(const std::vector<float>& gains);
+
+		/**
+		 * Sets the duration over which gain changes are ramped.
+		 * @param sampleCount Duration in samples
+		 */
+		void setRampTime(int sampleCount);
+
+		/**
+		 * @return Number of input channels of the matrix
+		 */
+		int getInputChannelCount() const { return mInputChannelCount; }
+
+		/**
+		 * @return Number of output channels of the matrix
+		 */
+		int getOutputChannelCount() const { return mOutputChannelCount; }
+
+	private:
+		/**
+		 * Starts a ramp from the current to the new gains
+		 */
+		void update();
+
+		/**
+		 * Collects the inputs with a non zero gain for every output
+		 */
+		void updateActiveInputs();
+
+		const int mInputChannelCount;
+		const int mOutputChannelCount;
+
+		// Settings
+		std::vector<float> mGains; // Gains set by the control thread
+		std::mutex mGainsLock;
+		std::atomic<int> mRampTime = { 256 };
+		DirtyFlag mIsDirty;
+
+		// State
+		std::vector<float> mCurrentGains; // Gains at the current position of the ramp
+		std::vector<float> mTargetGains; // Gains at the end of the ramp
+		std::vector<float> mGainSteps; // Change of the gains per sample during the ramp
+		std::vector<std::vector<int>> mActiveInputs; // Inputs with a non zero current or target gain for each output
+		int mRampRemaining = 0; // Number of samples left in the current ramp
+	};
+
+
+	template <typename InputType, typename OutputType>
+	void VBANMixMatrix::process(const InputType& input, int inputChannelCount, OutputType& output, int outputChannelCount, int sampleCount)
+	{
+		if (mIsDirty.check())
+			update();
+
+		auto rampCount = std::min(mRampRemaining, sampleCount);
+		auto isRampFinished = rampCount == mRampRemaining;
+
+		for (auto outputChannel = 0; outputChannel < outputChannelCount; ++outputChannel)
+		{
+			auto out = &output[outputChannel][0];
+			for (auto i = 0; i < sampleCount; ++i)
+				out[i] = 0.f;
+			if (outputChannel >= mOutputChannelCount)
+				continue;
+
+			for (auto inputChannel : mActiveInputs[outputChannel])
+			{
+				auto index = outputChannel * mInputChannelCount + inputChannel;
+				auto gain = mCurrentGains[index];
+				auto step = mGainSteps[index];
+				auto endGain = gain;
+				if (rampCount > 0)
+					endGain = isRampFinished ? mTargetGains[index] : gain + step * rampCount;
+				mCurrentGains[index] = endGain;
+
+				if (inputChannel >= inputChannelCount)
+					continue;
+
+				auto in = &input[inputChannel][0];
+				for (auto i = 0; i < rampCount; ++i)
+					out[i] += (gain + step * (i + 1)) * in[i];
+				for (auto i = rampCount; i < sampleCount; ++i)
+					out[i] += endGain * in[i];
+			}
+		}
+
+		// Gains of outputs that were not processed still have to follow the ramp
+		if (rampCount > 0)
+		{
+			for (auto outputChannel = outputChannelCount; outputChannel < mOutputChannelCount; ++outputChannel)
+				for (auto inputChannel : mActiveInputs[outputChannel])
+				{
+					auto index = outputChannel * mInputChannelCount + inputChannel;
+					mCurrentGains[index] = isRampFinished ? mTargetGains[index] : mCurrentGains[index] + mGainSteps[index] * rampCount;
+				}
+		}
+
+		mRampRemaining -= rampCount;
+		if (rampCount > 0 && isRampFinished)
+			updateActiveInputs();
+	}
+
+}
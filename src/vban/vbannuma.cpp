@@ -0,0 +1,168 @@
+#include "vbannuma.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace vban
+{
+
+	/**
+	 * Parses a sysfs cpu or node list like "0-3,8-11"
+	 */
+	static std::vector<int> readList(const std::string& path)
+	{
+		std::vector<int> result;
+		std::ifstream file(path);
+		std::string range;
+		while (std::getline(file, range, ','))
+		{
+			auto separator = range.find('-');
+			auto first = std::atoi(range.c_str());
+			auto last = separator == std::string::npos ? first : std::atoi(range.c_str() + separator + 1);
+			for (auto i = first; i <= last; ++i)
+				result.emplace_back(i);
+		}
+		return result;
+	}
+
+
+	/**
+	 * @return For every cpu the node it belongs to, read once.
+	 */
+	static const std::vector<int>& getCpuNodes()
+	{
+		static const std::vector<int> cpuNodes = []()
+		{
+			std::vector<int> result;
+			for (auto node = 0; node < getNumaNodeCount(); ++node)
+				for (auto cpu : getNumaNodeCpus(node))
+				{
+					if (cpu >= static_cast<int>(result.size()))
+						result.resize(cpu + 1, 0);
+					result[cpu] = node;
+				}
+			return result;
+		}();
+		return cpuNodes;
+	}
+
+
+	int getNumaNodeCount()
+	{
+#ifdef __linux__
+		static const int count = []()
+		{
+			auto nodes = readList("/sys/devices/system/node/online");
+			return nodes.empty() ? 1 : nodes.back() + 1;
+		}();
+		return count;
+#else
+		return 1;
+#endif
+	}
+
+
+	int getCurrentNumaNode()
+	{
+#ifdef __linux__
+		auto cpu = sched_getcpu();
+		auto& cpuNodes = getCpuNodes();
+		if (cpu >= 0 && cpu < static_cast<int>(cpuNodes.size()))
+			return cpuNodes[cpu];
+#endif
+		return 0;
+	}
+
+
+	std::vector<int> getNumaNodeCpus(int node)
+	{
+#ifdef __linux__
+		return readList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+#else
+		return { };
+#endif
+	}
+
+
+	int getNetworkInterfaceNumaNode(const std::string& interfaceName)
+	{
+		int node = -1;
+		std::ifstream file("/sys/class/net/" + interfaceName + "/device/numa_node");
+		file >> node;
+		return node < 0 ? 0 : node;
+	}
+
+
+	bool bindThreadToNumaNode(int node)
+	{
+#ifdef __linux__
+		auto cpus = getNumaNodeCpus(node);
+		if (cpus.empty())
+			return false;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (auto cpu : cpus)
+			CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+
+
+	/**
+	 * @return Whether memory for the node is mapped and bound to the node, otherwise it comes from the heap.
+	 */
+	static bool isBound(int node)
+	{
+#ifdef __linux__
+		return node >= 0 && node < 64 && getNumaNodeCount() > 1;
+#else
+		return false;
+#endif
+	}
+
+
+	void* allocateOnNumaNode(size_t size, int node)
+	{
+#ifdef __linux__
+		if (isBound(node))
+		{
+			auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (data == MAP_FAILED)
+				return nullptr;
+
+			// Prefer the node over the default first touch placement, so it does not matter which thread touches the memory first
+			constexpr int preferred = 1; // MPOL_PREFERRED from linux/mempolicy.h
+			unsigned long mask = 1ul << node;
+			syscall(SYS_mbind, data, size, preferred, &mask, sizeof(mask) * 8 + 1, 0); // the kernel ignores the last bit of maxnode
+			return data;
+		}
+#endif
+		return std::malloc(size);
+	}
+
+
+	void freeOnNumaNode(void* data, size_t size, int node)
+	{
+#ifdef __linux__
+		if (isBound(node))
+		{
+			if (data != nullptr)
+				munmap(data, size);
+			return;
+		}
+#endif
+		std::free(data);
+	}
+
+}
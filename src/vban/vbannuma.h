@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace vban
+{
+
+	/**
+	 * Helpers to keep packet memory and the threads touching it on the same NUMA node of multi socket machines.
+	 * The topology is read from sysfs on Linux, so no NUMA library is needed. On other platforms and on single node machines all functions behave as if there is one node.
+	 */
+
+	/**
+	 * @return Number of NUMA nodes of the machine, at least 1.
+	 */
+	int getNumaNodeCount();
+
+	/**
+	 * @return The node of the cpu the calling thread currently runs on.
+	 */
+	int getCurrentNumaNode();
+
+	/**
+	 * @param node Index of the node
+	 * @return Indices of the cpus of the node
+	 */
+	std::vector<int> getNumaNodeCpus(int node);
+
+	/**
+	 * Looks up the node a network interface is attached to, so the transport thread of that interface can be placed next to it.
+	 * @param interfaceName Name of the interface, for example "eth0"
+	 * @return The node of the interface, 0 when unknown.
+	 */
+	int getNetworkInterfaceNumaNode(const std::string& interfaceName);
+
+	/**
+	 * Restricts the calling thread to the cpus of a node.
+	 * @param node Index of the node
+	 * @return True on success
+	 */
+	bool bindThreadToNumaNode(int node);
+
+	/**
+	 * Allocates memory that is placed on a node. Without a node, and on single node machines, the memory comes from the heap.
+	 * @param size Size in bytes
+	 * @param node Index of the node, or -1 to use the default placement.
+	 * @return The memory, has to be freed with freeOnNumaNode().
+	 */
+	void* allocateOnNumaNode(size_t size, int node);
+
+	/**
+	 * Frees memory allocated with allocateOnNumaNode().
+	 * @param data The memory
+	 * @param size Size passed to allocateOnNumaNode()
+	 * @param node Node passed to allocateOnNumaNode()
+	 */
+	void freeOnNumaNode(void* data, size_t size, int node);
+
+}
@@ -0,0 +1,144 @@
+#include "vbanpacketpool.h"
+
+#include <algorithm>
+#include <new>
+#include <cassert>
+
+namespace vban
+{
+
+	VBANPacketPool::Slab::Slab(VBANPacketPool& pool, int packetSize, int slotCount, int numaNode) :
+		mPool(pool), mPacketSize(packetSize), mSlotCount(slotCount), mNumaNode(numaNode), mFrames(new std::atomic<int64_t>[slotCount])
+	{
+		mData = static_cast<char*>(allocateOnNumaNode(static_cast<size_t>(packetSize) * slotCount, numaNode));
+		if (mData == nullptr)
+			throw std::bad_alloc();
+	}
+
+
+	VBANPacketPool::Slab* VBANPacketPool::acquire(int packetSize, int slotCount)
+	{
+		packetSize = (packetSize + mSizeClass - 1) / mSizeClass * mSizeClass;
+		auto size = static_cast<int64_t>(packetSize) * slotCount;
+
+		Slab* slab = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			auto& free = mFreeSlabs[{ packetSize, slotCount }];
+			if (!free.empty())
+			{
+				slab = free.back();
+				free.pop_back();
+				mUsedSize += size;
+			}
+		}
+
+		// Allocate outside of the lock, so other decoders drawing from the pool do not wait for the system
+		if (slab == nullptr)
+		{
+			std::unique_ptr<Slab> allocated(new Slab(*this, packetSize, slotCount, mNumaNode));
+			slab = allocated.get();
+			std::lock_guard<std::mutex> lock(mMutex);
+			mSlabs.emplace_back(std::move(allocated));
+			mAllocatedSize += size;
+			mUsedSize += size;
+		}
+
+		for (auto i = 0; i < slotCount; ++i)
+			slab->mFrames[i].store(-1);
+		if (mNumaNode >= 0)
+		{
+			if (getCurrentNumaNode() == mNumaNode)
+				mLocalAcquireCount++;
+			else
+				mRemoteAcquireCount++;
+		}
+		return slab;
+	}
+
+
+	void VBANPacketPool::release(Slab* slab)
+	{
+		if (slab == nullptr)
+			return;
+
+		// The slabs are freed outside of the lock
+		std::vector<std::unique_ptr<Slab>> freed;
+		std::lock_guard<std::mutex> lock(mMutex);
+		slab->mReleaseStamp = mReleaseCount++;
+		mFreeSlabs[{ slab->mPacketSize, slab->mSlotCount }].emplace_back(slab);
+		mUsedSize -= static_cast<int64_t>(slab->mPacketSize) * slab->mSlotCount;
+		evictIdle(mIdleLimit, freed);
+	}
+
+
+	void VBANPacketPool::setIdleLimit(int64_t size)
+	{
+		assert(size >= 0);
+		std::vector<std::unique_ptr<Slab>> freed;
+		std::lock_guard<std::mutex> lock(mMutex);
+		mIdleLimit = size;
+		evictIdle(mIdleLimit, freed);
+	}
+
+
+	void VBANPacketPool::trim()
+	{
+		std::vector<std::unique_ptr<Slab>> freed;
+		std::lock_guard<std::mutex> lock(mMutex);
+		evictIdle(0, freed);
+	}
+
+
+	void VBANPacketPool::evictIdle(int64_t limit, std::vector<std::unique_ptr<Slab>>& freed)
+	{
+		while (mAllocatedSize.load() - mUsedSize.load() > limit)
+		{
+			// Every size class holds its slabs in the order they were released, the oldest of all is the first of one of them
+			auto oldest = mFreeSlabs.end();
+			for (auto it = mFreeSlabs.begin(); it != mFreeSlabs.end(); ++it)
+				if (!it->second.empty() && (oldest == mFreeSlabs.end() || it->second.front()->mReleaseStamp < oldest->second.front()->mReleaseStamp))
+					oldest = it;
+			if (oldest == mFreeSlabs.end())
+				break;
+
+			auto slab = oldest->second.front();
+			oldest->second.erase(oldest->second.begin());
+			if (oldest->second.empty())
+				mFreeSlabs.erase(oldest);
+			auto owner = std::find_if(mSlabs.begin(), mSlabs.end(), [slab](const std::unique_ptr<Slab>& candidate) { return candidate.get() == slab; });
+			assert(owner != mSlabs.end());
+			freed.emplace_back(std::move(*owner));
+			*owner = std::move(mSlabs.back());
+			mSlabs.pop_back();
+			mAllocatedSize -= static_cast<int64_t>(slab->mPacketSize) * slab->mSlotCount;
+		}
+	}
+
+
+
+	VBANNumaPacketPools::VBANNumaPacketPools()
+	{
+		for (auto node = 0; node < getNumaNodeCount(); ++node)
+			mPools.emplace_back(std::make_unique<VBANPacketPool>(node));
+	}
+
+
+	int VBANNumaPacketPools::getLocalAcquireCount() const
+	{
+		int count = 0;
+		for (auto& pool : mPools)
+			count += pool->getLocalAcquireCount();
+		return count;
+	}
+
+
+	int VBANNumaPacketPools::getRemoteAcquireCount() const
+	{
+		int count = 0;
+		for (auto& pool : mPools)
+			count += pool->getRemoteAcquireCount();
+		return count;
+	}
+
+}
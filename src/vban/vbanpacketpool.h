@@ -0,0 +1,201 @@
+#pragma once
+
+#include "vban.h"
+#include "vbannuma.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+namespace vban
+{
+
+	/**
+	 * Pool of jitter buffer memory shared by many VBANStreamDecoders.
+	 * A decoder draws a slab from the pool when the first packet of a stream arrives, sized to the packets of that stream instead of the largest possible VBAN packet, and gives it back when the stream goes idle.
+	 * Released slabs are kept and reused by decoders with the same packet size class, up to a limit on the idle memory beyond which the least recently released slabs are returned to the system, so memory scales with the active traffic.
+	 * trim() returns all idle slabs, for example from the control thread after a busy period.
+	 * The pool is thread safe, slabs are only drawn and released on a format change or eviction, not per packet.
+	 * On multi socket machines a pool can be bound to a NUMA node, use one pool per node and give each decoder the pool of the node its network thread runs on.
+	 */
+	class VBANPacketPool
+	{
+	public:
+		/**
+		 * Memory for the packets of one jitter buffer
+		 */
+		class Slab
+		{
+			friend class VBANPacketPool;
+		public:
+			// Returns the packet memory to the system
+			~Slab() { freeOnNumaNode(mData, static_cast<size_t>(mPacketSize) * mSlotCount, mNumaNode); }
+
+			Slab(const Slab&) = delete;
+			Slab& operator=(const Slab&) = delete;
+
+			/**
+			 * @return Frame number of the packet in slot index, -1 while empty or being written.
+			 */
+			std::atomic<int64_t>& getFrame(int index) { return mFrames[index]; }
+
+			/**
+			 * @return Data of the packet in slot index, holds getPacketSize() bytes.
+			 */
+			char* getPacket(int index) { return mData + static_cast<size_t>(index) * mPacketSize; }
+
+			/**
+			 * @return Maximum size of the packets the slab holds
+			 */
+			int getPacketSize() const { return mPacketSize; }
+
+			/**
+			 * @return Number of packets the slab holds
+			 */
+			int getSlotCount() const { return mSlotCount; }
+
+			/**
+			 * @return The pool the slab was drawn from and has to be returned to
+			 */
+			VBANPacketPool& getPool() { return mPool; }
+
+		private:
+			Slab(VBANPacketPool& pool, int packetSize, int slotCount, int numaNode);
+
+			VBANPacketPool& mPool;
+			uint64_t mReleaseStamp = 0; // Order in which idle slabs were released
+			int mPacketSize;
+			int mSlotCount;
+			int mNumaNode;
+			std::unique_ptr<std::atomic<int64_t>[]> mFrames;
+			char* mData;
+		};
+
+		/**
+		 * Constructor
+		 * @param numaNode NUMA node the packet memory is placed on, or -1 for the default placement.
+		 */
+		explicit VBANPacketPool(int numaNode = -1) : mNumaNode(numaNode) { }
+
+		/**
+		 * Draws a slab from the pool, allocating one when no released slab of the same size class is available.
+		 * All slots of the slab are empty.
+		 * @param packetSize Size of the packets in bytes, rounded up to the size class.
+		 * @param slotCount Number of packets
+		 * @return The slab, has to be returned with release()
+		 */
+		Slab* acquire(int packetSize, int slotCount);
+
+		/**
+		 * Returns a slab to the pool.
+		 * @param slab Slab drawn with acquire(), or nullptr.
+		 */
+		void release(Slab* slab);
+
+		/**
+		 * Sets how much memory released slabs may hold for reuse. Beyond it the least recently released slabs are returned to the system.
+		 * @param size Size in bytes, 0 to return every slab when it is released.
+		 */
+		void setIdleLimit(int64_t size);
+
+		/**
+		 * Returns all released slabs to the system.
+		 */
+		void trim();
+
+		/**
+		 * @return Total number of bytes allocated by the pool
+		 */
+		int64_t getAllocatedSize() const { return mAllocatedSize.load(); }
+
+		/**
+		 * @return Number of bytes in slabs that are currently drawn
+		 */
+		int64_t getUsedSize() const { return mUsedSize.load(); }
+
+		/**
+		 * @return Number of bytes in released slabs kept for reuse
+		 */
+		int64_t getIdleSize() const { return mAllocatedSize.load() - mUsedSize.load(); }
+
+		/**
+		 * @return NUMA node the packet memory is placed on, or -1.
+		 */
+		int getNumaNode() const { return mNumaNode; }
+
+		/**
+		 * @return Number of slabs drawn by threads running on the node of the pool, which access the packets without crossing sockets.
+		 */
+		int getLocalAcquireCount() const { return mLocalAcquireCount.load(); }
+
+		/**
+		 * @return Number of slabs drawn by threads running on another node than the pool.
+		 */
+		int getRemoteAcquireCount() const { return mRemoteAcquireCount.load(); }
+
+	private:
+		// Packet sizes are rounded up to a multiple of this to limit the number of size classes
+		static constexpr int mSizeClass = 64;
+
+		/**
+		 * Takes the least recently released slabs out of the pool until the idle memory is within the limit, called with mMutex locked.
+		 * @param limit Idle memory to keep in bytes
+		 * @param freed Receives the slabs, to be destroyed after unlocking.
+		 */
+		void evictIdle(int64_t limit, std::vector<std::unique_ptr<Slab>>& freed);
+
+		int mNumaNode;
+		std::mutex mMutex;
+		std::vector<std::unique_ptr<Slab>> mSlabs; // All slabs allocated by the pool
+		std::map<std::pair<int, int>, std::vector<Slab*>> mFreeSlabs; // Released slabs by packet size and slot count, least recently released first
+		int64_t mIdleLimit = 4 << 20;
+		uint64_t mReleaseCount = 0;
+		std::atomic<int64_t> mAllocatedSize = { 0 };
+		std::atomic<int64_t> mUsedSize = { 0 };
+		std::atomic<int> mLocalAcquireCount = { 0 };
+		std::atomic<int> mRemoteAcquireCount = { 0 };
+	};
+
+
+	/**
+	 * One VBANPacketPool for every NUMA node of the machine.
+	 */
+	class VBANNumaPacketPools
+	{
+	public:
+		// Creates a pool for every node
+		VBANNumaPacketPools();
+
+		/**
+		 * @return The pool of the given node
+		 */
+		VBANPacketPool& getPool(int node) { return *mPools[node]; }
+
+		/**
+		 * @return The pool of the node the calling thread runs on
+		 */
+		VBANPacketPool& getLocalPool() { return *mPools[getCurrentNumaNode()]; }
+
+		/**
+		 * @return Number of pools, equal to the number of nodes.
+		 */
+		int getPoolCount() const { return mPools.size(); }
+
+		/**
+		 * @return Number of slabs drawn from the pool of the node the drawing thread ran on, over all pools. Each of these avoids cross socket traffic on every packet.
+		 */
+		int getLocalAcquireCount() const;
+
+		/**
+		 * @return Number of slabs drawn from the pool of another node, over all pools.
+		 */
+		int getRemoteAcquireCount() const;
+
+	private:
+		std::vector<std::unique_ptr<VBANPacketPool>> mPools;
+	};
+
+}
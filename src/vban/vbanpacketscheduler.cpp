@@ -0,0 +1,120 @@
+#include "vbanpacketscheduler.h"
+
+namespace vban
+{
+
+	VBANPacketScheduler::Stream::Stream(VBANPacketScheduler& scheduler, Priority priority, int weight, int capacity) :
+		mScheduler(scheduler), mPriority(priority), mWeight(weight), mQueue(capacity)
+	{
+	}
+
+
+	void VBANPacketScheduler::Stream::sendPacket(const std::vector<char>& data)
+	{
+		assert(data.size() <= VBAN_PROTOCOL_MAX_SIZE);
+		auto packet = mScheduler.allocate(mPriority);
+		if (packet < 0)
+			return;
+
+		// The packets in the pool have reserved the maximum packet size, so this does not allocate
+		mScheduler.mPackets[packet].assign(data.begin(), data.end());
+		mQueue[(mHead + mCount) % mScheduler.mCapacity] = packet;
+		mCount++;
+	}
+
+
+	VBANPacketScheduler::VBANPacketScheduler(int capacity) : mPackets(capacity), mCapacity(capacity)
+	{
+		assert(capacity > 0);
+		mFreePackets.reserve(capacity);
+		for (auto i = 0; i < capacity; ++i)
+		{
+			mPackets[i].reserve(VBAN_PROTOCOL_MAX_SIZE);
+			mFreePackets.emplace_back(capacity - 1 - i);
+		}
+	}
+
+
+	VBANPacketScheduler::Stream& VBANPacketScheduler::addStream(Priority priority, int weight)
+	{
+		assert(priority < Priority::Count);
+		assert(weight > 0);
+		mStreams.emplace_back(new Stream(*this, priority, weight, mCapacity));
+		return *mStreams.back();
+	}
+
+
+	int VBANPacketScheduler::allocate(Priority priority)
+	{
+		if (!mFreePackets.empty())
+		{
+			auto packet = mFreePackets.back();
+			mFreePackets.pop_back();
+			return packet;
+		}
+
+		// Shed the oldest packet of the longest queue in the lowest priority class that is not more important than the new packet
+		for (auto c = mClassCount - 1; c >= static_cast<int>(priority); --c)
+		{
+			Stream* longest = nullptr;
+			for (auto& stream : mStreams)
+				if (static_cast<int>(stream->mPriority) == c && stream->mCount > 0 && (longest == nullptr || stream->mCount > longest->mCount))
+					longest = stream.get();
+
+			if (longest != nullptr)
+			{
+				auto packet = longest->mQueue[longest->mHead];
+				longest->mHead = (longest->mHead + 1) % mCapacity;
+				longest->mCount--;
+				mDropCount[c]++;
+				return packet;
+			}
+		}
+
+		mDropCount[static_cast<int>(priority)]++;
+		return -1;
+	}
+
+
+	VBANPacketScheduler::Stream* VBANPacketScheduler::next(int byteBudget)
+	{
+		auto streamCount = static_cast<int>(mStreams.size());
+		for (auto c = 0; c < mClassCount; ++c)
+		{
+			auto isPending = false;
+			for (auto& stream : mStreams)
+				if (static_cast<int>(stream->mPriority) == c && stream->mCount > 0)
+					isPending = true;
+			if (!isPending)
+				continue;
+
+			// Deficit round robin over the streams in this class.
+			// The quantum is at least the maximum packet size, so every stream that gets a turn can send at least one packet.
+			auto& index = mRoundRobin[c];
+			while (true)
+			{
+				auto& stream = *mStreams[index];
+				if (static_cast<int>(stream.mPriority) == c)
+				{
+					if (stream.mCount > 0)
+					{
+						if (!stream.mHasTurn)
+						{
+							stream.mDeficit += stream.mWeight * VBAN_PROTOCOL_MAX_SIZE;
+							stream.mHasTurn = true;
+						}
+						auto size = static_cast<int>(mPackets[stream.mQueue[stream.mHead]].size());
+						if (size <= stream.mDeficit)
+							return size <= byteBudget ? &stream : nullptr;
+					}
+					else
+						stream.mDeficit = 0;
+					stream.mHasTurn = false;
+				}
+				index = (index + 1) % streamCount;
+			}
+		}
+		return nullptr;
+	}
+
+}
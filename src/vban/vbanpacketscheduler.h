@@ -0,0 +1,146 @@
+#pragma once
+
+#include "vban.h"
+
+#include <vector>
+#include <memory>
+#include <cassert>
+
+namespace vban
+{
+
+	/**
+	 * Packet queue between a number of VBANStreamEncoders and the transport that sends their packets over the network.
+	 * Each encoder sends its packets into its own Stream, which is used as the SenderType of the encoder.
+	 * The transport is driven by calling send() with the number of bytes the link can take, for example on every tick of the sender thread.
+	 * Streams are scheduled with strict priority between priority classes and weighted fair queuing (deficit round robin) between streams of the same class.
+	 * When the queue is full, packets of the lowest priority class are dropped first. Drops are counted per class.
+	 * The scheduler is not thread safe: the encoders and send() have to be called from the same thread.
+	 */
+	class VBANPacketScheduler
+	{
+	public:
+		/**
+		 * Priority classes, a class is only sent when all classes with a higher priority have nothing left to send.
+		 */
+		enum class Priority
+		{
+			Critical = 0,	///< Program critical streams
+			Normal,			///< Regular streams
+			Monitoring,		///< Monitoring streams, shed first
+			Count
+		};
+
+		/**
+		 * Queue of one encoder. Implements the interface for the SenderType of VBANStreamEncoder.
+		 */
+		class Stream
+		{
+			friend class VBANPacketScheduler;
+		public:
+			/**
+			 * Queues a packet to be sent by the scheduler.
+			 * @param data The vban packet to be sent.
+			 */
+			void sendPacket(const std::vector<char>& data);
+
+			/**
+			 * @return Number of packets waiting to be sent.
+			 */
+			int getQueuedCount() const { return mCount; }
+
+		private:
+			Stream(VBANPacketScheduler& scheduler, Priority priority, int weight, int capacity);
+
+			VBANPacketScheduler& mScheduler;
+			Priority mPriority;
+			int mWeight;
+			int mDeficit = 0; // Number of bytes the stream is allowed to send in the current round
+			bool mHasTurn = false; // Whether the stream received its quantum for the current round
+			std::vector<int> mQueue; // Ring of indices into the packet pool of the scheduler
+			int mHead = 0;
+			int mCount = 0;
+		};
+
+		/**
+		 * Constructor
+		 * @param capacity Maximum number of packets that can be queued over all streams.
+		 */
+		explicit VBANPacketScheduler(int capacity = 256);
+
+		// Default destructor
+		virtual ~VBANPacketScheduler() = default;
+
+		/**
+		 * Adds a stream to the scheduler. Call this before starting to send, it allocates memory.
+		 * @param priority The priority class of the stream
+		 * @param weight Relative share of the bandwidth the stream gets compared to other streams in the same class.
+		 * @return The stream that can be used as the sender of a VBANStreamEncoder. Owned by the scheduler.
+		 */
+		Stream& addStream(Priority priority, int weight = 1);
+
+		/**
+		 * Sends queued packets to the transport until the byte budget is used up or the queue is empty.
+		 * @tparam TransportType Has to implement sendPacket(const std::vector<char>& data)
+		 * @param transport The transport the packets are sent through.
+		 * @param byteBudget Number of bytes that can be sent in this call.
+		 * @return Number of bytes sent.
+		 */
+		template <typename TransportType>
+		int send(TransportType& transport, int byteBudget);
+
+		/**
+		 * @return Number of packets of the given priority class that were dropped because the queue was full.
+		 */
+		int getDropCount(Priority priority) const { return mDropCount[static_cast<int>(priority)]; }
+
+		/**
+		 * @return Number of packets of the given priority class that were sent.
+		 */
+		int getSentCount(Priority priority) const { return mSentCount[static_cast<int>(priority)]; }
+
+	private:
+		static constexpr int mClassCount = static_cast<int>(Priority::Count);
+
+		/**
+		 * Takes a packet from the pool, dropping a queued packet of lower or equal priority when the pool is full.
+		 * @return Index into mPackets or -1 when the new packet has to be dropped.
+		 */
+		int allocate(Priority priority);
+
+		/**
+		 * Picks the stream that is allowed to send next, or nullptr when all streams are empty.
+		 * @param byteBudget Bytes available, packets that do not fit are kept for the next call.
+		 */
+		Stream* next(int byteBudget);
+
+		std::vector<std::unique_ptr<Stream>> mStreams;
+		std::vector<std::vector<char>> mPackets; // Pool of packets
+		std::vector<int> mFreePackets; // Indices of the unused packets in mPackets
+		int mCapacity;
+		int mRoundRobin[mClassCount] = { }; // Index into mStreams where the deficit round robin continues for each class
+		int mDropCount[mClassCount] = { };
+		int mSentCount[mClassCount] = { };
+	};
+
+
+	template <typename TransportType>
+	int VBANPacketScheduler::send(TransportType& transport, int byteBudget)
+	{
+		int sent = 0;
+		while (auto stream = next(byteBudget - sent))
+		{
+			auto packet = stream->mQueue[stream->mHead];
+			auto& data = mPackets[packet];
+			transport.sendPacket(data);
+			sent += data.size();
+			stream->mDeficit -= data.size();
+			stream->mHead = (stream->mHead + 1) % mCapacity;
+			stream->mCount--;
+			mFreePackets.emplace_back(packet);
+			mSentCount[static_cast<int>(stream->mPriority)]++;
+		}
+		return sent;
+	}
+
+}
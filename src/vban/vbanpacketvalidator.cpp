@@ -0,0 +1,110 @@
+#include "vbanpacketvalidator.h"
+#include "vbanusercodec.h"
+
+#include <bitset>
+#include <cstring>
+
+namespace vban
+{
+
+	// Masks and expected values of the first eight bytes of the header, read as a 64 bit word on a little endian host like the header itself
+	static constexpr uint64_t fourccMask = 0xFFFFFFFFull;
+	static constexpr uint64_t protocolMask = uint64_t(VBAN_PROTOCOL_MASK) << 32;
+	static constexpr uint64_t formatMask = uint64_t(VBAN_RESERVED_MASK) << 56;
+	static constexpr uint64_t headerMask = fourccMask | protocolMask | formatMask;
+	static constexpr uint64_t headerExpected = uint64_t('V') | (uint64_t('B') << 8) | (uint64_t('A') << 16) | (uint64_t('N') << 24) |
+		(uint64_t(VBAN_PROTOCOL_AUDIO) << 32);
+
+	// Number of bytes per sample for each bit format, 0 for the formats that are not supported
+	static constexpr int sampleSizes[VBAN_BIT_RESOLUTION_MASK + 1] = { 1, 2, 3, 4, 4, 8, 0, 0 };
+
+
+	static inline bool validateHeader(const unsigned char* data, int size)
+	{
+		uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+
+		auto sampleRate = data[4] & VBAN_SR_MASK;
+		auto sampleCount = data[5] + 1;
+		auto channelCount = data[6] + 1;
+		auto sampleSize = sampleSizes[data[7] & VBAN_BIT_RESOLUTION_MASK];
+		auto codec = data[7] & VBAN_CODEC_MASK;
+		auto pcmSize = sampleCount * channelCount * sampleSize;
+
+		// Evaluate all conditions of the header without branching
+		bool isValid = ((word & headerMask) == headerExpected) &
+			(sampleRate < VBAN_SR_MAXNUMBER) &
+			(sampleSize != 0);
+
+		if (codec == VBAN_CODEC_USER)
+			return isValid && validateUserPacket(data, size, pcmSize);
+		return isValid & (codec == VBAN_CODEC_PCM) & (size == VBAN_HEADER_SIZE + pcmSize);
+	}
+
+
+	bool validatePacket(const char* data, int size)
+	{
+		if (size < VBAN_HEADER_SIZE)
+			return false;
+		return validateHeader(reinterpret_cast<const unsigned char*>(data), size);
+	}
+
+
+	int validatePackets(const char* const* packets, const int* sizes, int count, uint64_t* acceptMask)
+	{
+		// Bytes per sample of each bit format in a nibble, 0 for the formats that are not supported
+		constexpr uint32_t sampleSizeNibbles = 0x844321;
+
+		int accepted = 0;
+		uint64_t words[64];
+		int lengths[64];
+		for (auto word = 0; word * 64 < count; ++word)
+		{
+			auto first = word * 64;
+			auto end = count - first < 64 ? count - first : 64;
+
+			// Gather the first eight bytes of every header, packets too short for a header get a word that fails the compare
+			for (auto i = 0; i < end; ++i)
+			{
+				lengths[i] = sizes[first + i];
+				words[i] = 0;
+				if (lengths[i] >= VBAN_HEADER_SIZE)
+					std::memcpy(&words[i], packets[first + i], sizeof(uint64_t));
+			}
+
+			// Check the fields of all headers in one pass over the words, without branches so the compiler can vectorize it
+			uint64_t mask = 0;
+			uint64_t userMask = 0;
+			for (auto i = 0; i < end; ++i)
+			{
+				auto header = words[i];
+				auto sampleRate = static_cast<uint32_t>(header >> 32) & VBAN_SR_MASK;
+				auto sampleCount = static_cast<int>((header >> 40) & 0xFF) + 1;
+				auto channelCount = static_cast<int>((header >> 48) & 0xFF) + 1;
+				auto format = static_cast<uint32_t>(header >> 56);
+				auto sampleSize = static_cast<int>((sampleSizeNibbles >> ((format & VBAN_BIT_RESOLUTION_MASK) * 4)) & 15);
+				auto codec = format & VBAN_CODEC_MASK;
+
+				bool isValid = ((header & headerMask) == headerExpected) & (sampleRate < VBAN_SR_MAXNUMBER) & (sampleSize != 0);
+				bool isPcm = (codec == VBAN_CODEC_PCM) & (lengths[i] == VBAN_HEADER_SIZE + sampleCount * channelCount * sampleSize);
+				mask |= uint64_t(isValid & isPcm) << i;
+				userMask |= uint64_t(isValid & (codec == VBAN_CODEC_USER)) << i;
+			}
+
+			// The codecs of this library each have their own layout, checked one by one
+			for (auto i = 0; userMask != 0; ++i, userMask >>= 1)
+			{
+				if ((userMask & 1) == 0)
+					continue;
+				auto data = reinterpret_cast<const unsigned char*>(packets[first + i]);
+				auto pcmSize = (data[5] + 1) * (data[6] + 1) * sampleSizes[data[7] & VBAN_BIT_RESOLUTION_MASK];
+				mask |= uint64_t(validateUserPacket(data, lengths[i], pcmSize)) << i;
+			}
+
+			acceptMask[word] = mask;
+			accepted += static_cast<int>(std::bitset<64>(mask).count());
+		}
+		return accepted;
+	}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "vban.h"
+
+#include <cstdint>
+
+namespace vban
+{
+
+	/**
+	 * Checks whether data contains a well formed VBAN audio packet: the fourcc, the audio protocol, the sample rate index, the bit format and whether the size matches the number of samples and channels in the header.
+	 * Packets are accepted with the PCM codec or with one of the codecs of this library in the VBAN_CODEC_USER slot, see vbanusercodec.h.
+	 * The first eight bytes of the header are checked with a single masked compare. The header is only read when size is at least VBAN_HEADER_SIZE.
+	 * @param data Data containing the packet
+	 * @param size Size of data in bytes
+	 * @return True if the packet is well formed
+	 */
+	bool validatePacket(const char* data, int size);
+
+	/**
+	 * Validates a batch of received packets, see validatePacket().
+	 * The first eight bytes of the headers of up to 64 packets are gathered into an array and checked in a single branch free pass, so the compiler can vectorize the compares.
+	 * Only packets with a codec in the VBAN_CODEC_USER slot are then checked one by one.
+	 * @param packets Pointers to the data of each packet
+	 * @param sizes Size of each packet in bytes
+	 * @param count Number of packets in the batch
+	 * @param acceptMask Receives one bit per packet, set when the packet is well formed. Has to hold (count + 63) / 64 words.
+	 * @return Number of accepted packets
+	 */
+	int validatePackets(const char* const* packets, const int* sizes, int count, uint64_t* acceptMask);
+
+}
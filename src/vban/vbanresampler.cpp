@@ -0,0 +1,101 @@
+#include "vbanresampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+namespace vban
+{
+
+	/**
+	 * Modified Bessel function of the first kind of order 0, for the Kaiser window
+	 */
+	static double besselI0(double x)
+	{
+		double sum = 1.0;
+		double term = 1.0;
+		for (auto k = 1; k < 50; ++k)
+		{
+			term *= (x / (2 * k)) * (x / (2 * k));
+			sum += term;
+			if (term < sum * 1e-12)
+				break;
+		}
+		return sum;
+	}
+
+
+	void VBANResampler::setup(int channelCount, int inputRate, int outputRate)
+	{
+		constexpr int length = 2 * mHalfLength;
+		mChannelCount = channelCount;
+		mMaxChannelCount = channelCount;
+		mInputRate = inputRate;
+		mOutputRate = outputRate;
+
+		// Room for the history and the input of the largest block at the highest drift
+		auto maxInputCount = static_cast<int>(std::ceil(mMaxOutputCount * (1.0 + mMaxDrift) * inputRate / outputRate)) + 2;
+		mStride = length + maxInputCount;
+		mBuffer.assign(channelCount * mStride, 0.f);
+
+		// Lowpass at 95% of the lower of the two Nyquist frequencies, flat up to 20 kHz between 44.1 and 48 kHz. The Kaiser window attenuates the stop band by about 85 dB
+		const double pi = 3.14159265358979323846;
+		const double beta = 8.5;
+		auto cutoff = 0.95 * std::min(1.0, static_cast<double>(outputRate) / inputRate);
+		mFilter.resize((mPhaseCount + 1) * length);
+		for (auto phase = 0; phase <= mPhaseCount; ++phase)
+		{
+			auto filter = mFilter.data() + phase * length;
+			double sum = 0.0;
+			for (auto k = 0; k < length; ++k)
+			{
+				// Distance of the tap to the output position
+				auto t = k - mHalfLength + 1 - static_cast<double>(phase) / mPhaseCount;
+				auto x = cutoff * t;
+				auto sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(pi * x) / (pi * x);
+				auto r = t / mHalfLength;
+				auto window = std::fabs(r) >= 1.0 ? 0.0 : besselI0(beta * std::sqrt(1.0 - r * r)) / besselI0(beta);
+				filter[k] = static_cast<float>(sinc * window);
+				sum += filter[k];
+			}
+
+			// Unity gain at DC for every phase
+			for (auto k = 0; k < length; ++k)
+				filter[k] = static_cast<float>(filter[k] / sum);
+		}
+
+		reset();
+		setDrift(1.0);
+	}
+
+
+	void VBANResampler::setChannelCount(int channelCount)
+	{
+		assert(channelCount <= mMaxChannelCount);
+		mChannelCount = channelCount;
+		reset();
+	}
+
+
+	void VBANResampler::reset()
+	{
+		std::fill(mBuffer.begin(), mBuffer.begin() + mChannelCount * mStride, 0.f);
+		mPosition = static_cast<uint64_t>(mHalfLength) << 32;
+	}
+
+
+	void VBANResampler::setDrift(double drift)
+	{
+		drift = std::max(1.0 - mMaxDrift, std::min(drift, 1.0 + mMaxDrift));
+		mStep = static_cast<uint64_t>(std::llround(drift * mInputRate / mOutputRate * 4294967296.0));
+	}
+
+
+	int VBANResampler::getInputCount(int outputCount) const
+	{
+		// The last output sample needs the input up to mHalfLength samples after its position
+		auto last = mPosition + mStep * (outputCount - 1);
+		return static_cast<int>(last >> 32) - mHalfLength + 1;
+	}
+
+}
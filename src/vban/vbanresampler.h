@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace vban
+{
+
+	/**
+	 * Multichannel sample rate converter with a windowed sinc filter, used by VBANStreamDecoder to convert a stream to the rate of the output device.
+	 * The conversion ratio combines the nominal rates with a fine drift correction, so both are applied in a single filter pass.
+	 * The filter coefficients are interpolated between precomputed phases once per output sample and then applied to all channels, the dot products run over contiguous samples so they vectorize.
+	 * The position in the input is kept in 32.32 fixed point, so the number of input samples needed for a block is exact.
+	 */
+	class VBANResampler
+	{
+	public:
+		// Half the number of taps of the filter, also the latency in input samples
+		static constexpr int mHalfLength = 64;
+
+		// Number of precomputed filter phases between two input samples
+		static constexpr int mPhaseCount = 256;
+
+		// Largest number of output samples per process() call
+		static constexpr int mMaxOutputCount = 256;
+
+		// Largest deviation of the drift correction from 1
+		static constexpr double mMaxDrift = 0.02;
+
+		/**
+		 * Sets the rates, computes the filter and clears the history. Allocates memory, the channel count can then be lowered with setChannelCount() without allocating.
+		 * @param channelCount Largest number of channels
+		 * @param inputRate Sample rate of the input
+		 * @param outputRate Sample rate of the output
+		 */
+		void setup(int channelCount, int inputRate, int outputRate);
+
+		/**
+		 * Sets the number of channels and clears the history. Does not allocate.
+		 * @param channelCount Number of channels, at most the number given to setup()
+		 */
+		void setChannelCount(int channelCount);
+
+		/**
+		 * @return The number of channels
+		 */
+		int getChannelCount() const { return mChannelCount; }
+
+		/**
+		 * @return Whether the resampler has been set up with these rates
+		 */
+		bool isSetUp(int inputRate, int outputRate) const { return inputRate == mInputRate && outputRate == mOutputRate; }
+
+		/**
+		 * Clears the history and the position, keeping the filter. Does not allocate.
+		 */
+		void reset();
+
+		/**
+		 * Sets a fine correction of the conversion ratio, for example to follow the clock of the sender.
+		 * @param drift Factor on the number of input samples consumed per output sample, clamped to 1 +/- mMaxDrift.
+		 */
+		void setDrift(double drift);
+
+		/**
+		 * @return Number of input samples process() consumes to produce outputCount samples from the current position
+		 */
+		int getInputCount(int outputCount) const;
+
+		/**
+		 * @return Buffer to write the new input samples of a channel to before calling process()
+		 */
+		float* getInput(int channel) { return mBuffer.data() + channel * mStride + 2 * mHalfLength; }
+
+		/**
+		 * Converts the input written to getInput() into outputCount samples.
+		 * @param inputCount Number of new input samples, as returned by getInputCount()
+		 * @param outputCount Number of output samples, at most mMaxOutputCount
+		 * @param write Called with the channel, the index and the value of every output sample
+		 */
+		template <typename Writer>
+		void process(int inputCount, int outputCount, Writer write);
+
+	private:
+		int mChannelCount = 0;
+		int mMaxChannelCount = 0; // Number of channels the buffer has room for
+		int mInputRate = 0;
+		int mOutputRate = 0;
+		int mStride = 0; // Size of the buffer of a channel
+		std::vector<float> mBuffer; // History of 2 * mHalfLength samples followed by the new input, for every channel
+		std::vector<float> mFilter; // mPhaseCount + 1 phases of 2 * mHalfLength coefficients
+		uint64_t mPosition = 0; // Position of the next output sample in the buffer, 32.32 fixed point
+		uint64_t mStep = 0; // Input samples per output sample, 32.32 fixed point
+	};
+
+
+	template <typename Writer>
+	void VBANResampler::process(int inputCount, int outputCount, Writer write)
+	{
+		constexpr int length = 2 * mHalfLength;
+		float coefficients[length];
+		for (auto i = 0; i < outputCount; ++i)
+		{
+			// Interpolate the coefficients between the two nearest phases
+			auto index = static_cast<int>(mPosition >> 32);
+			auto fraction = static_cast<uint32_t>(mPosition);
+			auto phase = fraction >> 24;
+			auto weight = static_cast<float>(fraction & 0xFFFFFF) * (1.f / 16777216.f);
+			auto filter = mFilter.data() + phase * length;
+			for (auto k = 0; k < length; ++k)
+				coefficients[k] = filter[k] + weight * (filter[length + k] - filter[k]);
+
+			auto start = index - mHalfLength + 1;
+			for (auto channel = 0; channel < mChannelCount; ++channel)
+			{
+				// Eight partial sums give the compiler independent lanes to vectorize
+				auto data = mBuffer.data() + channel * mStride + start;
+				float sums[8] = { };
+				for (auto k = 0; k < length; k += 8)
+					for (auto lane = 0; lane < 8; ++lane)
+						sums[lane] += data[k + lane] * coefficients[k + lane];
+				write(channel, i, ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7])));
+			}
+			mPosition += mStep;
+		}
+
+		// Keep the last samples as history for the next call
+		for (auto channel = 0; channel < mChannelCount; ++channel)
+		{
+			auto data = mBuffer.data() + channel * mStride;
+			std::copy(data + inputCount, data + inputCount + length, data);
+		}
+		mPosition -= static_cast<uint64_t>(inputCount) << 32;
+	}
+
+}
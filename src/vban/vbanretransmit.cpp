@@ -0,0 +1,131 @@
+#include "vbanretransmit.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+namespace vban
+{
+
+	void VBANNackGenerator::receivePacket(const char* data, int size, std::chrono::steady_clock::time_point now)
+	{
+		if (size < VBAN_HEADER_SIZE)
+			return;
+
+		auto header = reinterpret_cast<const VBanHeader*>(data);
+		auto rateIndex = header->format_SR & VBAN_SR_MASK;
+		if (rateIndex >= VBAN_SR_MAXNUMBER)
+			return;
+		auto frame = header->nuFrame;
+		if (!mHasStream)
+		{
+			std::memcpy(mStreamName, header->streamname, VBAN_STREAM_NAME_SIZE);
+			mNewestFrame = frame - 1;
+			mHasStream = true;
+		}
+		mSampleRateFormat = static_cast<uint8_t>(rateIndex);
+		mSamplesPerPacket = header->format_nbs + 1;
+		mSampleRate = static_cast<int>(VBanSRList[rateIndex]);
+
+		// A jump of more than a second either way is a sender that restarted, the frames of before are not requested anymore
+		auto distance = static_cast<int32_t>(frame - mNewestFrame);
+		if (std::abs(static_cast<int64_t>(distance)) * mSamplesPerPacket > mSampleRate)
+		{
+			std::fill(std::begin(mFrames), std::end(mFrames), Frame());
+			mNewestFrame = frame;
+		}
+
+		// The frames skipped by a newer frame are lost unless they show up within the reorder time
+		else if (distance > 0)
+		{
+			for (auto i = std::max(1, distance - mWindowSize + 1); i < distance; ++i)
+				getFrame(mNewestFrame + i).mLostTime = now;
+			mNewestFrame = frame;
+		}
+		else if (distance <= -mWindowSize)
+			return;
+
+		auto& state = getFrame(frame);
+		state.mIsReceived = true;
+		state.mIsDone = true;
+	}
+
+
+	int VBANNackGenerator::createNack(int64_t readFrame, std::chrono::steady_clock::time_point now, char* packet)
+	{
+		if (!mHasStream)
+			return 0;
+
+		auto roundTripTime = std::chrono::microseconds(mRoundTripTime.load());
+		auto reorderTime = std::chrono::microseconds(mReorderTime.load());
+		auto packetDuration = std::chrono::microseconds(static_cast<int64_t>(mSamplesPerPacket) * 1000000 / mSampleRate);
+
+		uint32_t first = 0;
+		auto hasFirst = false;
+		unsigned char bitmap[VBAN_NACK_BITMAP_SIZE] = { };
+		for (auto i = mWindowSize - 1; i > 0; --i)
+		{
+			auto frame = mNewestFrame - i;
+			auto& state = mFrames[frame % mWindowSize];
+			if (state.mFrame != frame || state.mIsDone || now - state.mLostTime < reorderTime)
+				continue;
+
+			// The frame after the one being played starts within a packet period, every next frame one period later.
+			// A frame that has been requested before may still be on its way, it is only no longer asked for.
+			if (readFrame >= 0)
+			{
+				auto ahead = static_cast<int32_t>(frame - static_cast<uint32_t>(readFrame));
+				if (ahead < 1 || (ahead - 1) * packetDuration < roundTripTime)
+				{
+					state.mIsDone = true;
+					if (!state.mIsRequested)
+						mSkipCount++;
+					continue;
+				}
+			}
+
+			// Ask again when the retransmission did not arrive within a round trip
+			if (state.mIsRequested && now - state.mRequestTime < roundTripTime)
+				continue;
+
+			if (!hasFirst)
+			{
+				first = frame;
+				hasFirst = true;
+			}
+			auto bit = static_cast<uint32_t>(frame - first);
+			if (bit >= VBAN_NACK_BITMAP_SIZE * 8)
+				break;
+			bitmap[bit / 8] |= 1 << (bit % 8);
+			state.mIsRequested = true;
+			state.mRequestTime = now;
+			mRequestCount++;
+		}
+		if (!hasFirst)
+			return 0;
+
+		std::memset(packet, 0, VBAN_NACK_PACKET_SIZE);
+		auto header = reinterpret_cast<VBanHeader*>(packet);
+		header->vban = *(int32_t*)("VBAN");
+		header->format_SR = mSampleRateFormat;
+		header->format_bit = VBAN_CODEC_USER;
+		std::memcpy(header->streamname, mStreamName, VBAN_STREAM_NAME_SIZE);
+		header->nuFrame = first;
+		packet[VBAN_HEADER_SIZE] = VBAN_USER_CODEC_NACK;
+		std::memcpy(packet + VBAN_NACK_BITMAP_OFFSET, bitmap, VBAN_NACK_BITMAP_SIZE);
+		return VBAN_NACK_PACKET_SIZE;
+	}
+
+
+	VBANNackGenerator::Frame& VBANNackGenerator::getFrame(uint32_t frame)
+	{
+		auto& state = mFrames[frame % mWindowSize];
+		if (state.mFrame != frame)
+		{
+			state = Frame();
+			state.mFrame = frame;
+		}
+		return state;
+	}
+
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include "vban.h"
+#include "vbanusercodec.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+namespace vban
+{
+
+	/**
+	 * Keeps the last packets of a stream so lost packets can be sent again when a receiver asks for them with a retransmission request, see VBANNackGenerator.
+	 * On links where the round trip is shorter than the jitter buffer a retransmitted packet still arrives in time to be played, at a fraction of the bandwidth of redundant packets.
+	 * The cache is used as the SenderType of a VBANStreamEncoder: packets are stored in a fixed ring of slots indexed by their frame number and forwarded to the actual sender, without allocations.
+	 * Requests are handled on the network thread with receiveNack(), which copies the requested packets out of the ring and sends them through a sender of the network thread.
+	 * @tparam SenderType The sender the packets are forwarded to, see VBANStreamEncoder.
+	 */
+	template <typename SenderType>
+	class VBANRetransmitCache
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param sender The sender the packets of the encoder are forwarded to
+		 * @param slotCount Number of packets kept, has to be a power of two. Should cover the jitter buffer of the receivers.
+		 */
+		explicit VBANRetransmitCache(SenderType& sender, int slotCount = 64);
+
+		// Default destructor
+		virtual ~VBANRetransmitCache() = default;
+
+		/**
+		 * Called by the encoder on the audio thread, stores the packet when it holds audio and forwards it to the sender.
+		 * @param data The vban packet to be sent.
+		 */
+		void sendPacket(const std::vector<char>& data);
+
+		/**
+		 * Called by the encoder on the audio thread after a batch of packets, forwarded to the sender when it implements flush().
+		 */
+		void flush() { flush(mSender, 0); }
+
+		/**
+		 * Called by the encoder on the audio thread at the start of every process() call, forwarded to the sender when it implements beginProcess().
+		 */
+		void beginProcess() { beginProcess(mSender, 0); }
+
+		/**
+		 * Called by the encoder on the audio thread at the end of every process() call, forwarded to the sender when it implements endProcess().
+		 */
+		void endProcess() { endProcess(mSender, 0); }
+
+		/**
+		 * Call this method from the network thread with a packet received from a receiver.
+		 * When it is a retransmission request for this stream, the requested packets that are still in the cache are sent again.
+		 * @tparam T Sender type of the network thread, implements sendPacket().
+		 * @param data The received packet
+		 * @param size Size of the packet in bytes
+		 * @param sender Sender the packets are sent again through, usually to the address the request came from.
+		 * @return Number of packets sent again, or -1 when the packet is not a retransmission request for this stream.
+		 */
+		template <typename T>
+		int receiveNack(const char* data, int size, T& sender);
+
+		/**
+		 * @return Number of packets that have been sent again
+		 */
+		int getRetransmitCount() const { return mRetransmitCount.load(); }
+
+		/**
+		 * @return Number of requested packets that were no longer in the cache
+		 */
+		int getMissCount() const { return mMissCount.load(); }
+
+	private:
+		template <typename T>
+		static auto flush(T& sender, int) -> decltype(sender.flush(), void()) { sender.flush(); }
+		template <typename T>
+		static void flush(T&, long) { }
+		template <typename T>
+		static auto beginProcess(T& sender, int) -> decltype(sender.beginProcess(), void()) { sender.beginProcess(); }
+		template <typename T>
+		static void beginProcess(T&, long) { }
+		template <typename T>
+		static auto endProcess(T& sender, int) -> decltype(sender.endProcess(), void()) { sender.endProcess(); }
+		template <typename T>
+		static void endProcess(T&, long) { }
+
+		SenderType& mSender;
+		const int mSlotCount;
+		std::vector<char> mPackets; // mSlotCount packets of VBAN_PROTOCOL_MAX_SIZE bytes
+		std::unique_ptr<std::atomic<int64_t>[]> mFrames; // Frame number of the packet in every slot, -1 while empty or being written
+		std::unique_ptr<std::atomic<int>[]> mSizes; // Size of the packet in every slot
+		std::vector<char> mResendBuffer; // Packet being sent again, used by the network thread
+		std::atomic<uint64_t> mStreamName[VBAN_STREAM_NAME_SIZE / 8] = { }; // Name of the stream of the cached packets, written by the audio thread
+		std::atomic<int> mRetransmitCount = { 0 };
+		std::atomic<int> mMissCount = { 0 };
+	};
+
+
+	/**
+	 * Watches the packets of a stream arriving at a receiver and asks the sender to send the lost ones again, see VBANRetransmitCache.
+	 * A frame is considered lost when a later frame arrived and it did not show up within the reorder time.
+	 * A lost frame is only requested while it can still arrive before the decoder plays it: the time until it is played has to be longer than the round trip.
+	 * Frames that can not make it in time anymore are given up, so the request does not waste bandwidth on packets the decoder would reject.
+	 * A frame that is still missing a round trip after its request is requested again.
+	 * A jump of the frame numbers by more than a second is taken as a restart of the sender and starts the window over.
+	 * All methods are called from the network thread.
+	 */
+	class VBANNackGenerator
+	{
+	public:
+		// Number of frames behind the newest one that are tracked
+		static constexpr int mWindowSize = 256;
+
+		/**
+		 * Sets the round trip time to the sender, the time a retransmission takes to arrive after the request.
+		 * @param time Round trip time in microseconds
+		 */
+		void setRoundTripTime(std::chrono::microseconds time) { mRoundTripTime.store(static_cast<int>(time.count())); }
+
+		/**
+		 * Sets how long a frame may arrive after a later frame before it is considered lost.
+		 * @param time Reorder time in microseconds
+		 */
+		void setReorderTime(std::chrono::microseconds time) { mReorderTime.store(static_cast<int>(time.count())); }
+
+		/**
+		 * Call this method from the network thread for every received packet of the stream, also for retransmitted ones.
+		 * @param data The packet, already validated by the decoder
+		 * @param size Size of the packet in bytes
+		 * @param now Time of arrival
+		 */
+		void receivePacket(const char* data, int size, std::chrono::steady_clock::time_point now);
+
+		/**
+		 * Call this method regularly from the network thread, for example after every received packet, to request the lost frames that can still be played.
+		 * @param readFrame Frame the decoder is playing, see VBANStreamDecoder::getReadFrame(), or -1 when it is not playing.
+		 * @param now Current time
+		 * @param packet Receives the retransmission request, holds VBAN_NACK_PACKET_SIZE bytes.
+		 * @return Size of the request to send to the sender, or 0 when no frame has to be requested.
+		 */
+		int createNack(int64_t readFrame, std::chrono::steady_clock::time_point now, char* packet);
+
+		/**
+		 * @return Number of frames that have been requested, including requests that were repeated
+		 */
+		int getRequestCount() const { return mRequestCount.load(); }
+
+		/**
+		 * @return Number of lost frames that were not requested because a retransmission could not arrive before they were played
+		 */
+		int getSkipCount() const { return mSkipCount.load(); }
+
+	private:
+		// State of a frame in the window
+		struct Frame
+		{
+			int64_t mFrame = -1; // Frame number the slot holds, -1 when unused
+			bool mIsReceived = false;
+			bool mIsDone = false; // Received, given up or played
+			bool mIsRequested = false;
+			std::chrono::steady_clock::time_point mLostTime; // When a later frame arrived
+			std::chrono::steady_clock::time_point mRequestTime; // When the frame was last requested
+		};
+
+		/**
+		 * @return The state of a frame, reset when the slot held an older frame.
+		 */
+		Frame& getFrame(uint32_t frame);
+
+		// Settings
+		std::atomic<int> mRoundTripTime = { 20000 };
+		std::atomic<int> mReorderTime = { 2000 };
+
+		// State
+		Frame mFrames[mWindowSize];
+		bool mHasStream = false;
+		uint32_t mNewestFrame = 0;
+		char mStreamName[VBAN_STREAM_NAME_SIZE] = { };
+		uint8_t mSampleRateFormat = 0;
+		int mSamplesPerPacket = 0;
+		int mSampleRate = 0;
+		std::atomic<int> mRequestCount = { 0 };
+		std::atomic<int> mSkipCount = { 0 };
+	};
+
+
+	template <typename SenderType>
+	VBANRetransmitCache<SenderType>::VBANRetransmitCache(SenderType& sender, int slotCount) : mSender(sender), mSlotCount(slotCount)
+	{
+		assert(slotCount > 0 && (slotCount & (slotCount - 1)) == 0);
+		mPackets.resize(static_cast<size_t>(slotCount) * VBAN_PROTOCOL_MAX_SIZE);
+		mFrames = std::make_unique<std::atomic<int64_t>[]>(slotCount);
+		mSizes = std::make_unique<std::atomic<int>[]>(slotCount);
+		for (auto i = 0; i < slotCount; ++i)
+		{
+			mFrames[i].store(-1);
+			mSizes[i].store(0);
+		}
+		mResendBuffer.reserve(VBAN_PROTOCOL_MAX_SIZE);
+	}
+
+
+	template <typename SenderType>
+	void VBANRetransmitCache<SenderType>::sendPacket(const std::vector<char>& data)
+	{
+		// Only the audio is kept, so timestamps and requests that share its frame number do not replace it
+		auto isAudio = data.size() >= VBAN_HEADER_SIZE && data.size() <= VBAN_PROTOCOL_MAX_SIZE;
+		if (isAudio && (data[offsetof(VBanHeader, format_bit)] & VBAN_CODEC_MASK) == VBAN_CODEC_USER)
+			isAudio = data.size() > VBAN_HEADER_SIZE && data[VBAN_HEADER_SIZE] != VBAN_USER_CODEC_NACK && data[VBAN_HEADER_SIZE] != VBAN_USER_CODEC_TIMESTAMPS;
+		if (isAudio)
+		{
+			// Mark the slot as being written, so the network thread does not send a mix of two packets
+			auto frame = reinterpret_cast<const VBanHeader*>(data.data())->nuFrame;
+			auto index = frame & (mSlotCount - 1);
+			for (auto i = 0; i < VBAN_STREAM_NAME_SIZE / 8; ++i)
+			{
+				uint64_t word;
+				std::memcpy(&word, data.data() + offsetof(VBanHeader, streamname) + i * 8, 8);
+				if (mStreamName[i].load(std::memory_order_relaxed) != word)
+					mStreamName[i].store(word, std::memory_order_relaxed);
+			}
+			mFrames[index].store(-1, std::memory_order_release);
+			std::atomic_thread_fence(std::memory_order_release);
+			std::memcpy(mPackets.data() + static_cast<size_t>(index) * VBAN_PROTOCOL_MAX_SIZE, data.data(), data.size());
+			mSizes[index].store(static_cast<int>(data.size()), std::memory_order_relaxed);
+			mFrames[index].store(frame, std::memory_order_release);
+		}
+		mSender.sendPacket(data);
+	}
+
+
+	template <typename SenderType>
+	template <typename T>
+	int VBANRetransmitCache<SenderType>::receiveNack(const char* data, int size, T& sender)
+	{
+		auto header = reinterpret_cast<const VBanHeader*>(data);
+		if (size != VBAN_NACK_PACKET_SIZE || std::memcmp(data, "VBAN", 4) != 0 || (header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_USER || data[VBAN_HEADER_SIZE] != VBAN_USER_CODEC_NACK)
+			return -1;
+
+		// Requests for other streams to the same sender are left to their own cache
+		char streamName[VBAN_STREAM_NAME_SIZE];
+		for (auto i = 0; i < VBAN_STREAM_NAME_SIZE / 8; ++i)
+		{
+			auto word = mStreamName[i].load(std::memory_order_relaxed);
+			std::memcpy(streamName + i * 8, &word, 8);
+		}
+		if (std::strncmp(streamName, header->streamname, VBAN_STREAM_NAME_SIZE) != 0)
+			return -1;
+
+		auto bitmap = reinterpret_cast<const unsigned char*>(data) + VBAN_NACK_BITMAP_OFFSET;
+		auto count = 0;
+		for (auto i = 0; i < VBAN_NACK_BITMAP_SIZE * 8; ++i)
+		{
+			if ((bitmap[i / 8] & (1 << (i % 8))) == 0)
+				continue;
+
+			// Copy the packet out and check it was not overwritten in the meantime
+			uint32_t frame = header->nuFrame + i;
+			auto index = frame & (mSlotCount - 1);
+			auto packet = mPackets.data() + static_cast<size_t>(index) * VBAN_PROTOCOL_MAX_SIZE;
+			if (mFrames[index].load(std::memory_order_acquire) != frame)
+			{
+				mMissCount++;
+				continue;
+			}
+			mResendBuffer.resize(mSizes[index].load(std::memory_order_relaxed));
+			std::memcpy(mResendBuffer.data(), packet, mResendBuffer.size());
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (mFrames[index].load(std::memory_order_relaxed) != frame)
+			{
+				mMissCount++;
+				continue;
+			}
+
+			// The stream can have been renamed since the check above
+			if (std::strncmp(mResendBuffer.data() + offsetof(VBanHeader, streamname), header->streamname, VBAN_STREAM_NAME_SIZE) != 0)
+				return -1;
+
+			sender.sendPacket(mResendBuffer);
+			mRetransmitCount++;
+			count++;
+		}
+		return count;
+	}
+
+}
@@ -0,0 +1,72 @@
+#include "vbanrtpgateway.h"
+
+namespace vban
+{
+
+	void swapSampleBytes(const char* input, char* output, int valueCount, int bytesPerSample)
+	{
+		// Fixed sizes so the compiler can turn the loops into shuffles
+		if (bytesPerSample == 2)
+		{
+			for (auto i = 0; i < valueCount; ++i)
+			{
+				output[i * 2] = input[i * 2 + 1];
+				output[i * 2 + 1] = input[i * 2];
+			}
+		}
+		else if (bytesPerSample == 3)
+		{
+			for (auto i = 0; i < valueCount; ++i)
+			{
+				output[i * 3] = input[i * 3 + 2];
+				output[i * 3 + 1] = input[i * 3 + 1];
+				output[i * 3 + 2] = input[i * 3];
+			}
+		}
+	}
+
+
+	void writeRtpHeader(char* data, int payloadType, uint16_t sequence, uint32_t timestamp, uint32_t ssrc)
+	{
+		auto header = reinterpret_cast<uint8_t*>(data);
+		header[0] = 0x80; // version 2, no padding, extension or contributing sources
+		header[1] = static_cast<uint8_t>(payloadType & 0x7F);
+		header[2] = static_cast<uint8_t>(sequence >> 8);
+		header[3] = static_cast<uint8_t>(sequence);
+		for (auto i = 0; i < 4; ++i)
+		{
+			header[4 + i] = static_cast<uint8_t>(timestamp >> (24 - i * 8));
+			header[8 + i] = static_cast<uint8_t>(ssrc >> (24 - i * 8));
+		}
+	}
+
+
+	int readRtpHeader(const char* data, int size, int& payloadType, uint16_t& sequence, uint32_t& timestamp, int& payloadSize)
+	{
+		auto header = reinterpret_cast<const uint8_t*>(data);
+		if (size < RTP_HEADER_SIZE || (header[0] >> 6) != 2)
+			return -1;
+
+		payloadType = header[1] & 0x7F;
+		sequence = static_cast<uint16_t>((header[2] << 8) | header[3]);
+		timestamp = (uint32_t(header[4]) << 24) | (uint32_t(header[5]) << 16) | (uint32_t(header[6]) << 8) | uint32_t(header[7]);
+
+		auto offset = RTP_HEADER_SIZE + (header[0] & 0x0F) * 4;
+		if ((header[0] & 0x10) != 0)
+		{
+			// Header extension, the length is given in 32 bit words after a 4 byte profile header
+			if (size < offset + 4)
+				return -1;
+			offset += 4 + ((header[offset + 2] << 8) | header[offset + 3]) * 4;
+		}
+		auto end = size;
+		if ((header[0] & 0x20) != 0 && size > 0)
+			end -= header[size - 1];
+		if (offset > end)
+			return -1;
+
+		payloadSize = end - offset;
+		return offset;
+	}
+
+}
@@ -0,0 +1,552 @@
+#pragma once
+
+#include "vban.h"
+#include "vbanpacketvalidator.h"
+#include "dirtyflag.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+namespace vban
+{
+
+	// Size of an RTP header without contributing sources or extensions
+	constexpr int RTP_HEADER_SIZE = 12;
+
+	// Largest RTP payload the gateway sends, keeps packets within a standard ethernet MTU like AES67 requires
+	constexpr int RTP_PAYLOAD_MAX_SIZE = 1440;
+
+	/**
+	 * Converts between little endian VBAN samples and big endian RTP L16 or L24 samples, in both directions.
+	 * @param input Interleaved samples in one byte order
+	 * @param output Receives the samples in the other byte order, can not overlap with input.
+	 * @param valueCount Number of samples over all channels
+	 * @param bytesPerSample 2 or 3
+	 */
+	void swapSampleBytes(const char* input, char* output, int valueCount, int bytesPerSample);
+
+	/**
+	 * Writes an RTP header.
+	 * @param data Receives RTP_HEADER_SIZE bytes
+	 */
+	void writeRtpHeader(char* data, int payloadType, uint16_t sequence, uint32_t timestamp, uint32_t ssrc);
+
+	/**
+	 * Reads the header of an RTP packet, skipping contributing sources, extensions and padding.
+	 * @return Offset of the payload in data, or -1 when the packet is malformed.
+	 */
+	int readRtpHeader(const char* data, int size, int& payloadType, uint16_t& sequence, uint32_t& timestamp, int& payloadSize);
+
+	/**
+	 * Repacketizes a VBAN stream into an RTP L16 or L24 stream for AES67 equipment.
+	 * Incoming VBAN packets are converted straight into the payload of the RTP packet being built, which is sent as soon as it holds the configured packet time.
+	 * Missing VBAN frames are replaced by silence so the RTP timestamps stay continuous, packets that arrive too late are dropped. Both are counted.
+	 * Frame numbers that jump back by more than a second are taken as a restart of the sender, the RTP stream continues with them.
+	 * The receiving AES67 device or VBANStreamDecoder absorbs the network jitter, the gateway does not add latency beyond one RTP packet.
+	 * Only 16 and 24 bit integer VBAN streams can be converted.
+	 * @tparam SenderType Sends the RTP packets, has to implement sendPacket(const std::vector<char>& data) like the SenderType of VBANStreamEncoder.
+	 */
+	template <typename SenderType>
+	class VBANToRtpGateway
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param sender This object's sendPacket() method is called with every RTP packet.
+		 */
+		explicit VBANToRtpGateway(SenderType& sender) : mSender(sender)
+		{
+			mRtpBuffer.reserve(RTP_HEADER_SIZE + RTP_PAYLOAD_MAX_SIZE);
+			mIsDirty.set();
+		}
+
+		// Default destructor
+		virtual ~VBANToRtpGateway() = default;
+
+		/**
+		 * Call this method from the network thread to convert a received VBAN packet.
+		 * @param data Data containing the full VBAN packet including the header.
+		 * @param size Size of the packet in bytes.
+		 * @return True if the packet was converted.
+		 */
+		bool receivePacket(const char* data, int size);
+
+		/**
+		 * Sets the name of the VBAN stream that is converted. Packets of other streams are ignored.
+		 * @param name Has to be equal or smaller than 16 characters. An empty name accepts packets of any stream.
+		 */
+		void setStreamName(const std::string& name);
+
+		/**
+		 * Sets the packet time of the RTP stream. AES67 requires 48 samples (1 ms at 48kHz) and allows 6, 12 and 16.
+		 * Packets are made smaller when the packet time does not fit the MTU for the number of channels.
+		 * @param sampleCount Number of samples per RTP packet
+		 */
+		void setPacketTime(int sampleCount);
+
+		/**
+		 * Sets the RTP payload type, as announced in the SDP of the stream.
+		 * @param payloadType Dynamic payload type between 96 and 127
+		 */
+		void setPayloadType(int payloadType);
+
+		/**
+		 * Sets the synchronization source identifier of the RTP stream.
+		 */
+		void setSsrc(uint32_t ssrc) { mSsrc.store(ssrc); mIsDirty.set(); }
+
+		/**
+		 * @return Number of RTP packets sent
+		 */
+		int getPacketCount() const { return mPacketCount.load(); }
+
+		/**
+		 * @return Number of VBAN packets that did not arrive and have been replaced by silence.
+		 */
+		int getLostPacketCount() const { return mLostPacketCount.load(); }
+
+		/**
+		 * @return Number of VBAN packets that arrived after newer packets and have been dropped.
+		 */
+		int getLatePacketCount() const { return mLatePacketCount.load(); }
+
+	private:
+		/**
+		 * Appends sampleCount samples to the RTP packet being built, converted from input or silence when input is nullptr. Sends every full packet.
+		 */
+		void append(const char* input, int sampleCount);
+
+		// Settings
+		std::atomic<int> mPacketTime = { 48 };
+		std::atomic<int> mPayloadType = { 96 };
+		std::atomic<uint32_t> mSsrc = { 0x56424e31 };
+		std::string mStreamName;
+		std::mutex mStreamNameLock;
+		DirtyFlag mIsDirty;
+
+		// State
+		char mNameFilter[VBAN_STREAM_NAME_SIZE] = { };
+		int mCurrentPayloadType = 96;
+		uint32_t mCurrentSsrc = 0;
+		int mChannelCount = 0;
+		int mBytesPerSample = 0;
+		int mSampleRate = 0;
+		int mSamplesPerPacket = 48; // Packet time, limited by the MTU
+		bool mIsStarted = false;
+		uint32_t mExpectedFrame = 0; // VBAN frame number expected next
+		uint16_t mSequence = 0;
+		uint32_t mTimestamp = 0; // RTP timestamp of the first sample in the packet being built
+		int mFill = 0; // Number of samples in the packet being built
+		std::vector<char> mRtpBuffer;
+
+		// Statistics
+		std::atomic<int> mPacketCount = { 0 };
+		std::atomic<int> mLostPacketCount = { 0 };
+		std::atomic<int> mLatePacketCount = { 0 };
+
+		SenderType& mSender;
+	};
+
+
+	/**
+	 * Repacketizes an RTP L16 or L24 stream from AES67 equipment into a VBAN stream.
+	 * RTP carries no format information, so the channel count, sample rate and bit depth have to be set as announced in the SDP of the stream.
+	 * Incoming payloads are converted straight into the VBAN packet being built, which is sent as soon as it holds the configured number of samples.
+	 * Gaps in the RTP timestamps are filled with silence, packets that arrive too late are dropped. Both are counted.
+	 * Timestamps that jump back by more than a second are taken as a restart of the sender, the VBAN stream continues with them.
+	 * @tparam SenderType Sends the VBAN packets, for example a VBANStreamDecoder adapter or a VBANUdpSender.
+	 */
+	template <typename SenderType>
+	class RtpToVBANGateway
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param sender This object's sendPacket() method is called with every VBAN packet.
+		 */
+		explicit RtpToVBANGateway(SenderType& sender) : mSender(sender)
+		{
+			mVbanBuffer.reserve(VBAN_PROTOCOL_MAX_SIZE);
+			mIsDirty.set();
+		}
+
+		// Default destructor
+		virtual ~RtpToVBANGateway() = default;
+
+		/**
+		 * Call this method from the network thread to convert a received RTP packet.
+		 * @param data Data containing the full RTP packet including the header.
+		 * @param size Size of the packet in bytes.
+		 * @return True if the packet was converted.
+		 */
+		bool receivePacket(const char* data, int size);
+
+		/**
+		 * Sets the name of the VBAN stream that is sent.
+		 * @param name Has to be equal or smaller than 16 characters.
+		 */
+		void setStreamName(const std::string& name);
+
+		/**
+		 * Sets the format of the RTP stream.
+		 * @param channelCount Number of channels
+		 * @param sampleRateFormat Index to VBanSRList
+		 * @param bitDepth 16 for L16 or 24 for L24
+		 */
+		void setFormat(int channelCount, int sampleRateFormat, int bitDepth);
+
+		/**
+		 * Sets the number of samples per VBAN packet. Packets are made smaller when they do not fit in a VBAN packet.
+		 * @param sampleCount Number of samples, up to VBAN_SAMPLES_MAX_NB.
+		 */
+		void setSamplesPerPacket(int sampleCount);
+
+		/**
+		 * Sets the RTP payload type that is accepted.
+		 * @param payloadType Payload type, or -1 to accept any.
+		 */
+		void setPayloadType(int payloadType);
+
+		/**
+		 * @return Number of VBAN packets sent
+		 */
+		int getPacketCount() const { return mPacketCount.load(); }
+
+		/**
+		 * @return Number of RTP packets that did not arrive and have been replaced by silence.
+		 */
+		int getLostPacketCount() const { return mLostPacketCount.load(); }
+
+		/**
+		 * @return Number of RTP packets that arrived after newer packets and have been dropped.
+		 */
+		int getLatePacketCount() const { return mLatePacketCount.load(); }
+
+	private:
+		/**
+		 * Updates the internal state from the current settings
+		 */
+		void update();
+
+		/**
+		 * Appends sampleCount samples to the VBAN packet being built, converted from input or silence when input is nullptr. Sends every full packet.
+		 */
+		void append(const char* input, int sampleCount);
+
+		// Settings
+		std::atomic<int> mChannelCount = { 2 };
+		std::atomic<int> mSampleRateFormat = { 3 };
+		std::atomic<int> mBitDepth = { 24 };
+		std::atomic<int> mSamplesPerPacket = { 48 };
+		std::atomic<int> mPayloadType = { -1 };
+		std::string mStreamName = "aes67";
+		std::mutex mStreamNameLock;
+		DirtyFlag mIsDirty;
+
+		// State
+		int mCurrentChannelCount = 2;
+		int mBytesPerSample = 3;
+		int mCurrentSamplesPerPacket = 48;
+		int mCurrentPayloadType = -1;
+		int mSampleRate = 48000;
+		bool mIsStarted = false;
+		uint16_t mExpectedSequence = 0;
+		uint32_t mExpectedTimestamp = 0; // RTP timestamp expected next
+		uint32_t mFrame = 0; // VBAN frame number of the packet being built
+		int mFill = 0; // Number of samples in the packet being built
+		std::vector<char> mVbanBuffer;
+
+		// Statistics
+		std::atomic<int> mPacketCount = { 0 };
+		std::atomic<int> mLostPacketCount = { 0 };
+		std::atomic<int> mLatePacketCount = { 0 };
+
+		SenderType& mSender;
+	};
+
+
+	template <typename SenderType>
+	bool VBANToRtpGateway<SenderType>::receivePacket(const char* data, int size)
+	{
+		if (!validatePacket(data, size))
+			return false;
+
+		auto header = reinterpret_cast<const VBanHeader*>(data);
+		if (mIsDirty.check())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mStreamNameLock);
+				std::memset(mNameFilter, 0, VBAN_STREAM_NAME_SIZE);
+				std::memcpy(mNameFilter, mStreamName.c_str(), std::min<size_t>(mStreamName.size(), VBAN_STREAM_NAME_SIZE));
+			}
+			mCurrentPayloadType = mPayloadType.load();
+			mCurrentSsrc = mSsrc.load();
+			mIsStarted = false;
+		}
+		if (mNameFilter[0] != 0 && std::strncmp(mNameFilter, header->streamname, VBAN_STREAM_NAME_SIZE) != 0)
+			return false;
+
+		auto bitFormat = header->format_bit & VBAN_BIT_RESOLUTION_MASK;
+		if ((header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_PCM || (bitFormat != VBAN_BITFMT_16_INT && bitFormat != VBAN_BITFMT_24_INT))
+			return false;
+
+		// A format change starts a new RTP stream
+		auto channelCount = header->format_nbc + 1;
+		auto bytesPerSample = VBanBitResolutionSize[bitFormat];
+		auto sampleRate = static_cast<int>(VBanSRList[header->format_SR & VBAN_SR_MASK]);
+		if (channelCount != mChannelCount || bytesPerSample != mBytesPerSample || sampleRate != mSampleRate)
+		{
+			mChannelCount = channelCount;
+			mBytesPerSample = bytesPerSample;
+			mSampleRate = sampleRate;
+			mIsStarted = false;
+		}
+
+		auto frame = header->nuFrame;
+		auto sampleCount = header->format_nbs + 1;
+		if (!mIsStarted)
+		{
+			mSamplesPerPacket = std::max(1, std::min(mPacketTime.load(), RTP_PAYLOAD_MAX_SIZE / (mChannelCount * mBytesPerSample)));
+			mRtpBuffer.resize(RTP_HEADER_SIZE + mSamplesPerPacket * mChannelCount * mBytesPerSample);
+			mFill = 0;
+			mIsStarted = true;
+		}
+		else
+		{
+			auto distance = static_cast<int32_t>(frame - mExpectedFrame);
+			if (distance < 0 && -static_cast<int64_t>(distance) * sampleCount > mSampleRate)
+			{
+				// A jump back of more than a second is a restart of the sender, the RTP stream continues from the new frame
+				distance = 0;
+			}
+			if (distance < 0)
+			{
+				mLatePacketCount++;
+				return false;
+			}
+			if (distance > 0)
+			{
+				// Fill short gaps with silence, after a long gap the sender probably restarted
+				mLostPacketCount += distance;
+				if (static_cast<int64_t>(distance) * sampleCount <= mSampleRate)
+					append(nullptr, distance * sampleCount);
+			}
+		}
+
+		append(data + VBAN_HEADER_SIZE, sampleCount);
+		mExpectedFrame = frame + 1;
+		return true;
+	}
+
+
+	template <typename SenderType>
+	void VBANToRtpGateway<SenderType>::append(const char* input, int sampleCount)
+	{
+		auto frameSize = mChannelCount * mBytesPerSample;
+		while (sampleCount > 0)
+		{
+			auto count = std::min(sampleCount, mSamplesPerPacket - mFill);
+			auto output = mRtpBuffer.data() + RTP_HEADER_SIZE + mFill * frameSize;
+			if (input != nullptr)
+			{
+				swapSampleBytes(input, output, count * mChannelCount, mBytesPerSample);
+				input += count * frameSize;
+			}
+			else
+				std::memset(output, 0, count * frameSize);
+			mFill += count;
+			sampleCount -= count;
+
+			if (mFill == mSamplesPerPacket)
+			{
+				writeRtpHeader(mRtpBuffer.data(), mCurrentPayloadType, mSequence, mTimestamp, mCurrentSsrc);
+				mSender.sendPacket(mRtpBuffer);
+				mSequence++;
+				mTimestamp += mSamplesPerPacket;
+				mFill = 0;
+				mPacketCount++;
+			}
+		}
+	}
+
+
+	template <typename SenderType>
+	void VBANToRtpGateway<SenderType>::setStreamName(const std::string& name)
+	{
+		assert(name.size() <= VBAN_STREAM_NAME_SIZE);
+		std::lock_guard<std::mutex> lock(mStreamNameLock);
+		mStreamName = name;
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANToRtpGateway<SenderType>::setPacketTime(int sampleCount)
+	{
+		assert(sampleCount > 0);
+		mPacketTime.store(sampleCount);
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANToRtpGateway<SenderType>::setPayloadType(int payloadType)
+	{
+		assert(payloadType >= 0 && payloadType < 128);
+		mPayloadType.store(payloadType);
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	bool RtpToVBANGateway<SenderType>::receivePacket(const char* data, int size)
+	{
+		if (mIsDirty.check())
+			update();
+
+		int payloadType;
+		uint16_t sequence;
+		uint32_t timestamp;
+		int payloadSize;
+		auto payloadOffset = readRtpHeader(data, size, payloadType, sequence, timestamp, payloadSize);
+		auto frameSize = mCurrentChannelCount * mBytesPerSample;
+		if (payloadOffset < 0 || (mCurrentPayloadType >= 0 && payloadType != mCurrentPayloadType) || payloadSize % frameSize != 0)
+			return false;
+
+		auto sampleCount = payloadSize / frameSize;
+		if (mIsStarted)
+		{
+			auto distance = static_cast<int32_t>(timestamp - mExpectedTimestamp);
+			if (distance < 0 && -static_cast<int64_t>(distance) > mSampleRate)
+			{
+				// A jump back of more than a second is a restart or a discontinuity of the sender, the VBAN stream continues from the new timestamp
+				distance = 0;
+			}
+			if (distance < 0)
+			{
+				mLatePacketCount++;
+				return false;
+			}
+			if (distance > 0)
+			{
+				// Fill short gaps with silence, after a long gap the sender probably restarted
+				mLostPacketCount += static_cast<int16_t>(sequence - mExpectedSequence);
+				if (distance <= mSampleRate)
+					append(nullptr, distance);
+			}
+		}
+		mIsStarted = true;
+
+		append(data + payloadOffset, sampleCount);
+		mExpectedSequence = sequence + 1;
+		mExpectedTimestamp = timestamp + sampleCount;
+		return true;
+	}
+
+
+	template <typename SenderType>
+	void RtpToVBANGateway<SenderType>::update()
+	{
+		mCurrentChannelCount = mChannelCount.load();
+		mBytesPerSample = mBitDepth.load() / 8;
+		mSampleRate = VBanSRList[mSampleRateFormat.load()];
+		mCurrentPayloadType = mPayloadType.load();
+
+		// The packet holds the requested number of samples if they fit
+		auto frameSize = mCurrentChannelCount * mBytesPerSample;
+		mCurrentSamplesPerPacket = std::min(mSamplesPerPacket.load(), VBAN_DATA_MAX_SIZE / frameSize);
+		mVbanBuffer.resize(VBAN_HEADER_SIZE + mCurrentSamplesPerPacket * frameSize);
+
+		auto header = reinterpret_cast<VBanHeader*>(mVbanBuffer.data());
+		std::memset(header, 0, VBAN_HEADER_SIZE);
+		header->vban = *(int32_t*)("VBAN");
+		header->format_SR = mSampleRateFormat.load();
+		header->format_nbs = mCurrentSamplesPerPacket - 1;
+		header->format_nbc = mCurrentChannelCount - 1;
+		header->format_bit = mBytesPerSample == 3 ? VBAN_BITFMT_24_INT : VBAN_BITFMT_16_INT;
+		{
+			std::lock_guard<std::mutex> lock(mStreamNameLock);
+			std::memcpy(header->streamname, mStreamName.c_str(), std::min<size_t>(mStreamName.size(), VBAN_STREAM_NAME_SIZE));
+		}
+
+		mFill = 0;
+		mIsStarted = false;
+	}
+
+
+	template <typename SenderType>
+	void RtpToVBANGateway<SenderType>::append(const char* input, int sampleCount)
+	{
+		auto frameSize = mCurrentChannelCount * mBytesPerSample;
+		while (sampleCount > 0)
+		{
+			auto count = std::min(sampleCount, mCurrentSamplesPerPacket - mFill);
+			auto output = mVbanBuffer.data() + VBAN_HEADER_SIZE + mFill * frameSize;
+			if (input != nullptr)
+			{
+				swapSampleBytes(input, output, count * mCurrentChannelCount, mBytesPerSample);
+				input += count * frameSize;
+			}
+			else
+				std::memset(output, 0, count * frameSize);
+			mFill += count;
+			sampleCount -= count;
+
+			if (mFill == mCurrentSamplesPerPacket)
+			{
+				reinterpret_cast<VBanHeader*>(mVbanBuffer.data())->nuFrame = mFrame++;
+				mSender.sendPacket(mVbanBuffer);
+				mFill = 0;
+				mPacketCount++;
+			}
+		}
+	}
+
+
+	template <typename SenderType>
+	void RtpToVBANGateway<SenderType>::setStreamName(const std::string& name)
+	{
+		assert(name.size() <= VBAN_STREAM_NAME_SIZE);
+		std::lock_guard<std::mutex> lock(mStreamNameLock);
+		mStreamName = name;
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void RtpToVBANGateway<SenderType>::setFormat(int channelCount, int sampleRateFormat, int bitDepth)
+	{
+		assert(channelCount > 0 && channelCount <= VBAN_CHANNELS_MAX_NB);
+		assert(sampleRateFormat < VBAN_SR_MAXNUMBER);
+		assert(bitDepth == 16 || bitDepth == 24);
+		mChannelCount.store(channelCount);
+		mSampleRateFormat.store(sampleRateFormat);
+		mBitDepth.store(bitDepth);
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void RtpToVBANGateway<SenderType>::setSamplesPerPacket(int sampleCount)
+	{
+		assert(sampleCount > 0 && sampleCount <= VBAN_SAMPLES_MAX_NB);
+		mSamplesPerPacket.store(sampleCount);
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void RtpToVBANGateway<SenderType>::setPayloadType(int payloadType)
+	{
+		assert(payloadType < 128);
+		mPayloadType.store(payloadType);
+		mIsDirty.set();
+	}
+
+}
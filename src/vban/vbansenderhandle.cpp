@@ -0,0 +1,146 @@
+#include "vbansenderhandle.h"
+
+namespace vban
+{
+
+	VBANSenderHandle::~VBANSenderHandle()
+	{
+		for (auto& binding : mBindings)
+			if (binding.mDelete != nullptr)
+				binding.mDelete(binding.mObject);
+	}
+
+
+	bool VBANSenderHandle::bind(const Binding& binding)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		collectRetired();
+
+		// Find a binding that is neither current nor waiting to be collected
+		Binding* free = nullptr;
+		for (auto& candidate : mBindings)
+			if (candidate.mObject == nullptr && !candidate.mIsRetired && &candidate != mCurrent.load())
+			{
+				free = &candidate;
+				break;
+			}
+		if (free == nullptr && binding.mObject != nullptr)
+			return false;
+
+		if (free != nullptr)
+		{
+			*free = binding;
+			free->mIsRetired = false;
+		}
+
+		auto previous = mCurrent.exchange(binding.mObject != nullptr ? free : nullptr);
+		if (previous != nullptr)
+			previous->mIsRetired = true;
+		collectRetired();
+		return true;
+	}
+
+
+	void VBANSenderHandle::collect()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		collectRetired();
+	}
+
+
+	void VBANSenderHandle::collectRetired()
+	{
+		auto reader = mReader.load();
+		for (auto& binding : mBindings)
+		{
+			if (!binding.mIsRetired || &binding == reader)
+				continue;
+
+			// Packets the audio thread queued in the sender before it was replaced are still sent
+			if (binding.mObject != nullptr)
+			{
+				binding.mFlush(binding.mObject);
+				if (binding.mDelete != nullptr)
+					binding.mDelete(binding.mObject);
+			}
+			binding = Binding();
+		}
+	}
+
+
+	bool VBANSenderHandle::isReleased(const void* sender)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		collectRetired();
+		for (auto& binding : mBindings)
+			if (binding.mObject == sender)
+				return false;
+		return true;
+	}
+
+
+	VBANSenderHandle::Binding* VBANSenderHandle::acquire()
+	{
+		auto binding = mCurrent.load();
+		while (true)
+		{
+			mReader.store(binding);
+			auto current = mCurrent.load();
+			if (current == binding)
+				return binding;
+			binding = current;
+		}
+	}
+
+
+	void VBANSenderHandle::beginProcess()
+	{
+		mPinned = acquire();
+		mIsPinned = true;
+		if (mPinned != nullptr)
+			mPinned->mBegin(mPinned->mObject);
+	}
+
+
+	void VBANSenderHandle::endProcess()
+	{
+		if (mPinned != nullptr)
+			mPinned->mEnd(mPinned->mObject);
+		mPinned = nullptr;
+		mIsPinned = false;
+		mReader.store(nullptr);
+	}
+
+
+	void VBANSenderHandle::sendPacket(const std::vector<char>& data)
+	{
+		if (mIsPinned)
+		{
+			if (mPinned != nullptr)
+				mPinned->mSend(mPinned->mObject, data);
+			return;
+		}
+
+		auto binding = acquire();
+		if (binding != nullptr)
+			binding->mSend(binding->mObject, data);
+		mReader.store(nullptr);
+	}
+
+
+	void VBANSenderHandle::flush()
+	{
+		if (mIsPinned)
+		{
+			if (mPinned != nullptr)
+				mPinned->mFlush(mPinned->mObject);
+			return;
+		}
+
+		auto binding = acquire();
+		if (binding != nullptr)
+			binding->mFlush(binding->mObject);
+		mReader.store(nullptr);
+	}
+
+}
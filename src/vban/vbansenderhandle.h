@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vban
+{
+
+	/**
+	 * Type erased sender that can be used as the SenderType of a VBANStreamEncoder, so the destination or transport of a stream can be changed without recreating the encoder.
+	 * The actual sender is swapped from the control thread with setSender() while the audio thread keeps encoding. Every packet is forwarded with one indirect call through a function pointer, and flush() with one more per batch, without allocations or virtual calls. Forwarding a batch in one call would mean copying its packets into the handle, which costs more than the calls.
+	 * The encoder pins the current sender for a whole process() call with beginProcess() and endProcess(), so the batch goes to one sender and the handover with the control thread happens once per call instead of for every packet.
+	 * The handle keeps a fixed number of bindings. A replaced sender is retired: it is flushed and, when owned by the handle, destroyed by collect() on the control thread once the audio thread no longer uses it.
+	 */
+	class VBANSenderHandle
+	{
+	public:
+		// Number of senders the handle can hold, the current one and the retired ones waiting to be collected
+		static constexpr int mBindingCount = 4;
+
+		// Default constructor
+		VBANSenderHandle() = default;
+
+		// Destroys the owned senders, the encoder has to be stopped.
+		virtual ~VBANSenderHandle();
+
+		VBANSenderHandle(const VBANSenderHandle&) = delete;
+		VBANSenderHandle& operator=(const VBANSenderHandle&) = delete;
+
+		/**
+		 * Call this method from the control thread to send the packets to a sender owned by the handle from now on.
+		 * @tparam T Sender type, implements sendPacket() and optionally flush(), beginProcess() and endProcess(), see VBANStreamEncoder.
+		 * @param sender The new sender, or nullptr to drop the packets.
+		 * @return False when all bindings are still in use by retired senders, try again after collect().
+		 */
+		template <typename T>
+		bool setSender(std::unique_ptr<T> sender);
+
+		/**
+		 * Call this method from the control thread to send the packets to a sender that is not owned by the handle.
+		 * The sender has to stay alive until isReleased() returns true for it.
+		 * @tparam T Sender type, implements sendPacket() and optionally flush(), beginProcess() and endProcess(), see VBANStreamEncoder.
+		 * @param sender The new sender
+		 * @return False when all bindings are still in use by retired senders, try again after collect().
+		 */
+		template <typename T>
+		bool setSender(T& sender);
+
+		/**
+		 * Call this method from the control thread to flush and release the retired senders the audio thread no longer uses. Owned senders are destroyed.
+		 */
+		void collect();
+
+		/**
+		 * @return Whether a sender that is not owned by the handle has been replaced and collected, so it can be destroyed.
+		 */
+		bool isReleased(const void* sender);
+
+		/**
+		 * Called by the encoder on the audio thread at the start of every process() call, pins the current sender until endProcess() and forwards the call to it when it implements beginProcess().
+		 */
+		void beginProcess();
+
+		/**
+		 * Called by the encoder on the audio thread at the end of every process() call, forwards the call to the pinned sender when it implements endProcess() and releases it so it can be collected when it has been replaced.
+		 */
+		void endProcess();
+
+		/**
+		 * Called by the encoder on the audio thread, forwards the packet to the pinned sender, or to the current one outside of a process() call.
+		 * @param data The vban packet to be sent.
+		 */
+		void sendPacket(const std::vector<char>& data);
+
+		/**
+		 * Called by the encoder on the audio thread after a batch of packets, forwarded to the pinned or current sender when it implements flush().
+		 */
+		void flush();
+
+	private:
+		// A type erased sender
+		struct Binding
+		{
+			void* mObject = nullptr;
+			void (*mSend)(void*, const std::vector<char>&) = nullptr;
+			void (*mFlush)(void*) = nullptr;
+			void (*mBegin)(void*) = nullptr;
+			void (*mEnd)(void*) = nullptr;
+			void (*mDelete)(void*) = nullptr; // Set when the sender is owned by the handle
+			bool mIsRetired = false;
+		};
+
+		/**
+		 * Publishes a binding to a sender and retires the current one.
+		 * @param binding The sender and its functions, mObject is nullptr to drop the packets.
+		 */
+		bool bind(const Binding& binding);
+
+		/**
+		 * @return A binding to a sender of type T, without the delete function.
+		 */
+		template <typename T>
+		static Binding makeBinding(T* sender);
+
+		/**
+		 * Releases the retired bindings that are not in use, called with mMutex locked.
+		 */
+		void collectRetired();
+
+		/**
+		 * Announces which binding the audio thread is using, so the control thread does not release it.
+		 */
+		Binding* acquire();
+
+		/**
+		 * Flushes the sender of a binding when it implements flush()
+		 */
+		template <typename T>
+		static auto flushSender(T& sender, int) -> decltype(sender.flush(), void()) { sender.flush(); }
+		template <typename T>
+		static void flushSender(T&, long) { }
+		template <typename T>
+		static auto beginSender(T& sender, int) -> decltype(sender.beginProcess(), void()) { sender.beginProcess(); }
+		template <typename T>
+		static void beginSender(T&, long) { }
+		template <typename T>
+		static auto endSender(T& sender, int) -> decltype(sender.endProcess(), void()) { sender.endProcess(); }
+		template <typename T>
+		static void endSender(T&, long) { }
+
+		Binding mBindings[mBindingCount];
+		std::atomic<Binding*> mCurrent = { nullptr };
+		std::atomic<Binding*> mReader = { nullptr }; // Binding the audio thread is forwarding to
+		Binding* mPinned = nullptr; // Binding pinned by beginProcess(), audio thread only
+		bool mIsPinned = false;
+		std::mutex mMutex;
+	};
+
+
+	template <typename T>
+	bool VBANSenderHandle::setSender(std::unique_ptr<T> sender)
+	{
+		if (sender == nullptr)
+			return bind(Binding());
+
+		auto binding = makeBinding(sender.get());
+		binding.mDelete = [](void* object) { delete static_cast<T*>(object); };
+		auto result = bind(binding);
+		if (result)
+			sender.release();
+		return result;
+	}
+
+
+	template <typename T>
+	bool VBANSenderHandle::setSender(T& sender)
+	{
+		return bind(makeBinding(&sender));
+	}
+
+
+	template <typename T>
+	VBANSenderHandle::Binding VBANSenderHandle::makeBinding(T* sender)
+	{
+		Binding binding;
+		binding.mObject = sender;
+		binding.mSend = [](void* object, const std::vector<char>& data) { static_cast<T*>(object)->sendPacket(data); };
+		binding.mFlush = [](void* object) { flushSender(*static_cast<T*>(object), 0); };
+		binding.mBegin = [](void* object) { beginSender(*static_cast<T*>(object), 0); };
+		binding.mEnd = [](void* object) { endSender(*static_cast<T*>(object), 0); };
+		return binding;
+	}
+
+}
@@ -0,0 +1,533 @@
+#include "vbanstreamdecoder.h"
+#include "vbanpacketvalidator.h"
+#include "vbanusercodec.h"
+#include "vbanadpcm.h"
+
+#include <cassert>
+#include <cstddef>
+
+namespace vban
+{
+
+	/**
+	 * Copies the samples of the subscribed channels out of an interleaved payload, channel by channel with a fixed stride.
+	 * Subscribed channels without samples in the payload are filled with silence.
+	 * @param sources First sample of every subscribed channel, or nullptr for silence.
+	 */
+	template <int SampleSize>
+	static void gather(const unsigned char* const* sources, int frameSize, char* output, int sampleCount, int outputChannelCount)
+	{
+		auto outputFrameSize = outputChannelCount * SampleSize;
+		for (auto i = 0; i < outputChannelCount; ++i)
+		{
+			auto out = output + i * SampleSize;
+			if (sources[i] == nullptr)
+			{
+				for (auto j = 0; j < sampleCount; ++j)
+					std::memset(out + j * outputFrameSize, 0, SampleSize);
+				continue;
+			}
+
+			auto in = sources[i];
+			for (auto j = 0; j < sampleCount; ++j)
+				std::memcpy(out + j * outputFrameSize, in + j * frameSize, SampleSize);
+		}
+	}
+
+
+	VBANStreamDecoder::VBANStreamDecoder(VBANPacketPool* pool, int slotCount) : mPool(pool), mSlotCount(slotCount)
+	{
+		assert(slotCount > 0 && (slotCount & (slotCount - 1)) == 0);
+		if (mPool == nullptr)
+		{
+			mOwnPool = std::make_unique<VBANPacketPool>();
+			mPool = mOwnPool.get();
+		}
+		mCurrentChannelMap.reserve(VBAN_CHANNELS_MAX_NB);
+		mCurrentSubscription.reserve(VBAN_CHANNELS_MAX_NB);
+		mMdctDecoder.reserve(VBAN_CHANNELS_MAX_NB);
+		mExpandedPacket.reserve(VBAN_HEADER_SIZE + VBAN_CHANNELS_MAX_NB * VBAN_MDCT_FRAME_SIZE * sizeof(float));
+		mReceiveTimes = std::make_unique<std::atomic<int64_t>[]>(slotCount);
+		for (auto i = 0; i < slotCount; ++i)
+			mReceiveTimes[i].store(0);
+	}
+
+
+	VBANStreamDecoder::VBANStreamDecoder(VBANNumaPacketPools& pools, int slotCount) : VBANStreamDecoder(&pools.getPool(0), slotCount)
+	{
+		mNumaPools = &pools;
+	}
+
+
+	VBANStreamDecoder::~VBANStreamDecoder()
+	{
+		if (mSlab.load() != nullptr)
+			mSlab.load()->getPool().release(mSlab.load());
+		for (auto slab : mRetiredSlabs)
+			slab->getPool().release(slab);
+		delete mPreparedResampler.load();
+		delete mRetiredResampler.load();
+	}
+
+
+	bool VBANStreamDecoder::receivePacket(const char* data, int size)
+	{
+		if (size > VBAN_PROTOCOL_MAX_SIZE || !validatePacket(data, size))
+			return false;
+
+		if (mDecryptionKeyDirty.check())
+		{
+			std::lock_guard<std::mutex> lock(mDecryptionKeyLock);
+			mIsEncrypted = !mDecryptionKey.empty();
+			if (mIsEncrypted)
+			{
+				std::memcpy(mCurrentDecryptionKey, mDecryptionKey.data(), VBAN_AEAD_KEY_SIZE);
+				mDecryptBuffer.resize(VBAN_PROTOCOL_MAX_SIZE);
+			}
+			mReplaySession = 0;
+		}
+
+		// Encrypted streams only accept encrypted packets
+		auto isUserCodec = (data[offsetof(VBanHeader, format_bit)] & VBAN_CODEC_MASK) == VBAN_CODEC_USER;
+		if (mIsEncrypted != (isUserCodec && data[VBAN_HEADER_SIZE] == VBAN_USER_CODEC_AEAD))
+			return false;
+
+		auto header = reinterpret_cast<const VBanHeader*>(data);
+		if (mStreamNameDirty.check())
+		{
+			std::lock_guard<std::mutex> lock(mStreamNameLock);
+			std::memset(mNameFilter, 0, VBAN_STREAM_NAME_SIZE);
+			std::memcpy(mNameFilter, mStreamName.c_str(), std::min<size_t>(mStreamName.size(), VBAN_STREAM_NAME_SIZE));
+		}
+		if (mNameFilter[0] != 0 && std::strncmp(mNameFilter, header->streamname, VBAN_STREAM_NAME_SIZE) != 0)
+			return false;
+
+		// When playing, only accept packets within the window of the jitter buffer that have not been played yet.
+		// When not playing the sender might have restarted, so the frame numbers of the last packets are followed.
+		auto frame = header->nuFrame;
+		auto isPlaying = mIsPlaying.load();
+		auto index = frame & (mSlotCount - 1);
+		auto slab = mSlab.load();
+		if (isPlaying && slab != nullptr)
+		{
+			auto distance = static_cast<int32_t>(frame - mReadFrame.load());
+			if (distance < 0 || distance >= mSlotCount)
+				return false;
+			if (slab->getFrame(index).load(std::memory_order_acquire) == frame)
+				return false; // duplicate
+		}
+
+		if (mIsEncrypted)
+		{
+			size = decrypt(data, size);
+			if (size < 0)
+				return false;
+			data = mDecryptBuffer.data();
+		}
+
+		// IMA-ADPCM packets are stored as 16 bit PCM, every packet decodes on its own
+		if (!mIsEncrypted && isUserCodec && data[VBAN_HEADER_SIZE] == VBAN_USER_CODEC_ADPCM)
+		{
+			auto sampleCount = header->format_nbs + 1;
+			auto channelCount = header->format_nbc + 1;
+			size = VBAN_HEADER_SIZE + sampleCount * channelCount * 2;
+			mAdpcmBuffer.resize(std::max<size_t>(mAdpcmBuffer.size(), size));
+			std::memcpy(mAdpcmBuffer.data(), data, VBAN_HEADER_SIZE);
+			reinterpret_cast<VBanHeader*>(mAdpcmBuffer.data())->format_bit = VBAN_BITFMT_16_INT;
+			adpcmDecode(reinterpret_cast<const unsigned char*>(data) + VBAN_ADPCM_PAYLOAD_OFFSET, sampleCount, channelCount, mAdpcmBuffer.data() + VBAN_HEADER_SIZE);
+			data = mAdpcmBuffer.data();
+		}
+
+		if (mSubscriptionDirty.check())
+		{
+			std::lock_guard<std::mutex> lock(mSubscriptionLock);
+			mCurrentSubscription.assign(mSubscription.begin(), mSubscription.end());
+		}
+
+		// With a subscription only the subscribed channels are stored, in the order of the subscription.
+		// Transform coded packets keep the coded channels, so only the subscribed ones are decoded.
+		header = reinterpret_cast<const VBanHeader*>(data);
+		auto codec = header->format_bit & VBAN_CODEC_MASK;
+		auto isSparse = codec == VBAN_CODEC_USER && data[VBAN_HEADER_SIZE] == VBAN_USER_CODEC_SPARSE;
+		auto isMdct = codec == VBAN_CODEC_USER && data[VBAN_HEADER_SIZE] == VBAN_USER_CODEC_MDCT;
+		auto isGathered = !mCurrentSubscription.empty() && (codec == VBAN_CODEC_PCM || isSparse || isMdct);
+		auto bytesPerSample = VBanBitResolutionSize[header->format_bit & VBAN_BIT_RESOLUTION_MASK];
+		auto sampleCount = header->format_nbs + 1;
+		auto subscribedCount = static_cast<int>(mCurrentSubscription.size());
+		auto packetSize = size;
+		if (isGathered && isMdct)
+			packetSize = VBAN_MDCT_PAYLOAD_OFFSET + subscribedCount * getMdctChannelSize(reinterpret_cast<const unsigned char*>(data));
+		else if (isGathered)
+			packetSize = VBAN_HEADER_SIZE + sampleCount * subscribedCount * bytesPerSample;
+
+		// Sparse packets grow with the number of active channels, their memory is sized for all channels at once
+		if (isSparse && !isGathered)
+		{
+			auto channelCount = header->format_nbc + 1;
+			auto maximumSize = VBAN_SPARSE_BITMAP_OFFSET + getSparseBitmapSize(channelCount) + sampleCount * channelCount * bytesPerSample;
+			packetSize = std::max(packetSize, std::min(maximumSize, VBAN_PROTOCOL_MAX_SIZE));
+		}
+
+		prepareResampler(static_cast<int>(VBanSRList[header->format_SR & VBAN_SR_MASK]));
+
+		// Draw memory sized to the packets of the stream when it starts, or when the packets became larger
+		releaseRetiredSlabs();
+		if (slab == nullptr || packetSize > slab->getPacketSize())
+		{
+			// A starting stream draws from the node the network thread runs on now
+			if (slab == nullptr && mNumaPools != nullptr)
+				mPool = &mNumaPools->getLocalPool();
+			auto grown = mPool->acquire(packetSize, mSlotCount);
+
+			// Keep the packets that are buffered already
+			if (slab != nullptr)
+			{
+				for (auto i = 0; i < mSlotCount; ++i)
+				{
+					auto slotFrame = slab->getFrame(i).load(std::memory_order_acquire);
+					if (slotFrame < 0)
+						continue;
+					std::memcpy(grown->getPacket(i), slab->getPacket(i), slab->getPacketSize());
+					grown->getFrame(i).store(slotFrame, std::memory_order_release);
+				}
+			}
+			slab = grown;
+			replaceSlab(slab);
+		}
+		mLastPacketTime = std::chrono::steady_clock::now();
+
+		auto& slotFrame = slab->getFrame(index);
+		auto packet = slab->getPacket(index);
+		slotFrame.store(-1, std::memory_order_release);
+		mReceiveTimes[index].store(std::chrono::duration_cast<std::chrono::nanoseconds>(mLastPacketTime.time_since_epoch()).count(), std::memory_order_relaxed);
+		if (isGathered && isMdct)
+			gatherCodedChannels(data, packet);
+		else if (isGathered)
+		{
+			// The gathered packet is plain PCM, also when the channels come from a sparse packet
+			std::memcpy(packet, data, VBAN_HEADER_SIZE);
+			auto packetHeader = reinterpret_cast<VBanHeader*>(packet);
+			packetHeader->format_nbc = static_cast<uint8_t>(mCurrentSubscription.size() - 1);
+			packetHeader->format_bit &= ~VBAN_CODEC_MASK;
+			gatherChannels(data, packet + VBAN_HEADER_SIZE, sampleCount, bytesPerSample);
+		}
+		else
+			std::memcpy(packet, data, size);
+		slotFrame.store(frame, std::memory_order_release);
+
+		if (!isPlaying || static_cast<int32_t>(frame - mNewestFrame.load()) > 0)
+			mNewestFrame.store(frame);
+		mReceivedCount++;
+
+		return true;
+	}
+
+
+	void VBANStreamDecoder::gatherChannels(const char* packet, char* output, int sampleCount, int bytesPerSample)
+	{
+		const unsigned char* sources[VBAN_CHANNELS_MAX_NB];
+		int frameSize = 0;
+		auto channelCount = static_cast<int>(mCurrentSubscription.size());
+		for (auto i = 0; i < channelCount; ++i)
+		{
+			int channelFrameSize = 0;
+			sources[i] = getChannelData(packet, mCurrentSubscription[i], channelFrameSize);
+			if (sources[i] != nullptr)
+				frameSize = channelFrameSize;
+		}
+
+		// Fixed sample sizes let the compiler turn the copies into single loads and stores
+		switch (bytesPerSample)
+		{
+			case 1: gather<1>(sources, frameSize, output, sampleCount, channelCount); break;
+			case 2: gather<2>(sources, frameSize, output, sampleCount, channelCount); break;
+			case 3: gather<3>(sources, frameSize, output, sampleCount, channelCount); break;
+			case 4: gather<4>(sources, frameSize, output, sampleCount, channelCount); break;
+			case 8: gather<8>(sources, frameSize, output, sampleCount, channelCount); break;
+			default: break;
+		}
+	}
+
+
+	void VBANStreamDecoder::gatherCodedChannels(const char* packet, char* output)
+	{
+		auto data = reinterpret_cast<const unsigned char*>(packet);
+		auto channelCount = reinterpret_cast<const VBanHeader*>(packet)->format_nbc + 1;
+		auto channelSize = getMdctChannelSize(data);
+		std::memcpy(output, packet, VBAN_MDCT_PAYLOAD_OFFSET);
+		reinterpret_cast<VBanHeader*>(output)->format_nbc = static_cast<uint8_t>(mCurrentSubscription.size() - 1);
+
+		// A coded channel of zeros has all bands silent
+		auto coded = output + VBAN_MDCT_PAYLOAD_OFFSET;
+		for (auto channel : mCurrentSubscription)
+		{
+			if (channel >= 0 && channel < channelCount)
+				std::memcpy(coded, packet + VBAN_MDCT_PAYLOAD_OFFSET + channel * channelSize, channelSize);
+			else
+				std::memset(coded, 0, channelSize);
+			coded += channelSize;
+		}
+	}
+
+
+	const unsigned char* VBANStreamDecoder::getChannelData(const char* packet, int channel, int& frameSize)
+	{
+		auto header = reinterpret_cast<const VBanHeader*>(packet);
+		auto channelCount = header->format_nbc + 1;
+		auto bytesPerSample = VBanBitResolutionSize[header->format_bit & VBAN_BIT_RESOLUTION_MASK];
+		auto data = reinterpret_cast<const unsigned char*>(packet);
+		if (channel < 0 || channel >= channelCount)
+			return nullptr;
+
+		// Sparse packets only hold the channels with a bit set in the bitmap
+		if ((header->format_bit & VBAN_CODEC_MASK) == VBAN_CODEC_USER && data[VBAN_HEADER_SIZE] == VBAN_USER_CODEC_SPARSE)
+		{
+			auto bitmap = data + VBAN_SPARSE_BITMAP_OFFSET;
+			auto index = getSparseChannelIndex(bitmap, channelCount, channel);
+			if (index < 0)
+				return nullptr;
+			frameSize = getSparseChannelCount(bitmap, channelCount) * bytesPerSample;
+			return bitmap + getSparseBitmapSize(channelCount) + index * bytesPerSample;
+		}
+
+		frameSize = channelCount * bytesPerSample;
+		return data + VBAN_HEADER_SIZE + channel * bytesPerSample;
+	}
+
+
+	const char* VBANStreamDecoder::expandPacket(const char* packet, uint32_t frame)
+	{
+		auto data = reinterpret_cast<const unsigned char*>(packet);
+		auto header = reinterpret_cast<const VBanHeader*>(packet);
+		if ((header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_USER || data[VBAN_HEADER_SIZE] != VBAN_USER_CODEC_MDCT)
+			return packet;
+		if (mIsExpanded && frame == mExpandedFrame)
+			return mExpandedPacket.data();
+
+		// The overlap only continues from the previous frame
+		auto channelCount = header->format_nbc + 1;
+		if (channelCount != mMdctDecoder.getChannelCount())
+			mMdctDecoder.setChannelCount(channelCount);
+		else if (!mIsExpanded || frame != mExpandedFrame + 1)
+			mMdctDecoder.reset();
+		mExpandedPacket.resize(VBAN_HEADER_SIZE + channelCount * VBAN_MDCT_FRAME_SIZE * sizeof(float));
+		std::memcpy(mExpandedPacket.data(), packet, VBAN_HEADER_SIZE);
+		reinterpret_cast<VBanHeader*>(mExpandedPacket.data())->format_bit = VBAN_BITFMT_32_FLOAT;
+
+		auto channelSize = getMdctChannelSize(data);
+		auto output = reinterpret_cast<float*>(mExpandedPacket.data() + VBAN_HEADER_SIZE);
+		float samples[VBAN_MDCT_FRAME_SIZE];
+		for (auto channel = 0; channel < channelCount; ++channel)
+		{
+			mMdctDecoder.decode(channel, data + VBAN_MDCT_PAYLOAD_OFFSET + channel * channelSize, channelSize, samples);
+			for (auto i = 0; i < VBAN_MDCT_FRAME_SIZE; ++i)
+				output[i * channelCount + channel] = samples[i];
+		}
+		mExpandedFrame = frame;
+		mIsExpanded = true;
+		return mExpandedPacket.data();
+	}
+
+
+	bool VBANStreamDecoder::releaseIfIdle(std::chrono::milliseconds timeout)
+	{
+		releaseRetiredSlabs();
+		if (mSlab.load() == nullptr || std::chrono::steady_clock::now() - mLastPacketTime < timeout)
+			return false;
+		replaceSlab(nullptr);
+		return true;
+	}
+
+
+	void VBANStreamDecoder::replaceSlab(VBANPacketPool::Slab* slab)
+	{
+		auto old = mSlab.exchange(slab);
+		if (old != nullptr)
+			mRetiredSlabs.emplace_back(old);
+		releaseRetiredSlabs();
+	}
+
+
+	void VBANStreamDecoder::prepareResampler(int inputRate)
+	{
+		delete mRetiredResampler.exchange(nullptr);
+
+		// The filter and the buffers for all channels are set up here, the audio thread only sets the number of channels
+		auto outputRate = mOutputSampleRate.load();
+		if (outputRate <= 0 || (inputRate == mPreparedInputRate && outputRate == mPreparedOutputRate))
+			return;
+		auto resampler = std::make_unique<VBANResampler>();
+		resampler->setup(VBAN_CHANNELS_MAX_NB, inputRate, outputRate);
+		delete mPreparedResampler.exchange(resampler.release());
+		mPreparedInputRate = inputRate;
+		mPreparedOutputRate = outputRate;
+	}
+
+
+	void VBANStreamDecoder::measurePlayDelay(int64_t receiveTime, int64_t playTime)
+	{
+		// Both times move on with the played samples, relative to them only the delays of single packets and callbacks remain
+		auto sampleRate = static_cast<int64_t>(VBanSRList[mSampleRateFormat.load()]);
+		auto streamTime = mPlaySampleCount * 1000000000 / sampleRate;
+		auto receiveOffset = receiveTime - streamTime;
+		auto playOffset = playTime - streamTime;
+		if (mPlayDelayCount < 0)
+		{
+			mPreviousReceiveOffset = mReceiveOffset = receiveOffset;
+			mPreviousPlayOffset = mPlayOffset = playOffset;
+			mPlayDelayCount = 0;
+		}
+		mReceiveOffset = std::min(mReceiveOffset, receiveOffset);
+		mPlayOffset = std::min(mPlayOffset, playOffset);
+
+		// The first sample of a packet arrived when the sender had collected the whole packet
+		auto delay = std::min(mPlayOffset, mPreviousPlayOffset) - std::min(mReceiveOffset, mPreviousReceiveOffset);
+		mPlayDelay.store(delay * sampleRate / 1000000000 + mSamplesPerPacket);
+
+		if (++mPlayDelayCount >= mPlayDelayWindow)
+		{
+			mPreviousReceiveOffset = mReceiveOffset;
+			mPreviousPlayOffset = mPlayOffset;
+			mReceiveOffset = receiveOffset;
+			mPlayOffset = playOffset;
+			mPlayDelayCount = 0;
+		}
+	}
+
+
+	void VBANStreamDecoder::releaseRetiredSlabs()
+	{
+		for (size_t i = 0; i < mRetiredSlabs.size();)
+		{
+			if (mRetiredSlabs[i] != mReaderSlab.load())
+			{
+				mRetiredSlabs[i]->getPool().release(mRetiredSlabs[i]);
+				mRetiredSlabs[i] = mRetiredSlabs.back();
+				mRetiredSlabs.pop_back();
+			}
+			else
+				++i;
+		}
+	}
+
+
+	int VBANStreamDecoder::decrypt(const char* data, int size)
+	{
+		auto packet = reinterpret_cast<const uint8_t*>(data);
+		auto frame = reinterpret_cast<const VBanHeader*>(data)->nuFrame;
+		uint64_t session = 0;
+		for (auto i = 0; i < VBAN_AEAD_SESSION_SIZE; ++i)
+			session |= uint64_t(packet[VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE + i]) << (i * 8);
+
+		// Reject packets of older sessions and frames that have been received before
+		if (session < mReplaySession)
+			return -1;
+		auto isNewSession = session > mReplaySession;
+		auto distance = static_cast<int32_t>(mReplayFrame - frame);
+		if (!isNewSession && distance >= 0 && (distance >= 64 || (mReplayWindow >> distance) & 1))
+			return -1;
+
+		// The nonce is the session id followed by the frame number
+		uint8_t nonce[VBAN_AEAD_NONCE_SIZE];
+		std::memcpy(nonce, packet + VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE, VBAN_AEAD_SESSION_SIZE);
+		for (auto i = 0; i < 4; ++i)
+			nonce[VBAN_AEAD_SESSION_SIZE + i] = static_cast<uint8_t>(frame >> (i * 8));
+
+		// Decrypt the payload into a plain PCM packet
+		auto pcmSize = size - VBAN_HEADER_SIZE - VBAN_AEAD_OVERHEAD;
+		auto output = reinterpret_cast<uint8_t*>(mDecryptBuffer.data());
+		std::memcpy(output + VBAN_HEADER_SIZE, packet + VBAN_AEAD_PAYLOAD_OFFSET, pcmSize);
+		if (!aeadDecrypt(mCurrentDecryptionKey, nonce, packet, VBAN_AEAD_PAYLOAD_OFFSET, output + VBAN_HEADER_SIZE, pcmSize, packet + VBAN_AEAD_PAYLOAD_OFFSET + pcmSize))
+			return -1;
+		std::memcpy(output, packet, VBAN_HEADER_SIZE);
+		reinterpret_cast<VBanHeader*>(output)->format_bit &= ~VBAN_CODEC_MASK;
+
+		// Only authentic packets move the replay window
+		if (isNewSession)
+		{
+			mReplaySession = session;
+			mReplayFrame = frame;
+			mReplayWindow = 1;
+		}
+		else if (distance < 0)
+		{
+			mReplayWindow = -distance < 64 ? (mReplayWindow << -distance) | 1 : 1;
+			mReplayFrame = frame;
+		}
+		else
+			mReplayWindow |= uint64_t(1) << distance;
+
+		return VBAN_HEADER_SIZE + pcmSize;
+	}
+
+
+	void VBANStreamDecoder::setDecryptionKey(const std::vector<uint8_t>& key)
+	{
+		assert(key.empty() || key.size() == VBAN_AEAD_KEY_SIZE);
+		std::lock_guard<std::mutex> lock(mDecryptionKeyLock);
+		mDecryptionKey = key;
+		mDecryptionKeyDirty.set();
+	}
+
+
+	void VBANStreamDecoder::setStreamName(const std::string& name)
+	{
+		assert(name.size() <= 16);
+		std::lock_guard<std::mutex> lock(mStreamNameLock);
+		mStreamName = name;
+		mStreamNameDirty.set();
+	}
+
+
+	void VBANStreamDecoder::setChannelMap(const std::vector<int>& channelMap)
+	{
+		assert(channelMap.size() <= VBAN_CHANNELS_MAX_NB);
+		std::lock_guard<std::mutex> lock(mChannelMapLock);
+		mChannelMap = channelMap;
+		mIsDirty.set();
+	}
+
+
+	void VBANStreamDecoder::setSubscribedChannels(const std::vector<int>& channels)
+	{
+		assert(channels.size() <= VBAN_CHANNELS_MAX_NB);
+		std::lock_guard<std::mutex> lock(mSubscriptionLock);
+		mSubscription = channels;
+		mSubscriptionDirty.set();
+	}
+
+
+	void VBANStreamDecoder::setOutputSampleRate(int sampleRate)
+	{
+		assert(sampleRate >= 0);
+		mOutputSampleRate.store(sampleRate);
+	}
+
+
+	void VBANStreamDecoder::setLatency(int packetCount)
+	{
+		assert(packetCount > 0 && packetCount < mSlotCount / 2);
+		mLatency.store(packetCount);
+		mIsDirty.set();
+	}
+
+
+	void VBANStreamDecoder::setTimeout(int packetCount)
+	{
+		assert(packetCount > 0);
+		mTimeout.store(packetCount);
+		mIsDirty.set();
+	}
+
+
+	void VBANStreamDecoder::update()
+	{
+		mCurrentLatency = mLatency.load();
+		mCurrentTimeout = mTimeout.load();
+		{
+			std::lock_guard<std::mutex> lock(mChannelMapLock);
+			mCurrentChannelMap.assign(mChannelMap.begin(), mChannelMap.end());
+		}
+	}
+
+}
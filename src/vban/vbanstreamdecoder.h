@@ -0,0 +1,735 @@
+#pragma once
+
+#include "vban.h"
+#include "vbanaead.h"
+#include "vbanpacketpool.h"
+#include "vbanmdct.h"
+#include "vbanresampler.h"
+#include "dirtyflag.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+
+namespace vban
+{
+
+	/**
+	 * Helper class to decode a VBAN packet stream received through an external protocol into a multichannel audio signal.
+	 * Packets are passed in from the network thread using receivePacket() and stored in a jitter buffer that is indexed by the frame number of the packets, so reordered packets end up in the right place.
+	 * The audio thread pulls the audio out of the jitter buffer using process(). Lost packets are replaced by silence.
+	 * The decoder also watches the stream: when no packets arrive for a number of packet periods, isReceiving() returns false.
+	 * The memory of the jitter buffer is drawn from a VBANPacketPool when the first packet arrives, sized to the packets of the stream, and can be given back when the stream goes idle using releaseIfIdle().
+	 */
+	class VBANStreamDecoder
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param pool Pool the jitter buffer memory is drawn from, shared by many decoders. When nullptr the decoder uses a pool of its own.
+		 * @param slotCount Number of packets the jitter buffer can hold, has to be a power of two.
+		 */
+		explicit VBANStreamDecoder(VBANPacketPool* pool = nullptr, int slotCount = 64);
+
+		/**
+		 * Constructor for multi socket machines. Whenever the stream starts, the jitter buffer memory is drawn from the pool of the node the network thread runs on.
+		 * @param pools Pools of all nodes, shared by many decoders.
+		 * @param slotCount Number of packets the jitter buffer can hold, has to be a power of two.
+		 */
+		explicit VBANStreamDecoder(VBANNumaPacketPools& pools, int slotCount = 64);
+
+		// Destructor, returns the jitter buffer memory to the pool
+		virtual ~VBANStreamDecoder();
+
+		/**
+		 * Call this method from the network thread to pass a received VBAN packet to the decoder.
+		 * @param data Data containing the full VBAN packet including the header.
+		 * @param size Size of the packet in bytes.
+		 * @return True if the packet was accepted, false if it was malformed, belongs to another stream or arrived too late.
+		 */
+		bool receivePacket(const char* data, int size);
+
+		/**
+		 * Call this method from the network thread to return the jitter buffer memory to the pool when no packets came in for a while.
+		 * The memory is drawn again when the stream comes back.
+		 * @param timeout Time without packets after which the stream is considered idle
+		 * @return True if the memory has been released
+		 */
+		bool releaseIfIdle(std::chrono::milliseconds timeout);
+
+		/**
+		 * Call this method from the audio thread to fill the output with decoded samples.
+		 * @tparam T Type for the multichannel audio data. Implements a subscript operator that returns data for a single channel.
+		 * 	Data for a single channel also needs to implement a subscript operator that returns a reference to a floating point sample.
+		 * 	Examples: std::vector<std::vector<float>> or float**
+		 * @param output Multichannel audio data to be filled. Channels that are not present in the stream are filled with silence.
+		 * @param channelCount Number of channels in output.
+		 * @param sampleCount Number of samples to fill in each channel of output.
+		 */
+		template <typename T>
+		void process(T& output, int channelCount, int sampleCount);
+
+		/**
+		 * Call this method from the audio thread to fill an interleaved integer buffer, for example to write directly to a sound device.
+		 * The samples are converted straight from the packet payload to the requested sample type, without an intermediate floating point buffer.
+		 * @tparam SampleType int16_t or int32_t
+		 * @param output Interleaved audio data to be filled, holding channelCount * sampleCount samples.
+		 * @param channelCount Number of interleaved channels in output.
+		 * @param sampleCount Number of samples to fill for each channel.
+		 */
+		template <typename SampleType>
+		void processInterleaved(SampleType* output, int channelCount, int sampleCount);
+
+		/**
+		 * Sets which channel of the stream is decoded into each output channel.
+		 * @param channelMap For each output channel the index of the stream channel, or -1 for silence. Output channels beyond the size of the map take the stream channel with the same index.
+		 */
+		void setChannelMap(const std::vector<int>& channelMap);
+
+		/**
+		 * Subscribes to a subset of the channels of the stream, for example to listen to 2 channels of a 64 channel stream.
+		 * Only the subscribed channels are extracted from the packets and stored in the jitter buffer, so the cost of receiving and decoding scales with the number of subscribed channels.
+		 * The decoded stream then consists of the subscribed channels in the order of the subscription, the channel map and getChannelCount() refer to these.
+		 * @param channels Indices of the channels in the stream, or an empty vector to decode all channels.
+		 */
+		void setSubscribedChannels(const std::vector<int>& channels);
+
+		/**
+		 * Converts the stream to the sample rate of the output device, so a 44.1 kHz stream can be played on a 48 kHz device without an external resampler.
+		 * The conversion happens in the output stage of process() and processInterleaved() and adds VBANResampler::mHalfLength samples of latency at the stream rate.
+		 * The resampler is prepared on the network thread with the first packet after the rate of the stream or of the output changed, and handed over to the audio thread, which does not allocate. Until it is ready the stream is played without conversion.
+		 * @param sampleRate Sample rate of the output in Hz, or 0 to output at the rate of the stream.
+		 */
+		void setOutputSampleRate(int sampleRate);
+
+		/**
+		 * Sets a fine correction of the conversion ratio, applied in the same filter pass as the sample rate conversion.
+		 * Can be called continuously, for example by a controller that keeps the jitter buffer level constant to follow the clock of the sender.
+		 * Once a correction has been applied the resampler stays in the signal path, also when the drift returns to 1, so the output does not jump between the two paths.
+		 * @param drift Factor on the speed at which the stream is played, 1 for none, limited to 1 +/- VBANResampler::mMaxDrift.
+		 */
+		void setDriftCorrection(double drift) { mDrift.store(drift); }
+
+		/**
+		 * Sets the name of the stream this decoder listens to. Packets of other streams are ignored.
+		 * @param name Has to be equal or smaller than 16 characters. An empty name accepts packets of any stream.
+		 */
+		void setStreamName(const std::string& name);
+
+		/**
+		 * Sets the key to decrypt streams that are encrypted with VBANStreamEncoder::setEncryptionKey().
+		 * With a key set, only encrypted packets with a valid authentication tag are accepted and replayed packets are rejected.
+		 * @param key Key of VBAN_AEAD_KEY_SIZE bytes, or an empty vector to accept unencrypted packets.
+		 */
+		void setDecryptionKey(const std::vector<uint8_t>& key);
+
+		/**
+		 * Sets the number of packets that are buffered before playback starts.
+		 * Higher values make the stream more robust against network jitter at the cost of latency.
+		 * @param packetCount Number of packets, has to be smaller than half the jitter buffer capacity.
+		 */
+		void setLatency(int packetCount);
+
+		/**
+		 * Sets after how many packet periods without incoming packets the stream is considered to be down.
+		 * @param packetCount Number of packet periods
+		 */
+		void setTimeout(int packetCount);
+
+		/**
+		 * @return Whether the decoder is playing a stream and packets are still coming in within the timeout.
+		 */
+		bool isReceiving() const { return mIsReceiving.load(); }
+
+		/**
+		 * @return Number of channels in the last packet that has been played.
+		 */
+		int getChannelCount() const { return mChannelCount.load(); }
+
+		/**
+		 * @return Index to VBanSRList of the last packet that has been played.
+		 */
+		int getSampleRateFormat() const { return mSampleRateFormat.load(); }
+
+		/**
+		 * @return Number of packets that did not arrive in time and have been replaced by silence.
+		 */
+		int getLostPacketCount() const { return mLostPacketCount.load(); }
+
+		/**
+		 * @return Number of times the jitter buffer ran empty and had to be refilled.
+		 */
+		int getUnderrunCount() const { return mUnderrunCount.load(); }
+
+		/**
+		 * Call this method from the audio thread to find out which part of the stream is being played.
+		 * The position counts samples from the first packet the sender sent, as frame number times the number of samples per packet, so it assumes packets of a fixed size.
+		 * @return Position in the stream of the next sample process() will play, or -1 when not playing.
+		 */
+		int64_t getPlayPosition() const { return mIsPlaying.load() ? static_cast<int64_t>(mReadFrame.load()) * mSamplesPerPacket + mReadPosition : -1; }
+
+		/**
+		 * Can be called from any thread to find out how long the samples stay in the decoder, measured on the clock of the receiver.
+		 * For every packet played, its arrival time and the time its first sample is played are compared to its position in the samples played since playback started.
+		 * The earliest arrival and the earliest playback relative to that position are taken, so packets delayed by the network and late audio callbacks do not count. Their difference, plus the duration of a packet for the time the sender spent collecting it, is the play delay.
+		 * Frame numbers are not used, so the measurement does not depend on where the sender started counting. It starts over whenever playback starts.
+		 * @return Time from the arrival of a sample to its playback, in samples at the rate of the stream, or -1 when not playing.
+		 */
+		int64_t getPlayDelay() const { return mPlayDelay.load(); }
+
+		/**
+		 * Can be called from any thread, for example by VBANNackGenerator on the network thread to find out which lost packets can still be played.
+		 * @return Frame number of the packet being played, or -1 when not playing.
+		 */
+		int64_t getReadFrame() const { return mIsPlaying.load() ? static_cast<int64_t>(mReadFrame.load()) : -1; }
+
+		/**
+		 * @return Whether the decoder currently holds jitter buffer memory from the pool.
+		 */
+		bool hasBuffer() const { return mSlab.load() != nullptr; }
+
+	private:
+		/**
+		 * Replaces the jitter buffer memory, the old memory is returned to the pool once the audio thread stopped using it.
+		 */
+		void replaceSlab(VBANPacketPool::Slab* slab);
+
+		/**
+		 * Copies the samples of the subscribed channels from a PCM or sparse packet into the payload of the packet in the jitter buffer.
+		 */
+		void gatherChannels(const char* packet, char* output, int sampleCount, int bytesPerSample);
+
+		/**
+		 * Copies the coded frames of the subscribed channels from a transform coded packet into the packet in the jitter buffer, which stays transform coded.
+		 */
+		void gatherCodedChannels(const char* packet, char* output);
+
+		/**
+		 * Finds the samples of a stream channel in a PCM or sparse packet.
+		 * @param frameSize Receives the distance in bytes between two samples of the channel
+		 * @return The first sample of the channel, or nullptr when the channel is silent or not in the stream.
+		 */
+		static const unsigned char* getChannelData(const char* packet, int channel, int& frameSize);
+
+		/**
+		 * Returns replaced memory to the pool that is no longer used by the audio thread.
+		 */
+		void releaseRetiredSlabs();
+
+		/**
+		 * Prepares a resampler for the rates of the stream and the output when they changed, for the audio thread to take over. Frees the resampler the audio thread gave back. Network thread only.
+		 * @param inputRate Sample rate of the stream
+		 */
+		void prepareResampler(int inputRate);
+
+		/**
+		 * Updates the play delay with a packet that starts playing, see getPlayDelay().
+		 * @param receiveTime Arrival time of the packet in nanoseconds
+		 * @param playTime Time the first sample of the packet is played in nanoseconds
+		 */
+		void measurePlayDelay(int64_t receiveTime, int64_t playTime);
+
+		/**
+		 * Authenticates and decrypts an encrypted packet into mDecryptBuffer as a plain PCM packet.
+		 * @return Size of the decrypted packet, or -1 when the packet is not authentic or has been replayed.
+		 */
+		int decrypt(const char* data, int size);
+
+		/**
+		 * Decodes a transform coded packet into a 32 bit float PCM packet on the audio thread, where the frames come in order for the overlap of the transform.
+		 * A frame is decoded once, also when it is read in parts. Memory is allocated when the first coded packet is played or the channel count changes.
+		 * @return The decoded packet, or the packet itself when it is not transform coded.
+		 */
+		const char* expandPacket(const char* packet, uint32_t frame);
+
+		/**
+		 * Updates the internal state of the audio thread from the current settings
+		 */
+		void update();
+
+		/**
+		 * Reads sampleCount samples at the rate of the output, through the resampler when the output rate or drift correction ask for it.
+		 * @param write Called with the channel, the position and the value of every resampled sample
+		 */
+		template <typename DecodeFunction, typename ClearFunction, typename WriteFunction>
+		void readResampled(int channelCount, int sampleCount, DecodeFunction decode, ClearFunction clear, WriteFunction write);
+
+		/**
+		 * Reads sampleCount samples from the jitter buffer.
+		 * @param decode Called with the packet, the offset and number of samples within the packet and the position in the output to decode into.
+		 * @param clear Called with the position and number of samples in the output to fill with silence.
+		 */
+		template <typename DecodeFunction, typename ClearFunction>
+		void read(int sampleCount, DecodeFunction decode, ClearFunction clear);
+
+		/**
+		 * Converts count samples starting at offset from the payload of a packet into output starting at outputOffset.
+		 */
+		template <typename T>
+		void decode(const char* packet, int offset, int count, T& output, int outputOffset, int channelCount);
+
+		/**
+		 * Converts count samples starting at offset from the payload of a packet into an interleaved integer buffer.
+		 */
+		template <typename SampleType>
+		void decodeInterleaved(const char* packet, int offset, int count, SampleType* output, int channelCount);
+
+		/**
+		 * Fills count samples of output starting at outputOffset with silence.
+		 */
+		template <typename T>
+		void clear(T& output, int outputOffset, int count, int channelCount);
+
+		/**
+		 * @return The stream channel that is decoded into the given output channel, or -1 for silence.
+		 */
+		int getSourceChannel(int channel) const { return channel < static_cast<int>(mCurrentChannelMap.size()) ? mCurrentChannelMap[channel] : channel; }
+
+		// Settings
+		std::atomic<int> mLatency = { 3 }; // Number of packets buffered before playback starts
+		std::atomic<int> mTimeout = { 2 }; // Number of packet periods without packets before the stream is considered down
+		std::atomic<int> mOutputSampleRate = { 0 };
+		std::atomic<double> mDrift = { 1.0 };
+		DirtyFlag mIsDirty;
+		std::string mStreamName;
+		std::mutex mStreamNameLock;
+		DirtyFlag mStreamNameDirty;
+		std::vector<int> mChannelMap;
+		std::mutex mChannelMapLock;
+		std::vector<int> mSubscription;
+		std::mutex mSubscriptionLock;
+		DirtyFlag mSubscriptionDirty;
+		std::vector<uint8_t> mDecryptionKey;
+		std::mutex mDecryptionKeyLock;
+		DirtyFlag mDecryptionKeyDirty;
+
+		// Jitter buffer, shared between the network and the audio thread
+		std::unique_ptr<VBANPacketPool> mOwnPool; // Used when no pool is passed to the constructor
+		VBANPacketPool* mPool; // Pool new memory is drawn from, memory is returned to the pool of its slab
+		VBANNumaPacketPools* mNumaPools = nullptr; // When set, mPool is the pool of the network thread's node
+		const int mSlotCount; // Number of packets the jitter buffer can hold. Power of two so the frame number can be masked into a slot index.
+		std::atomic<VBANPacketPool::Slab*> mSlab = { nullptr }; // Memory of the jitter buffer, replaced by the network thread only
+		std::atomic<VBANPacketPool::Slab*> mReaderSlab = { nullptr }; // Memory the audio thread is reading from, can not be released
+		std::atomic<uint32_t> mNewestFrame = { 0 }; // Highest frame number received
+		std::atomic<uint32_t> mReceivedCount = { 0 }; // Number of packets accepted
+		std::atomic<uint32_t> mReadFrame = { 0 }; // Frame number currently being played
+		std::atomic<bool> mIsPlaying = { false }; // Whether the audio thread is reading from the jitter buffer
+		std::unique_ptr<std::atomic<int64_t>[]> mReceiveTimes; // Arrival time in nanoseconds of the packet in every slot
+		std::atomic<VBANResampler*> mPreparedResampler = { nullptr }; // Set up by the network thread, taken over by the audio thread
+		std::atomic<VBANResampler*> mRetiredResampler = { nullptr }; // Replaced by the audio thread, freed by the network thread
+
+		// Network thread state
+		char mNameFilter[VBAN_STREAM_NAME_SIZE] = { };
+		bool mIsEncrypted = false;
+		uint8_t mCurrentDecryptionKey[VBAN_AEAD_KEY_SIZE] = { };
+		std::vector<int> mCurrentSubscription; // Reserved to VBAN_CHANNELS_MAX_NB so updating does not allocate
+		std::vector<char> mDecryptBuffer; // Holds a decrypted packet before it is copied into the jitter buffer
+		std::vector<char> mAdpcmBuffer; // Holds a decoded IMA-ADPCM packet before it is copied into the jitter buffer
+		int mPreparedInputRate = 0; // Rates of the last resampler that was prepared
+		int mPreparedOutputRate = 0;
+		uint64_t mReplaySession = 0; // Newest encryption session of the sender
+		uint32_t mReplayFrame = 0; // Highest frame number received in the session
+		uint64_t mReplayWindow = 0; // Bit n is set when frame mReplayFrame - n has been received
+		std::vector<VBANPacketPool::Slab*> mRetiredSlabs; // Replaced memory that may still be read by the audio thread
+		std::chrono::steady_clock::time_point mLastPacketTime;
+
+		// Audio thread state
+		int mCurrentLatency = 3;
+		int mCurrentTimeout = 2;
+		std::vector<int> mCurrentChannelMap; // Reserved to VBAN_CHANNELS_MAX_NB so updating does not allocate
+		int mReadPosition = 0; // Read position within the current packet in samples
+
+		// Play delay, the earliest arrival and playback are the minimum over the current and the previous window
+		static constexpr int mPlayDelayWindow = 512; // Number of packets in a window
+		int64_t mPlaySampleCount = 0; // Number of samples played since playback started
+		int64_t mReceiveOffset = 0; // Earliest arrival in the current window, relative to the played samples
+		int64_t mPreviousReceiveOffset = 0;
+		int64_t mPlayOffset = 0; // Earliest playback in the current window, relative to the played samples
+		int64_t mPreviousPlayOffset = 0;
+		int mPlayDelayCount = 0; // Number of packets measured in the current window, -1 before the first one
+		std::atomic<int64_t> mPlayDelay = { -1 };
+		int mSamplesPerPacket = VBAN_SAMPLES_MAX_NB; // Number of samples in the last packet that has been played
+		uint32_t mIdleReceivedCount = 0; // Value of mReceivedCount when the jitter buffer started filling
+		uint32_t mLastReceivedCount = 0; // Value of mReceivedCount at the last process() call
+		int mSamplesWithoutPackets = 0; // Number of samples processed since the last packet came in
+		VBANMdctDecoder mMdctDecoder;
+		std::vector<char> mExpandedPacket; // Transform coded packet decoded into 32 bit float PCM
+		uint32_t mExpandedFrame = 0; // Frame number of mExpandedPacket
+		bool mIsExpanded = false; // Whether mExpandedPacket holds a frame
+		std::unique_ptr<VBANResampler> mResampler;
+		bool mIsResampling = false; // Whether the output goes through the resampler, kept until the output rate is reset
+		float* mResamplerInputs[VBAN_CHANNELS_MAX_NB] = { }; // Input buffers of the resampler for every output channel
+
+		// Statistics
+		std::atomic<bool> mIsReceiving = { false };
+		std::atomic<int> mChannelCount = { 0 };
+		std::atomic<int> mSampleRateFormat = { 0 };
+		std::atomic<int> mLostPacketCount = { 0 };
+		std::atomic<int> mUnderrunCount = { 0 };
+	};
+
+
+	template <typename T>
+	void VBANStreamDecoder::process(T& output, int channelCount, int sampleCount)
+	{
+		readResampled(channelCount, sampleCount,
+			[&](const char* packet, int offset, int count, int position) { decode(packet, offset, count, output, position, channelCount); },
+			[&](int position, int count) { clear(output, position, count, channelCount); },
+			[&](int channel, int position, float value) { output[channel][position] = value; });
+	}
+
+
+	template <typename SampleType>
+	void VBANStreamDecoder::processInterleaved(SampleType* output, int channelCount, int sampleCount)
+	{
+		static_assert(std::is_same<SampleType, int16_t>::value || std::is_same<SampleType, int32_t>::value, "Only 16 and 32 bit integer output is supported");
+		constexpr int shift = 32 - 8 * sizeof(SampleType);
+		readResampled(channelCount, sampleCount,
+			[&](const char* packet, int offset, int count, int position) { decodeInterleaved(packet, offset, count, output + position * channelCount, channelCount); },
+			[&](int position, int count) { std::memset(output + position * channelCount, 0, count * channelCount * sizeof(SampleType)); },
+			[&](int channel, int position, float value)
+			{
+				value = std::max(-1.f, std::min(value, 1.f));
+				output[position * channelCount + channel] = static_cast<int32_t>(static_cast<double>(value) * std::numeric_limits<int32_t>::max()) >> shift;
+			});
+	}
+
+
+	template <typename DecodeFunction, typename ClearFunction, typename WriteFunction>
+	void VBANStreamDecoder::readResampled(int channelCount, int sampleCount, DecodeFunction decode, ClearFunction clear, WriteFunction write)
+	{
+		// The rate of the stream is known once packets have been played
+		auto outputRate = mOutputSampleRate.load();
+		auto drift = mDrift.load();
+		auto inputRate = mChannelCount.load() > 0 ? static_cast<int>(VBanSRList[mSampleRateFormat.load()]) : outputRate;
+		if (outputRate <= 0 || channelCount <= 0 || (!mIsResampling && inputRate == outputRate && drift == 1.0))
+		{
+			mIsResampling = false;
+			read(sampleCount, decode, clear);
+			return;
+		}
+
+		// Take over the resampler the network thread prepared, the previous one goes back to it to be freed
+		if (mRetiredResampler.load() == nullptr)
+		{
+			auto prepared = mPreparedResampler.exchange(nullptr);
+			if (prepared != nullptr)
+			{
+				mRetiredResampler.store(mResampler.release());
+				mResampler.reset(prepared);
+			}
+		}
+		if (mResampler == nullptr || !mResampler->isSetUp(inputRate, outputRate))
+		{
+			mIsResampling = false;
+			read(sampleCount, decode, clear);
+			return;
+		}
+
+		// Switching over to the resampler starts it with a clear history, it then stays engaged
+		if (channelCount != mResampler->getChannelCount())
+		{
+			mResampler->setChannelCount(channelCount);
+			for (auto channel = 0; channel < channelCount; ++channel)
+				mResamplerInputs[channel] = mResampler->getInput(channel);
+		}
+		else if (!mIsResampling)
+			mResampler->reset();
+		mIsResampling = true;
+		mResampler->setDrift(drift);
+
+		// The stream is decoded into the input of the resampler, which writes the output
+		auto inputs = mResamplerInputs;
+		for (auto position = 0; position < sampleCount; position += VBANResampler::mMaxOutputCount)
+		{
+			auto count = std::min(sampleCount - position, VBANResampler::mMaxOutputCount);
+			auto inputCount = mResampler->getInputCount(count);
+			read(inputCount,
+				[&](const char* packet, int offset, int count, int inputPosition) { this->decode(packet, offset, count, inputs, inputPosition, channelCount); },
+				[&](int inputPosition, int count) { this->clear(inputs, inputPosition, count, channelCount); });
+			mResampler->process(inputCount, count, [&](int channel, int index, float value) { write(channel, position + index, value); });
+		}
+	}
+
+
+	template <typename DecodeFunction, typename ClearFunction>
+	void VBANStreamDecoder::read(int sampleCount, DecodeFunction decode, ClearFunction clear)
+	{
+		if (mIsDirty.check())
+			update();
+		auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		// Announce which memory is being read, so the network thread does not return it to the pool while reading
+		auto slab = mSlab.load();
+		while (true)
+		{
+			mReaderSlab.store(slab);
+			auto current = mSlab.load();
+			if (current == slab)
+				break;
+			slab = current;
+		}
+
+		int position = 0;
+		while (position < sampleCount)
+		{
+			if (slab == nullptr)
+			{
+				// No memory, the stream has not started yet or has been released
+				if (mIsPlaying.load())
+				{
+					mIsPlaying.store(false);
+					mPlayDelay.store(-1);
+					mIdleReceivedCount = mReceivedCount.load();
+				}
+				clear(position, sampleCount - position);
+				break;
+			}
+
+			if (!mIsPlaying.load())
+			{
+				// Wait until enough packets are buffered, then start playing mCurrentLatency packets behind the newest one
+				if (mReceivedCount.load() - mIdleReceivedCount < static_cast<uint32_t>(mCurrentLatency))
+				{
+					clear(position, sampleCount - position);
+					break;
+				}
+				mReadFrame.store(mNewestFrame.load() - mCurrentLatency + 1);
+				mReadPosition = 0;
+				mPlaySampleCount = 0;
+				mPlayDelayCount = -1;
+				mIsPlaying.store(true);
+			}
+
+			auto frame = mReadFrame.load();
+			auto index = frame & (mSlotCount - 1);
+			const char* packet = slab->getPacket(index);
+			if (slab->getFrame(index).load(std::memory_order_acquire) == frame)
+			{
+				auto header = reinterpret_cast<const VBanHeader*>(packet);
+				mSamplesPerPacket = header->format_nbs + 1;
+				mChannelCount.store(header->format_nbc + 1);
+				mSampleRateFormat.store(header->format_SR & VBAN_SR_MASK);
+				packet = expandPacket(packet, frame);
+				if (mReadPosition == 0)
+					measurePlayDelay(mReceiveTimes[index].load(std::memory_order_relaxed), now + position * 1000000000ll / VBanSRList[mSampleRateFormat.load()]);
+
+				auto count = std::min(mSamplesPerPacket - mReadPosition, sampleCount - position);
+				decode(packet, mReadPosition, count, position);
+				mReadPosition += count;
+				mPlaySampleCount += count;
+				position += count;
+			}
+			else if (static_cast<int32_t>(mNewestFrame.load() - frame) > 0)
+			{
+				// Newer packets have arrived, so this one is lost
+				auto count = std::min(mSamplesPerPacket - mReadPosition, sampleCount - position);
+				clear(position, count);
+				if (mReadPosition == 0)
+					mLostPacketCount++;
+				mReadPosition += count;
+				mPlaySampleCount += count;
+				position += count;
+			}
+			else {
+				// The jitter buffer ran empty, wait for it to fill up again
+				mIsPlaying.store(false);
+				mPlayDelay.store(-1);
+				mIdleReceivedCount = mReceivedCount.load();
+				mUnderrunCount++;
+				clear(position, sampleCount - position);
+				break;
+			}
+
+			if (mReadPosition >= mSamplesPerPacket)
+			{
+				mReadPosition = 0;
+				mReadFrame.store(frame + 1);
+			}
+		}
+
+		// Watchdog
+		auto receivedCount = mReceivedCount.load();
+		if (receivedCount != mLastReceivedCount)
+		{
+			mLastReceivedCount = receivedCount;
+			mSamplesWithoutPackets = 0;
+		}
+		else if (mSamplesWithoutPackets < mCurrentTimeout * mSamplesPerPacket)
+			mSamplesWithoutPackets += sampleCount;
+		mIsReceiving.store(mIsPlaying.load() && mSamplesWithoutPackets < mCurrentTimeout * mSamplesPerPacket);
+
+		mReaderSlab.store(nullptr);
+	}
+
+
+	template <typename T>
+	void VBANStreamDecoder::decode(const char* packet, int offset, int count, T& output, int outputOffset, int channelCount)
+	{
+		auto header = reinterpret_cast<const VBanHeader*>(packet);
+		auto bitFormat = header->format_bit & VBAN_BIT_RESOLUTION_MASK;
+
+		for (auto channel = 0; channel < channelCount; ++channel)
+		{
+			auto& out = output[channel];
+			int frameSize = 0;
+			auto data = getChannelData(packet, getSourceChannel(channel), frameSize);
+			if (data == nullptr)
+			{
+				for (auto i = 0; i < count; ++i)
+					out[outputOffset + i] = 0.f;
+				continue;
+			}
+
+			data += offset * frameSize;
+			switch (bitFormat)
+			{
+				case VBAN_BITFMT_8_INT:
+					for (auto i = 0; i < count; ++i)
+						out[outputOffset + i] = static_cast<int8_t>(data[i * frameSize]) / static_cast<float>(std::numeric_limits<int8_t>::max());
+					break;
+				case VBAN_BITFMT_16_INT:
+					for (auto i = 0; i < count; ++i)
+					{
+						auto d = data + i * frameSize;
+						auto value = static_cast<int16_t>(d[0] | (d[1] << 8));
+						out[outputOffset + i] = value / static_cast<float>(std::numeric_limits<int16_t>::max());
+					}
+					break;
+				case VBAN_BITFMT_24_INT:
+					for (auto i = 0; i < count; ++i)
+					{
+						// assemble the three bytes in the upper part of a 32 bit int to keep the sign
+						auto d = data + i * frameSize;
+						auto value = static_cast<int32_t>((uint32_t(d[0]) << 8) | (uint32_t(d[1]) << 16) | (uint32_t(d[2]) << 24));
+						out[outputOffset + i] = value / static_cast<float>(std::numeric_limits<int32_t>::max());
+					}
+					break;
+				case VBAN_BITFMT_32_INT:
+					for (auto i = 0; i < count; ++i)
+					{
+						auto d = data + i * frameSize;
+						auto value = static_cast<int32_t>(uint32_t(d[0]) | (uint32_t(d[1]) << 8) | (uint32_t(d[2]) << 16) | (uint32_t(d[3]) << 24));
+						out[outputOffset + i] = value / static_cast<float>(std::numeric_limits<int32_t>::max());
+					}
+					break;
+				case VBAN_BITFMT_32_FLOAT:
+					for (auto i = 0; i < count; ++i)
+					{
+						float value;
+						std::memcpy(&value, data + i * frameSize, sizeof(float));
+						out[outputOffset + i] = value;
+					}
+					break;
+				case VBAN_BITFMT_64_FLOAT:
+					for (auto i = 0; i < count; ++i)
+					{
+						double value;
+						std::memcpy(&value, data + i * frameSize, sizeof(double));
+						out[outputOffset + i] = static_cast<float>(value);
+					}
+					break;
+				default:
+					for (auto i = 0; i < count; ++i)
+						out[outputOffset + i] = 0.f;
+					break;
+			}
+		}
+	}
+
+
+	template <typename SampleType>
+	void VBANStreamDecoder::decodeInterleaved(const char* packet, int offset, int count, SampleType* output, int channelCount)
+	{
+		// Samples are first brought to a left aligned 32 bit integer and then shifted down to the size of SampleType
+		constexpr int shift = 32 - 8 * sizeof(SampleType);
+
+		auto header = reinterpret_cast<const VBanHeader*>(packet);
+		auto bitFormat = header->format_bit & VBAN_BIT_RESOLUTION_MASK;
+
+		for (auto channel = 0; channel < channelCount; ++channel)
+		{
+			auto out = output + channel;
+			int frameSize = 0;
+			auto data = getChannelData(packet, getSourceChannel(channel), frameSize);
+			if (data == nullptr)
+			{
+				for (auto i = 0; i < count; ++i)
+					out[i * channelCount] = 0;
+				continue;
+			}
+
+			data += offset * frameSize;
+			switch (bitFormat)
+			{
+				case VBAN_BITFMT_8_INT:
+					for (auto i = 0; i < count; ++i)
+						out[i * channelCount] = static_cast<int32_t>(uint32_t(data[i * frameSize]) << 24) >> shift;
+					break;
+				case VBAN_BITFMT_16_INT:
+					for (auto i = 0; i < count; ++i)
+					{
+						auto d = data + i * frameSize;
+						out[i * channelCount] = static_cast<int32_t>((uint32_t(d[0]) << 16) | (uint32_t(d[1]) << 24)) >> shift;
+					}
+					break;
+				case VBAN_BITFMT_24_INT:
+					for (auto i = 0; i < count; ++i)
+					{
+						auto d = data + i * frameSize;
+						out[i * channelCount] = static_cast<int32_t>((uint32_t(d[0]) << 8) | (uint32_t(d[1]) << 16) | (uint32_t(d[2]) << 24)) >> shift;
+					}
+					break;
+				case VBAN_BITFMT_32_INT:
+					for (auto i = 0; i < count; ++i)
+					{
+						auto d = data + i * frameSize;
+						out[i * channelCount] = static_cast<int32_t>(uint32_t(d[0]) | (uint32_t(d[1]) << 8) | (uint32_t(d[2]) << 16) | (uint32_t(d[3]) << 24)) >> shift;
+					}
+					break;
+				case VBAN_BITFMT_32_FLOAT:
+				case VBAN_BITFMT_64_FLOAT:
+					for (auto i = 0; i < count; ++i)
+					{
+						double value;
+						if (bitFormat == VBAN_BITFMT_32_FLOAT)
+						{
+							float floatValue;
+							std::memcpy(&floatValue, data + i * frameSize, sizeof(float));
+							value = floatValue;
+						}
+						else
+							std::memcpy(&value, data + i * frameSize, sizeof(double));
+						value = std::max(-1.0, std::min(value, 1.0));
+						out[i * channelCount] = static_cast<int32_t>(value * std::numeric_limits<int32_t>::max()) >> shift;
+					}
+					break;
+				default:
+					for (auto i = 0; i < count; ++i)
+						out[i * channelCount] = 0;
+					break;
+			}
+		}
+	}
+
+
+	template <typename T>
+	void VBANStreamDecoder::clear(T& output, int outputOffset, int count, int channelCount)
+	{
+		for (auto channel = 0; channel < channelCount; ++channel)
+		{
+			auto& out = output[channel];
+			for (auto i = 0; i < count; ++i)
+				out[outputOffset + i] = 0.f;
+		}
+	}
+
+}
@@ -1,4 +1,10 @@
+#pragma once
+
 #include "vban.h"
+#include "vbanaead.h"
+#include "vbanusercodec.h"
+#include "vbanmdct.h"
+#include "vbanadpcm.h"
 #include "dirtyflag.h"
 
 #include <functional>
@@ -7,6 +13,9 @@
 #include <mutex>
 #include <vector>
 #include <cstring>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
 
 namespace vban
 {
@@ -17,6 +26,9 @@ namespace vban
 	 * 	The SenderType has to implement the sendPacket() method with the following signature:
 	 * 	SenderType::sendPacket(const std::vector<char>& data);
 	 * 	With data containing the vban packet to be sent.
+	 * 	When the SenderType also implements flush(), it is called after every process() call that sent packets, so the sender can send them in one batch.
+	 * 	When the SenderType also implements beginProcess(), it is called at the start of every process() call, so the sender can time the encoding, see VBANLatencyProbe.
+	 * 	When the SenderType also implements endProcess(), it is called at the end of every process() call, after flush(), see VBANSenderHandle.
 	 */
 	template <typename SenderType>
 	class VBANStreamEncoder
@@ -26,7 +38,7 @@ namespace vban
 		 * Constructor
 		 * @param sender This object's sendPacket() method will be called by the encoder to send VBAN packets.
 		 */
-		explicit VBANStreamEncoder(SenderType& sender) : mSender(sender) { }
+		explicit VBANStreamEncoder(SenderType& sender) : mSender(sender) { mVbanBuffer.reserve(VBAN_PROTOCOL_MAX_SIZE); }
 
 		// Default destructor
 		virtual ~VBANStreamEncoder() = default;
@@ -58,7 +70,8 @@ namespace vban
 
 		/**
 		 * Sets the bit depth of the audio data, or the number of bits per sample.
-		 * At the moment only 16 and 32 bit audio is supported. Other values result in a runtime error.
+		 * At the moment 8, 16 and 32 bit audio is supported. Other values result in a runtime error.
+		 * 8 bit audio is dithered with triangular noise of one step, to fit many talkback channels in a packet.
 		 * @param bitDepth The desired number of bits per sample
 		 */
 		void setBitDepth(int bitDepth);
@@ -75,6 +88,71 @@ namespace vban
 		 */
 		void setStreamName(const std::string& name);
 
+		/**
+		 * Enables authenticated encryption of the packets with ChaCha20-Poly1305, using the VBAN_CODEC_USER codec slot.
+		 * Receivers need the same key to decode the stream and reject packets that were tampered with or replayed.
+		 * @param key Key of VBAN_AEAD_KEY_SIZE bytes, or an empty vector to send unencrypted packets.
+		 */
+		void setEncryptionKey(const std::vector<uint8_t>& key);
+
+		/**
+		 * Enables a soft clipper instead of the hard clamp at full scale.
+		 * Samples above the threshold are bent smoothly towards full scale instead of being cut off, in the same pass that converts them to integers.
+		 * @param value True to soft clip, false to hard clamp
+		 */
+		void setSoftClip(bool value);
+
+		/**
+		 * Sets the level above which the soft clipper starts to reduce the gain.
+		 * @param threshold Linear level between 0 and 1
+		 */
+		void setSoftClipThreshold(float threshold);
+
+		/**
+		 * Enables sparse packets, which only carry the channels that have signal, using the VBAN_CODEC_USER codec slot.
+		 * A channel is active while its level is above the threshold and for the hold time afterwards. Each packet carries a bitmap of the channels it contains, receivers fill in silence for the others.
+		 * With fewer channels per packet more samples fit in a packet, so both the bandwidth and the number of packets go down with the number of active channels.
+		 * Not used when encryption is enabled.
+		 * @param value True to send sparse packets
+		 */
+		void setSparse(bool value);
+
+		/**
+		 * Sets the level above which a channel is active in sparse packets.
+		 * @param threshold Linear level, default -80dB.
+		 */
+		void setSparseThreshold(float threshold);
+
+		/**
+		 * Sets how long a channel stays active in sparse packets after its level dropped below the threshold.
+		 * @param sampleCount Hold time in samples
+		 */
+		void setSparseHoldTime(int sampleCount);
+
+		/**
+		 * Enables the low delay lossy transform codec, using the VBAN_CODEC_USER codec slot, for links where PCM takes too much bandwidth.
+		 * Packets hold one frame of VBAN_MDCT_FRAME_SIZE samples, the algorithmic delay is two frames. See vbanmdct.h.
+		 * The bit rate is limited by the maximum packet size, about 65 kbit/s per channel for 64 channels at 48 kHz.
+		 * Not used when encryption is enabled, or above 159 channels where the smallest coded frames of all channels do not fit in one packet.
+		 * Allocates memory for the codec on the audio thread when it is enabled or the channel count changes.
+		 * @param bitRate Bit rate per channel in bits per second, or 0 to send PCM.
+		 */
+		void setLossyBitRate(int bitRate);
+
+		/**
+		 * Enables IMA-ADPCM, using the VBAN_CODEC_USER codec slot, which codes 16 bit samples into 4 bits at very little cost for talkback and monitoring feeds.
+		 * Every packet starts with the coder state of all channels, so a lost packet does not affect the next ones. The bit depth setting is not used.
+		 * Not used when encryption or the lossy transform codec is enabled.
+		 * @param value True to send IMA-ADPCM packets
+		 */
+		void setAdpcm(bool value);
+
+		/**
+		 * Returns the highest gain reduction applied by the soft clipper since the last call, to be polled from the control thread for metering.
+		 * @return Gain reduction in dB, 0 when no samples were above the threshold.
+		 */
+		float getGainReduction() { return 20.f * std::log10(mGainReduction.exchange(1.f)); }
+
 		/**
 		 * Activates or deactivates the vban encoding.
 		 * @param value True on activate, false on deactivate
@@ -97,21 +175,159 @@ namespace vban
 		 */
 		void update();
 
+		/**
+		 * Encrypts the payload of the current packet in place and appends the authentication tag
+		 */
+		void encrypt();
+
+		/**
+		 * Starts an encryption session and writes its id into the packet.
+		 * @param session Id of the session, has to be higher than all previous ones.
+		 */
+		void setSession(uint64_t session);
+
+		/**
+		 * Applies the soft clipper or the hard clamp to a sample.
+		 */
+		inline float limit(float sample, float& peakReduction) const;
+
+		/**
+		 * Converts a sample to the bit depth of the stream and writes it at the write position of the packet.
+		 */
+		inline void writeSample(float sample, float& peakReduction);
+
+		/**
+		 * Encodes the input into sparse packets that only carry the active channels.
+		 * @return Whether packets have been sent
+		 */
+		template <typename T>
+		bool processSparse(const T& input, int sampleCount, float& peakReduction);
+
+		/**
+		 * Encodes the input with the lossy transform codec, one frame per packet.
+		 * @return Whether packets have been sent
+		 */
+		template <typename T>
+		bool processLossy(const T& input, int sampleCount, float& peakReduction);
+
+		/**
+		 * Encodes the input with IMA-ADPCM.
+		 * @return Whether packets have been sent
+		 */
+		template <typename T>
+		bool processAdpcm(const T& input, int sampleCount, float& peakReduction);
+
+		/**
+		 * Starts a sparse packet with the channels that are active
+		 */
+		void startSparsePacket();
+
+		/**
+		 * Sends the sparse packet being built
+		 */
+		void sendSparsePacket();
+
+		/**
+		 * @return The next number of the xorshift generator for the dither
+		 */
+		uint32_t nextRandom()
+		{
+			mRandomState ^= mRandomState << 13;
+			mRandomState ^= mRandomState >> 17;
+			mRandomState ^= mRandomState << 5;
+			return mRandomState;
+		}
+
+		/**
+		 * Soft clips a sample and keeps track of the highest gain reduction in peakReduction.
+		 */
+		inline float softClip(float sample, float& peakReduction) const;
+
+		/**
+		 * Calls flush() on senders that implement it, see VBANUdpSender. Does nothing for other senders.
+		 */
+		template <typename T>
+		static auto flush(T& sender, int) -> decltype(sender.flush(), void()) { sender.flush(); }
+		template <typename T>
+		static void flush(T&, long) { }
+
+		/**
+		 * Calls beginProcess() on senders that implement it, see VBANLatencyProbe. Does nothing for other senders.
+		 */
+		template <typename T>
+		static auto beginProcess(T& sender, int) -> decltype(sender.beginProcess(), void()) { sender.beginProcess(); }
+		template <typename T>
+		static void beginProcess(T&, long) { }
+
+		/**
+		 * Calls endProcess() on senders that implement it, see VBANSenderHandle. Does nothing for other senders.
+		 */
+		template <typename T>
+		static auto endProcess(T& sender, int) -> decltype(sender.endProcess(), void()) { sender.endProcess(); }
+		template <typename T>
+		static void endProcess(T&, long) { }
+
 		// Settings
 		std::atomic<int> mSampleRateFormat = { 0 }; // Index to VBanSRList, sample rates supported by VBAN
 		std::atomic<int> mChannelCount = { 2 }; // Number of channels of audio being sent
 		std::atomic<int> mBufferSize = { 256 }; // Buffer size of the audio processing
 		std::atomic<int> mBitDepth = { 16 }; // Bit depth of the vban data
 		std::atomic<bool> mIsActive = { false };
+		std::atomic<bool> mSoftClip = { false };
+		std::atomic<float> mSoftClipThreshold = { 0.8f };
+		std::atomic<bool> mSparse = { false };
+		std::atomic<float> mSparseThreshold = { 0.0001f };
+		std::atomic<int> mSparseHoldTime = { 4800 };
+		std::atomic<int> mLossyBitRate = { 0 };
+		std::atomic<bool> mAdpcm = { false };
 		DirtyFlag mIsDirty;
+		DirtyFlag mSoftClipDirty; // Soft clip settings are applied without restarting the stream
+		DirtyFlag mSparseLevelDirty; // Sparse threshold and hold time are applied without restarting the stream
 
 		// State
 		std::string mStreamName = "vbanstream";
 		std::mutex mStreamNameLock;
+		std::vector<uint8_t> mEncryptionKey;
+		std::mutex mEncryptionKeyLock;
+		int mPayloadPos = VBAN_HEADER_SIZE; // Position in mVbanBuffer where the audio data starts
+		int mPayloadEnd = VBAN_HEADER_SIZE; // Position in mVbanBuffer where the audio data ends
 		int mPacketWritePos = VBAN_HEADER_SIZE; // Write position in the mVbanBuffer of incoming audio data.
-		int mPacketCounter = 0; // Number of packets sent
+		uint32_t mPacketCounter = 0; // Frame number of the next packet, wraps around
 		int mCurrentChannelCount = 0; // Current channelcount
 		int mBytesPerSample = 2; // Determined from bit depth setting
+		uint32_t mRandomState = 0x9E3779B9; // State of the dither generator
+		bool mIsEncrypted = false;
+		uint8_t mCurrentEncryptionKey[VBAN_AEAD_KEY_SIZE] = { };
+		uint64_t mSession = 0; // Encryption session, part of the nonce. Increases on every update and when the packet counter wraps, so a nonce is never reused.
+		bool mIsSoftClipping = false;
+		float mCurrentSoftClipThreshold = 0.8f;
+		std::atomic<float> mGainReduction = { 1.f }; // Highest linear gain reduction of the soft clipper since it was last read
+
+		// Sparse packets
+		bool mIsSparse = false;
+		float mCurrentSparseThreshold = 0.0001f;
+		int mCurrentSparseHoldTime = 4800;
+		int mSamplesPerPacket = VBAN_SAMPLES_MAX_NB; // Largest number of samples in a sparse packet
+		int mSparseCapacity = 0; // Number of samples that fit in the sparse packet being built
+		int mSparseSampleCount = 0; // Number of samples in the sparse packet being built
+		int mPacketChannelCount = 0; // Number of channels in the sparse packet being built
+		uint8_t mPacketChannels[VBAN_CHANNELS_MAX_NB] = { }; // Channels in the sparse packet being built
+		bool mIsPacketChannel[VBAN_CHANNELS_MAX_NB] = { };
+		int mHoldRemaining[VBAN_CHANNELS_MAX_NB] = { }; // Number of samples each channel stays active
+		float mSparseFrame[VBAN_CHANNELS_MAX_NB] = { }; // Samples of all channels at the current position
+
+		// Lossy transform codec
+		bool mIsLossy = false;
+		VBANMdctEncoder mMdctEncoder;
+		std::vector<float> mCodecInput; // Frame being collected, channel after channel
+		int mCodecPosition = 0; // Number of samples in the frame being collected
+		int mCodedChannelSize = 0; // Number of bytes of a coded channel
+
+		// IMA-ADPCM
+		bool mIsAdpcm = false;
+		int16_t mAdpcmFrame[VBAN_CHANNELS_MAX_NB] = { }; // One sample of every channel
+		int32_t mAdpcmPredictors[VBAN_CHANNELS_MAX_NB] = { };
+		int32_t mAdpcmIndices[VBAN_CHANNELS_MAX_NB] = { };
 
 		// VBAN packet
 		std::vector<char> mVbanBuffer; // Data containing the full VBAN packet including the header
@@ -130,45 +346,264 @@ namespace vban
 		if (mIsDirty.check())
 			update();
 
+		assert(channelCount >= mCurrentChannelCount);
+		(void)channelCount; // Only checked in debug builds
+
+		if (mSoftClipDirty.check())
+		{
+			mIsSoftClipping = mSoftClip.load();
+			mCurrentSoftClipThreshold = mSoftClipThreshold.load();
+		}
+
+		if (mSparseLevelDirty.check())
+		{
+			mCurrentSparseThreshold = mSparseThreshold.load();
+			mCurrentSparseHoldTime = mSparseHoldTime.load();
+			for (auto& remaining : mHoldRemaining)
+				remaining = std::min(remaining, mCurrentSparseHoldTime);
+		}
+
+		beginProcess(mSender, 0);
+
+		float peakReduction = 1.f;
+		bool isSent = false;
+		if (mIsLossy)
+			isSent = processLossy(input, sampleCount, peakReduction);
+		else if (mIsAdpcm)
+			isSent = processAdpcm(input, sampleCount, peakReduction);
+		else if (mIsSparse)
+			isSent = processSparse(input, sampleCount, peakReduction);
+		else
+		{
+			for (auto i = 0; i < sampleCount; ++i)
+			{
+				for (auto channel = 0; channel < mCurrentChannelCount; ++channel)
+					writeSample(input[channel][i], peakReduction);
+				if (mPacketWritePos >= mPayloadEnd)
+				{
+					assert(mPacketWritePos == mPayloadEnd);
+					mPacketHeader->nuFrame = mPacketCounter;
+					if (mIsEncrypted)
+						encrypt();
+					mSender.sendPacket(mVbanBuffer);
+					mPacketWritePos = mPayloadPos;
+					if (++mPacketCounter == 0 && mIsEncrypted)
+						setSession(mSession + 1);
+					isSent = true;
+				}
+			}
+		}
+
+		// Senders that collect packets send them all at once
+		if (isSent)
+			flush(mSender, 0);
+		endProcess(mSender, 0);
+
+		if (peakReduction > 1.f)
+		{
+			auto reduction = mGainReduction.load();
+			while (peakReduction > reduction && !mGainReduction.compare_exchange_weak(reduction, peakReduction));
+		}
+	}
+
+
+	template <typename SenderType>
+	float VBANStreamEncoder<SenderType>::limit(float sample, float& peakReduction) const
+	{
+		if (mIsSoftClipping)
+			sample = softClip(sample, peakReduction);
+		return std::max(-1.f, std::min(sample, 1.f));
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::writeSample(float sample, float& peakReduction)
+	{
+		sample = limit(sample, peakReduction);
+		if (mBytesPerSample == 4)
+		{
+			auto value = static_cast<int32_t>(sample * std::numeric_limits<int32_t>::max());
+
+			// convert 32 bit int to four bytes
+			mVbanBuffer[mPacketWritePos] = value;
+			mVbanBuffer[mPacketWritePos + 1] = value >> 8;
+			mVbanBuffer[mPacketWritePos + 2] = value >> 16;
+			mVbanBuffer[mPacketWritePos + 3] = value >> 24;
+			mPacketWritePos += 4;
+		}
+		else if (mBytesPerSample == 1)
+		{
+			// Triangular dither decorrelates the quantization error from the signal, the difference of two uniform random numbers spans one step either way
+			auto dither = (static_cast<float>(nextRandom()) - static_cast<float>(nextRandom())) * (1.f / 4294967296.f);
+			auto value = std::floor(sample * std::numeric_limits<int8_t>::max() + dither + 0.5f);
+			value = std::max(-127.f, std::min(value, 127.f));
+			mVbanBuffer[mPacketWritePos] = static_cast<int8_t>(value);
+			mPacketWritePos += 1;
+		}
+		else {
+			auto value = static_cast<int16_t>(sample * std::numeric_limits<int16_t>::max());
+
+			// convert 16 bit int to two bytes
+			mVbanBuffer[mPacketWritePos] = value;
+			mVbanBuffer[mPacketWritePos + 1] = value >> 8;
+			mPacketWritePos += 2;
+		}
+	}
+
+
+	template <typename SenderType> template <typename T>
+	bool VBANStreamEncoder<SenderType>::processSparse(const T& input, int sampleCount, float& peakReduction)
+	{
+		bool isSent = false;
 		for (auto i = 0; i < sampleCount; ++i)
 		{
+			// Channels above the threshold are active for the hold time
+			bool isNewChannelActive = false;
 			for (auto channel = 0; channel < mCurrentChannelCount; ++channel)
 			{
 				float sample = input[channel][i];
-				if (sample < -1.f)
-					sample = -1.f;
-				if (sample > 1.f)
-					sample = 1.f;
-
-				if (mBytesPerSample == 4)
+				mSparseFrame[channel] = sample;
+				if (std::fabs(sample) > mCurrentSparseThreshold)
 				{
-					auto value = static_cast<int32_t>(sample * std::numeric_limits<int32_t>::max());
-
-					// convert 32 bit int to four bytes
-					mVbanBuffer[mPacketWritePos] = value;
-					mVbanBuffer[mPacketWritePos + 1] = value >> 8;
-					mVbanBuffer[mPacketWritePos + 2] = value >> 16;
-					mVbanBuffer[mPacketWritePos + 3] = value >> 24;
-					mPacketWritePos += 4;
+					mHoldRemaining[channel] = mCurrentSparseHoldTime;
+					isNewChannelActive |= !mIsPacketChannel[channel];
 				}
-				else {
-					auto value = static_cast<int16_t>(sample * std::numeric_limits<int16_t>::max());
+			}
 
-					// convert 16 bit int to two bytes
-					mVbanBuffer[mPacketWritePos] = value;
-					mVbanBuffer[mPacketWritePos + 1] = value >> 8;
-					mPacketWritePos += 2;
-				}
+			// The channels of a packet are fixed, a channel that becomes active ends the packet early
+			if (isNewChannelActive && mSparseSampleCount > 0)
+			{
+				sendSparsePacket();
+				isSent = true;
+			}
+			if (mSparseSampleCount == 0)
+				startSparsePacket();
+
+			for (auto index = 0; index < mPacketChannelCount; ++index)
+				writeSample(mSparseFrame[mPacketChannels[index]], peakReduction);
+			for (auto channel = 0; channel < mCurrentChannelCount; ++channel)
+				if (mHoldRemaining[channel] > 0)
+					mHoldRemaining[channel]--;
+
+			mSparseSampleCount++;
+			if (mSparseSampleCount == mSparseCapacity)
+			{
+				sendSparsePacket();
+				isSent = true;
+			}
+		}
+		return isSent;
+	}
+
+
+	template <typename SenderType> template <typename T>
+	bool VBANStreamEncoder<SenderType>::processLossy(const T& input, int sampleCount, float& peakReduction)
+	{
+		bool isSent = false;
+		for (auto i = 0; i < sampleCount; ++i)
+		{
+			for (auto channel = 0; channel < mCurrentChannelCount; ++channel)
+				mCodecInput[channel * VBAN_MDCT_FRAME_SIZE + mCodecPosition] = limit(input[channel][i], peakReduction);
+
+			// Every packet holds one coded frame of all channels
+			if (++mCodecPosition == VBAN_MDCT_FRAME_SIZE)
+			{
+				auto output = reinterpret_cast<unsigned char*>(&mVbanBuffer[VBAN_MDCT_PAYLOAD_OFFSET]);
+				for (auto channel = 0; channel < mCurrentChannelCount; ++channel)
+					mMdctEncoder.encode(channel, &mCodecInput[channel * VBAN_MDCT_FRAME_SIZE], output + channel * mCodedChannelSize, mCodedChannelSize);
+				mPacketHeader->nuFrame = mPacketCounter;
+				mSender.sendPacket(mVbanBuffer);
+				mPacketCounter++;
+				mCodecPosition = 0;
+				isSent = true;
+			}
+		}
+		return isSent;
+	}
+
+
+	template <typename SenderType> template <typename T>
+	bool VBANStreamEncoder<SenderType>::processAdpcm(const T& input, int sampleCount, float& peakReduction)
+	{
+		bool isSent = false;
+		auto output = reinterpret_cast<unsigned char*>(mVbanBuffer.data());
+		for (auto i = 0; i < sampleCount; ++i)
+		{
+			// Every packet starts with the state of the coder
+			if (mPacketWritePos == mPayloadPos)
+			{
+				adpcmWriteState(mAdpcmPredictors, mAdpcmIndices, mCurrentChannelCount, output + mPacketWritePos);
+				mPacketWritePos += mCurrentChannelCount * VBAN_ADPCM_STATE_SIZE;
 			}
-			if (mPacketWritePos >= mVbanBuffer.size())
+
+			for (auto channel = 0; channel < mCurrentChannelCount; ++channel)
+				mAdpcmFrame[channel] = static_cast<int16_t>(limit(input[channel][i], peakReduction) * std::numeric_limits<int16_t>::max());
+			adpcmEncode(mAdpcmFrame, mCurrentChannelCount, mAdpcmPredictors, mAdpcmIndices, output + mPacketWritePos);
+			mPacketWritePos += getAdpcmFrameSize(mCurrentChannelCount);
+
+			if (mPacketWritePos >= mPayloadEnd)
 			{
-				assert(mPacketWritePos == mVbanBuffer.size());
 				mPacketHeader->nuFrame = mPacketCounter;
 				mSender.sendPacket(mVbanBuffer);
-				mPacketWritePos = VBAN_HEADER_SIZE;
+				mPacketWritePos = mPayloadPos;
 				mPacketCounter++;
+				isSent = true;
+			}
+		}
+		return isSent;
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::startSparsePacket()
+	{
+		// The packet carries the channels that are still within their hold time
+		mVbanBuffer.resize(VBAN_PROTOCOL_MAX_SIZE);
+		auto bitmapSize = getSparseBitmapSize(mCurrentChannelCount);
+		auto bitmap = reinterpret_cast<uint8_t*>(&mVbanBuffer[VBAN_SPARSE_BITMAP_OFFSET]);
+		std::memset(bitmap, 0, bitmapSize);
+		mPacketChannelCount = 0;
+		for (auto channel = 0; channel < mCurrentChannelCount; ++channel)
+		{
+			mIsPacketChannel[channel] = mHoldRemaining[channel] > 0;
+			if (mIsPacketChannel[channel])
+			{
+				bitmap[channel / 8] |= 1 << (channel % 8);
+				mPacketChannels[mPacketChannelCount++] = channel;
 			}
 		}
+
+		// Fewer channels leave room for more samples per packet
+		mSparseCapacity = mSamplesPerPacket;
+		if (mPacketChannelCount > 0)
+			mSparseCapacity = std::min(mSparseCapacity, (VBAN_PROTOCOL_MAX_SIZE - VBAN_SPARSE_BITMAP_OFFSET - bitmapSize) / (mPacketChannelCount * mBytesPerSample));
+		mPacketWritePos = VBAN_SPARSE_BITMAP_OFFSET + bitmapSize;
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::sendSparsePacket()
+	{
+		mPacketHeader->nuFrame = mPacketCounter;
+		mPacketHeader->format_nbs = mSparseSampleCount - 1;
+		mVbanBuffer.resize(mPacketWritePos);
+		mSender.sendPacket(mVbanBuffer);
+		mPacketCounter++;
+		mSparseSampleCount = 0;
+	}
+
+
+	template <typename SenderType>
+	float VBANStreamEncoder<SenderType>::softClip(float sample, float& peakReduction) const
+	{
+		// Above the threshold the curve t + (1 - t) * u / (1 + u) continues with the same slope and approaches full scale.
+		// Below the threshold u is 0 and the sample passes unchanged, computed without branches so the same instructions run for every sample.
+		auto magnitude = std::fabs(sample);
+		auto headroom = 1.f - mCurrentSoftClipThreshold;
+		auto over = std::max(magnitude - mCurrentSoftClipThreshold, 0.f) / headroom;
+		auto clipped = std::min(magnitude, mCurrentSoftClipThreshold) + headroom * over / (1.f + over);
+		peakReduction = std::max(peakReduction, magnitude / std::max(clipped, std::numeric_limits<float>::min()));
+		return std::copysign(clipped, sample);
 	}
 
 
@@ -192,7 +627,7 @@ namespace vban
 	template<typename SenderType>
 	void VBANStreamEncoder<SenderType>::setBitDepth(int bitrate)
 	{
-		assert(bitrate == 16 || bitrate == 32);
+		assert(bitrate == 8 || bitrate == 16 || bitrate == 32);
 		mBitDepth.store(bitrate);
 		mIsDirty.set();
 	}
@@ -217,6 +652,76 @@ namespace vban
 	}
 
 
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setEncryptionKey(const std::vector<uint8_t>& key)
+	{
+		assert(key.empty() || key.size() == VBAN_AEAD_KEY_SIZE);
+		std::lock_guard<std::mutex> lock(mEncryptionKeyLock);
+		mEncryptionKey = key;
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setSoftClip(bool value)
+	{
+		mSoftClip.store(value);
+		mSoftClipDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setSoftClipThreshold(float threshold)
+	{
+		assert(threshold >= 0.f && threshold < 1.f);
+		mSoftClipThreshold.store(threshold);
+		mSoftClipDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setLossyBitRate(int bitRate)
+	{
+		assert(bitRate >= 0);
+		mLossyBitRate.store(bitRate);
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setAdpcm(bool value)
+	{
+		mAdpcm.store(value);
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setSparse(bool value)
+	{
+		mSparse.store(value);
+		mIsDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setSparseThreshold(float threshold)
+	{
+		assert(threshold >= 0.f);
+		mSparseThreshold.store(threshold);
+		mSparseLevelDirty.set();
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setSparseHoldTime(int sampleCount)
+	{
+		assert(sampleCount >= 0);
+		mSparseHoldTime.store(sampleCount);
+		mSparseLevelDirty.set();
+	}
+
+
 	template <typename SenderType>
 	void VBANStreamEncoder<SenderType>::setActive(bool value)
 	{
@@ -233,6 +738,16 @@ namespace vban
 		mBytesPerSample = 2;
 		if (mBitDepth.load() == 32)
 			mBytesPerSample = 4;
+		else if (mBitDepth.load() == 8)
+			mBytesPerSample = 1;
+
+		{
+			std::lock_guard<std::mutex> lock(mEncryptionKeyLock);
+			mIsEncrypted = !mEncryptionKey.empty();
+			if (mIsEncrypted)
+				std::memcpy(mCurrentEncryptionKey, mEncryptionKey.data(), VBAN_AEAD_KEY_SIZE);
+		}
+		auto overhead = mIsEncrypted ? VBAN_AEAD_OVERHEAD : 0;
 
 		// Determine the packet size
 		// Ideally the packet holds one single buffer of the calling DSP system
@@ -240,20 +755,22 @@ namespace vban
 		if (samplesPerPacket > VBAN_SAMPLES_MAX_NB)
 			samplesPerPacket = VBAN_SAMPLES_MAX_NB;
 		int samplesSize = samplesPerPacket * mBytesPerSample * mCurrentChannelCount;
-		if (samplesSize > VBAN_DATA_MAX_SIZE)
+		if (samplesSize > VBAN_DATA_MAX_SIZE - overhead)
 		{
-			samplesPerPacket = (VBAN_DATA_MAX_SIZE / mBytesPerSample) / mCurrentChannelCount;
+			samplesPerPacket = ((VBAN_DATA_MAX_SIZE - overhead) / mBytesPerSample) / mCurrentChannelCount;
 			samplesSize = samplesPerPacket * mBytesPerSample * mCurrentChannelCount;
 		}
 
-		auto packetSize = samplesSize + VBAN_HEADER_SIZE;
+		auto packetSize = samplesSize + VBAN_HEADER_SIZE + overhead;
 
 		// resize the packet data to have the correct size
 		mVbanBuffer.resize(packetSize);
+		mPayloadPos = mIsEncrypted ? VBAN_AEAD_PAYLOAD_OFFSET : VBAN_HEADER_SIZE;
+		mPayloadEnd = mPayloadPos + samplesSize;
 
 		// Reset packet counter and buffer write position
 		mPacketCounter = 0;
-		mPacketWritePos = VBAN_HEADER_SIZE;
+		mPacketWritePos = mPayloadPos;
 
 		// initialize VBAN header
 		mPacketHeader = (struct VBanHeader*)(&mVbanBuffer[0]);
@@ -262,6 +779,8 @@ namespace vban
 		mPacketHeader->format_SR  = mSampleRateFormat.load();
 		if (mBytesPerSample == 4)
 			mPacketHeader->format_bit = VBAN_BITFMT_32_INT;
+		else if (mBytesPerSample == 1)
+			mPacketHeader->format_bit = VBAN_BITFMT_8_INT;
 		else
 			mPacketHeader->format_bit = VBAN_BITFMT_16_INT;
 		{
@@ -270,6 +789,96 @@ namespace vban
 		}
 		mPacketHeader->nuFrame    = mPacketCounter;
 		mPacketHeader->format_nbs = samplesPerPacket - 1;
+
+		if (mIsEncrypted)
+		{
+			// Start a new session, based on the time so it keeps increasing over restarts of the sender
+			auto now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			mPacketHeader->format_bit |= VBAN_CODEC_USER;
+			auto userHeader = reinterpret_cast<VBanUserHeader*>(&mVbanBuffer[VBAN_HEADER_SIZE]);
+			userHeader->type = VBAN_USER_CODEC_AEAD;
+			std::memset(userHeader->reserved, 0, sizeof(userHeader->reserved));
+			setSession(std::max(static_cast<uint64_t>(now), mSession + 1));
+		}
+
+		// Transform coded packets hold one frame, each channel coded into the same number of bytes, at least the side information
+		auto bitRate = mLossyBitRate.load();
+		mIsLossy = bitRate > 0 && !mIsEncrypted && mCurrentChannelCount * VBAN_MDCT_MIN_CHANNEL_SIZE <= VBAN_DATA_MAX_SIZE - VBAN_USER_HEADER_SIZE;
+		mCodecPosition = 0;
+		if (mIsLossy)
+		{
+			auto sampleRate = VBanSRList[mSampleRateFormat.load()];
+			mCodedChannelSize = static_cast<int>(static_cast<long>(bitRate) * VBAN_MDCT_FRAME_SIZE / (sampleRate * 8));
+			mCodedChannelSize = std::max(VBAN_MDCT_MIN_CHANNEL_SIZE, std::min(mCodedChannelSize, (VBAN_DATA_MAX_SIZE - VBAN_USER_HEADER_SIZE) / mCurrentChannelCount));
+			mCodecInput.assign(mCurrentChannelCount * VBAN_MDCT_FRAME_SIZE, 0.f);
+			mMdctEncoder.setChannelCount(mCurrentChannelCount);
+
+			mVbanBuffer.resize(VBAN_MDCT_PAYLOAD_OFFSET + mCurrentChannelCount * mCodedChannelSize);
+			mPacketHeader->format_nbs = VBAN_MDCT_FRAME_SIZE - 1;
+			mPacketHeader->format_bit |= VBAN_CODEC_USER;
+			auto userHeader = reinterpret_cast<VBanUserHeader*>(&mVbanBuffer[VBAN_HEADER_SIZE]);
+			userHeader->type = VBAN_USER_CODEC_MDCT;
+			userHeader->reserved[0] = static_cast<uint8_t>(mCodedChannelSize);
+			userHeader->reserved[1] = static_cast<uint8_t>(mCodedChannelSize >> 8);
+			userHeader->reserved[2] = 0;
+		}
+
+		// IMA-ADPCM packets hold as many samples as fit next to the coder state
+		mIsAdpcm = mAdpcm.load() && !mIsEncrypted && !mIsLossy;
+		if (mIsAdpcm)
+		{
+			auto frameSize = getAdpcmFrameSize(mCurrentChannelCount);
+			auto samples = std::min(std::min(mBufferSize.load(), VBAN_SAMPLES_MAX_NB), (VBAN_DATA_MAX_SIZE - VBAN_USER_HEADER_SIZE - mCurrentChannelCount * VBAN_ADPCM_STATE_SIZE) / frameSize);
+			mPayloadPos = VBAN_ADPCM_PAYLOAD_OFFSET;
+			mPayloadEnd = mPayloadPos + getAdpcmPayloadSize(samples, mCurrentChannelCount);
+			mPacketWritePos = mPayloadPos;
+			mVbanBuffer.resize(mPayloadEnd);
+			mPacketHeader->format_nbs = samples - 1;
+			mPacketHeader->format_bit = VBAN_BITFMT_16_INT | VBAN_CODEC_USER;
+			auto userHeader = reinterpret_cast<VBanUserHeader*>(&mVbanBuffer[VBAN_HEADER_SIZE]);
+			userHeader->type = VBAN_USER_CODEC_ADPCM;
+			std::memset(userHeader->reserved, 0, sizeof(userHeader->reserved));
+			std::fill(std::begin(mAdpcmPredictors), std::end(mAdpcmPredictors), 0);
+			std::fill(std::begin(mAdpcmIndices), std::end(mAdpcmIndices), 0);
+		}
+
+		// Sparse packets have a variable size, they are built by startSparsePacket()
+		mIsSparse = mSparse.load() && !mIsEncrypted && !mIsLossy && !mIsAdpcm;
+		mSamplesPerPacket = std::min(mBufferSize.load(), VBAN_SAMPLES_MAX_NB);
+		mSparseSampleCount = 0;
+		std::fill(std::begin(mHoldRemaining), std::end(mHoldRemaining), 0);
+		if (mIsSparse)
+		{
+			mVbanBuffer.resize(VBAN_PROTOCOL_MAX_SIZE);
+			mPacketHeader->format_bit |= VBAN_CODEC_USER;
+			auto userHeader = reinterpret_cast<VBanUserHeader*>(&mVbanBuffer[VBAN_HEADER_SIZE]);
+			userHeader->type = VBAN_USER_CODEC_SPARSE;
+			std::memset(userHeader->reserved, 0, sizeof(userHeader->reserved));
+		}
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::encrypt()
+	{
+		// The nonce is the session id followed by the frame number
+		uint8_t nonce[VBAN_AEAD_NONCE_SIZE];
+		std::memcpy(nonce, &mVbanBuffer[VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE], VBAN_AEAD_SESSION_SIZE);
+		for (auto i = 0; i < 4; ++i)
+			nonce[VBAN_AEAD_SESSION_SIZE + i] = static_cast<uint8_t>(mPacketCounter >> (i * 8));
+
+		// The headers are authenticated, the audio is encrypted
+		auto data = reinterpret_cast<uint8_t*>(mVbanBuffer.data());
+		aeadEncrypt(mCurrentEncryptionKey, nonce, data, mPayloadPos, data + mPayloadPos, mPayloadEnd - mPayloadPos, data + mPayloadEnd);
+	}
+
+
+	template <typename SenderType>
+	void VBANStreamEncoder<SenderType>::setSession(uint64_t session)
+	{
+		mSession = session;
+		for (auto i = 0; i < VBAN_AEAD_SESSION_SIZE; ++i)
+			mVbanBuffer[VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE + i] = static_cast<char>(mSession >> (i * 8));
 	}
 
 }
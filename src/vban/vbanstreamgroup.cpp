@@ -0,0 +1,59 @@
+#include "vbanstreamgroup.h"
+
+#include <cassert>
+
+namespace vban
+{
+
+	VBANStreamGroup::VBANStreamGroup(const std::vector<Member>& members) : mMembers(members)
+	{
+		int channelCount = 0;
+		int maxChannelCount = 0;
+		for (auto& member : mMembers)
+		{
+			assert(member.mDecoder != nullptr && member.mChannelCount > 0);
+			channelCount += member.mChannelCount;
+			maxChannelCount = std::max(maxChannelCount, member.mChannelCount);
+		}
+		mBuffer.resize(maxChannelCount);
+		mDelayLines.resize(channelCount);
+		mPlayDelays.assign(mMembers.size(), -1);
+		mDelays.assign(mMembers.size(), 0);
+		mMemberDelays = std::make_unique<std::atomic<int>[]>(mMembers.size());
+		for (size_t i = 0; i < mMembers.size(); ++i)
+			mMemberDelays[i].store(0);
+		update();
+	}
+
+
+	void VBANStreamGroup::setBufferSize(int bufferSize)
+	{
+		assert(bufferSize > 0);
+		mBufferSize.store(bufferSize);
+		mIsDirty.set();
+	}
+
+
+	void VBANStreamGroup::setMaxDelay(int sampleCount)
+	{
+		assert(sampleCount >= 0);
+		mMaxDelay.store(sampleCount);
+		mIsDirty.set();
+	}
+
+
+	void VBANStreamGroup::update()
+	{
+		auto bufferSize = mBufferSize.load();
+		for (auto& channel : mBuffer)
+			channel.resize(bufferSize);
+
+		// Room for the largest delay behind the block that is written
+		mCurrentMaxDelay = mMaxDelay.load();
+		mDelayLineSize = mCurrentMaxDelay + bufferSize;
+		for (auto& delayLine : mDelayLines)
+			delayLine.assign(mDelayLineSize, 0.f);
+		mWritePosition = 0;
+	}
+
+}
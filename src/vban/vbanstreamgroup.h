@@ -0,0 +1,185 @@
+#pragma once
+
+#include "vbanstreamdecoder.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+
+namespace vban
+{
+
+	/**
+	 * Plays a number of VBAN streams from different senders that together form one multichannel program, aligned to a common playout point.
+	 * The streams arrive with different latencies and each decoder buffers its own number of packets, so samples that arrived at the same time are played at different times.
+	 * After every call the group compares how long the samples of each member stayed in its decoder, measured on the clock of the receiver from the arrival of the packets, see VBANStreamDecoder::getPlayDelay().
+	 * The members that play their samples sooner after arrival are delayed by the difference, so samples that arrived together leave the group together.
+	 * The frame numbers and clocks of the senders are not used, so the senders can start and restart independently. A difference in network latency between a sender and the receiver can not be seen by the receiver and is not compensated.
+	 * The estimate follows the packets that arrived without delay, so the alignment is as accurate as the fastest packets are regular, and delays only change when the estimate moves by more than mTolerance samples.
+	 */
+	class VBANStreamGroup
+	{
+	public:
+		// Smallest change of the estimated offset of a member in samples that changes its delay, so the jitter of the estimate does not cause clicks
+		static constexpr int mTolerance = 8;
+
+		/**
+		 * A stream in the group
+		 */
+		struct Member
+		{
+			VBANStreamDecoder* mDecoder = nullptr;
+			int mChannelCount = 0; // Number of channels the member contributes to the output
+		};
+
+		/**
+		 * Constructor
+		 * @param members The streams of the group. The channels of the members follow each other in the output, in the order of the members.
+		 */
+		explicit VBANStreamGroup(const std::vector<Member>& members);
+
+		// Default destructor
+		virtual ~VBANStreamGroup() = default;
+
+		/**
+		 * Call this method from the audio thread to fill the output with the aligned channels of all members.
+		 * @tparam T Type for the multichannel audio data, see VBANStreamDecoder::process().
+		 * @param output Multichannel audio data to be filled.
+		 * @param channelCount Number of channels in output, channels beyond the channels of the members are filled with silence.
+		 * @param sampleCount Number of samples to fill. Has to be smaller than or equal to the buffer size set by setBufferSize().
+		 */
+		template <typename T>
+		void process(T& output, int channelCount, int sampleCount);
+
+		/**
+		 * Sets the maximum buffer size of the calling audio processing system.
+		 * @param bufferSize in samples
+		 */
+		void setBufferSize(int bufferSize);
+
+		/**
+		 * Sets the largest arrival offset between members that can be compensated. Members that are further ahead are delayed by this maximum.
+		 * @param sampleCount Maximum delay in samples
+		 */
+		void setMaxDelay(int sampleCount);
+
+		/**
+		 * @return Number of samples the member is delayed by, which is how much sooner its decoder plays the samples after arrival than the slowest member.
+		 */
+		int getMemberDelay(int member) const { return mMemberDelays[member].load(); }
+
+		/**
+		 * @return Whether all members are playing and their offsets could be compensated.
+		 */
+		bool isAligned() const { return mIsAligned.load(); }
+
+		/**
+		 * @return Number of times the delays changed, after a member started playing or refilled its jitter buffer.
+		 */
+		int getRealignCount() const { return mRealignCount.load(); }
+
+	private:
+		/**
+		 * Updates the internal state from the current settings
+		 */
+		void update();
+
+		// Settings
+		std::atomic<int> mBufferSize = { 256 };
+		std::atomic<int> mMaxDelay = { 4800 };
+		DirtyFlag mIsDirty;
+
+		// State
+		std::vector<Member> mMembers;
+		std::vector<std::vector<float>> mBuffer; // Output of the decoder of a member, reused for all members
+		std::vector<std::vector<float>> mDelayLines; // Ring buffer of every channel of every member
+		std::vector<int64_t> mPlayDelays; // Play delay of every member after the last call, -1 when not playing
+		std::vector<int> mDelays; // Current delay of every member
+		int mCurrentMaxDelay = 0;
+		int mDelayLineSize = 0;
+		int mWritePosition = 0; // Write position in the delay lines
+		std::unique_ptr<std::atomic<int>[]> mMemberDelays;
+		std::atomic<bool> mIsAligned = { false };
+		std::atomic<int> mRealignCount = { 0 };
+	};
+
+
+	template <typename T>
+	void VBANStreamGroup::process(T& output, int channelCount, int sampleCount)
+	{
+		if (mIsDirty.check())
+			update();
+
+		assert(mBuffer.empty() || sampleCount <= static_cast<int>(mBuffer[0].size()));
+
+		// Decode every member into its delay line and note how long its samples stayed in the decoder
+		int channelOffset = 0;
+		for (size_t member = 0; member < mMembers.size(); ++member)
+		{
+			auto& decoder = *mMembers[member].mDecoder;
+			auto memberChannelCount = mMembers[member].mChannelCount;
+			decoder.process(mBuffer, memberChannelCount, sampleCount);
+			mPlayDelays[member] = decoder.getPlayDelay();
+
+			for (auto channel = 0; channel < memberChannelCount; ++channel)
+			{
+				auto& delayLine = mDelayLines[channelOffset + channel];
+				auto& input = mBuffer[channel];
+				for (auto i = 0; i < sampleCount; ++i)
+					delayLine[(mWritePosition + i) % mDelayLineSize] = input[i];
+			}
+			channelOffset += memberChannelCount;
+		}
+		mWritePosition = (mWritePosition + sampleCount) % mDelayLineSize;
+
+		// The member that holds its samples the longest sets the common playout point
+		int64_t longest = -1;
+		for (auto playDelay : mPlayDelays)
+			longest = std::max(longest, playDelay);
+
+		auto isAligned = longest >= 0;
+		for (size_t member = 0; member < mMembers.size(); ++member)
+		{
+			auto delay = mDelays[member];
+			if (mPlayDelays[member] < 0)
+				isAligned = false;
+			else if (longest - mPlayDelays[member] > mCurrentMaxDelay)
+			{
+				delay = mCurrentMaxDelay;
+				isAligned = false;
+			}
+			else if (std::abs(longest - mPlayDelays[member] - delay) > mTolerance)
+				delay = static_cast<int>(longest - mPlayDelays[member]);
+
+			if (delay != mDelays[member] && mPlayDelays[member] >= 0)
+			{
+				mDelays[member] = delay;
+				mMemberDelays[member].store(delay);
+				mRealignCount++;
+			}
+		}
+		mIsAligned.store(isAligned);
+
+		// Read every member its delay behind the block that has just been written
+		channelOffset = 0;
+		for (size_t member = 0; member < mMembers.size(); ++member)
+		{
+			auto start = mWritePosition - sampleCount - mDelays[member] + 2 * mDelayLineSize;
+			for (auto channel = 0; channel < mMembers[member].mChannelCount && channelOffset + channel < channelCount; ++channel)
+			{
+				auto& delayLine = mDelayLines[channelOffset + channel];
+				auto& out = output[channelOffset + channel];
+				for (auto i = 0; i < sampleCount; ++i)
+					out[i] = delayLine[(start + i) % mDelayLineSize];
+			}
+			channelOffset += mMembers[member].mChannelCount;
+		}
+		for (auto channel = channelOffset; channel < channelCount; ++channel)
+			for (auto i = 0; i < sampleCount; ++i)
+				output[channel][i] = 0.f;
+	}
+
+}
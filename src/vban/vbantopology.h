@@ -0,0 +1,417 @@
+#pragma once
+
+#include "vbanstreamencoder.h"
+#include "vbanstreamdecoder.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+namespace vban
+{
+
+	/**
+	 * Declarative description of all VBAN streams a process sends and receives.
+	 * Streams are identified by their id, so a stream that keeps its id between two topologies is modified instead of recreated.
+	 */
+	struct VBANTopology
+	{
+		/**
+		 * A stream sent by a VBANStreamEncoder
+		 */
+		struct Sender
+		{
+			std::string id;							///< Identifies the stream between topologies
+			std::string streamName;					///< VBAN stream name, up to 16 characters
+			std::string destination;				///< Address the packets are sent to
+			int port = 6980;						///< Port the packets are sent to
+			int sampleRateFormat = 3;				///< Index to VBanSRList
+			int bitDepth = 16;						///< 8, 16 or 32
+			std::vector<int> inputChannels;			///< For each channel of the stream the input channel of the host, or -1 for silence
+		};
+
+		/**
+		 * A stream received by a VBANStreamDecoder
+		 */
+		struct Receiver
+		{
+			std::string id;							///< Identifies the stream between topologies
+			std::string streamName;					///< VBAN stream name to listen to, up to 16 characters
+			int latency = 3;						///< Number of packets buffered before playback starts
+			int timeout = 2;						///< Number of packet periods without packets before the stream is considered down
+			std::vector<int> subscribedChannels;	///< Channels of the stream that are decoded, empty for all
+			std::vector<int> channelMap;			///< Maps decoded channels onto the outputs of the stream, see VBANStreamDecoder::setChannelMap()
+			std::vector<int> outputChannels;		///< For each output of the stream the output channel of the host it is mixed into, or -1
+		};
+
+		std::vector<Sender> senders;
+		std::vector<Receiver> receivers;
+	};
+
+
+	/**
+	 * Creates, modifies and removes encoders and decoders to match a VBANTopology, so a process can be reconfigured without a restart.
+	 * apply() compares the new topology with the current one: unchanged streams are left alone, changed settings are passed to the existing encoders and decoders through their setters and only streams that are new, removed or moved to another destination are created or destroyed.
+	 * The audio thread calls process() and the network thread receivePacket(). Both read an immutable snapshot of the streams that is replaced by apply(), so they never wait for the control thread and never allocate.
+	 * Replaced snapshots, and the streams only they refer to, are destroyed on the control thread once no thread reads them anymore.
+	 * @tparam SenderType The sender used by the encoders, see VBANStreamEncoder.
+	 */
+	template <typename SenderType>
+	class VBANTopologyApplier
+	{
+	public:
+		/**
+		 * Creates the sender of a new stream.
+		 * Receives the destination address and port of the stream.
+		 */
+		using SenderFactory = std::function<std::unique_ptr<SenderType>(const std::string& destination, int port)>;
+
+		/**
+		 * Constructor
+		 * @param senderFactory Called on the control thread to create the sender of every new stream.
+		 * @param bufferSize Number of samples process() is called with, the buffer size of the host.
+		 */
+		VBANTopologyApplier(SenderFactory senderFactory, int bufferSize = 256);
+
+		// Destructor, the audio and network thread have to be stopped.
+		virtual ~VBANTopologyApplier();
+
+		/**
+		 * Call this method from the control thread to reconfigure the streams.
+		 * @param topology The new topology
+		 */
+		void apply(const VBANTopology& topology);
+
+		/**
+		 * Call this method from the control thread to destroy the streams of earlier topologies that are no longer read. apply() does this as well.
+		 */
+		void collect();
+
+		/**
+		 * Call this method from the audio thread to encode the input into the senders and decode the receivers into the output.
+		 * @tparam InputType Type for the multichannel input data, see VBANStreamEncoder::process().
+		 * @tparam OutputType Type for the multichannel output data, see VBANStreamDecoder::process().
+		 * @param input Multichannel audio data sent by the senders
+		 * @param inputChannelCount Number of channels in input
+		 * @param output Multichannel audio data, overwritten by the mix of all receivers.
+		 * @param outputChannelCount Number of channels in output
+		 * @param sampleCount Number of samples to process, up to the buffer size passed to the constructor.
+		 */
+		template <typename InputType, typename OutputType>
+		void process(const InputType& input, int inputChannelCount, OutputType& output, int outputChannelCount, int sampleCount);
+
+		/**
+		 * Call this method from the network thread to pass a received VBAN packet to the receivers listening to its stream.
+		 * @param data Data containing the full VBAN packet including the header.
+		 * @param size Size of the packet in bytes.
+		 * @return True if a receiver accepted the packet.
+		 */
+		bool receivePacket(const char* data, int size);
+
+		/**
+		 * @return The current topology
+		 */
+		const VBANTopology& getTopology() const { return mTopology; }
+
+		/**
+		 * @return Number of streams that have been created since construction.
+		 */
+		int getCreatedCount() const { return mCreatedCount; }
+
+	private:
+		using Encoder = VBANStreamEncoder<SenderType>;
+
+		// Owns an encoder and its sender
+		struct SenderStream
+		{
+			std::unique_ptr<SenderType> mSender;
+			std::unique_ptr<Encoder> mEncoder;
+		};
+
+		struct SenderEntry
+		{
+			std::shared_ptr<SenderStream> mStream;
+			std::vector<int> mInputChannels;
+			std::vector<const float*> mChannels; // Input channels passed to the encoder, filled on the audio thread
+		};
+
+		struct ReceiverEntry
+		{
+			std::shared_ptr<VBANStreamDecoder> mDecoder;
+			char mStreamName[VBAN_STREAM_NAME_SIZE] = { };
+			std::vector<int> mOutputChannels;
+			std::vector<std::vector<float>> mBuffer; // Decoded outputs of the stream
+		};
+
+		// Immutable set of streams read by the audio and network thread
+		struct Snapshot
+		{
+			std::vector<SenderEntry> mSenders;
+			std::vector<ReceiverEntry> mReceivers;
+		};
+
+		// Threads reading snapshots
+		enum Reader { Audio = 0, Network, ReaderCount };
+
+		/**
+		 * Announces which snapshot the reader is using, so the control thread does not destroy it.
+		 */
+		Snapshot* acquire(Reader reader);
+
+		/**
+		 * Applies the settings of a sender to an existing encoder when they differ from the previous settings.
+		 */
+		void configure(Encoder& encoder, const VBANTopology::Sender& sender, const VBANTopology::Sender* previous);
+
+		/**
+		 * Applies the settings of a receiver to an existing decoder when they differ from the previous settings.
+		 */
+		void configure(VBANStreamDecoder& decoder, const VBANTopology::Receiver& receiver, const VBANTopology::Receiver* previous);
+
+		SenderFactory mSenderFactory;
+		const int mBufferSize;
+		std::vector<float> mSilence; // Input for stream channels that are not routed
+
+		// Control thread state
+		std::mutex mApplyLock;
+		VBANTopology mTopology;
+		std::map<std::string, std::shared_ptr<SenderStream>> mSenderStreams;
+		std::map<std::string, std::shared_ptr<VBANStreamDecoder>> mDecoders;
+		std::vector<Snapshot*> mRetiredSnapshots;
+		int mCreatedCount = 0;
+
+		// Shared between the threads
+		std::atomic<Snapshot*> mSnapshot = { nullptr };
+		std::atomic<Snapshot*> mReaderSnapshots[ReaderCount] = { };
+	};
+
+
+	template <typename SenderType>
+	VBANTopologyApplier<SenderType>::VBANTopologyApplier(SenderFactory senderFactory, int bufferSize) :
+		mSenderFactory(std::move(senderFactory)), mBufferSize(bufferSize), mSilence(bufferSize, 0.f)
+	{
+		mSnapshot.store(new Snapshot);
+	}
+
+
+	template <typename SenderType>
+	VBANTopologyApplier<SenderType>::~VBANTopologyApplier()
+	{
+		delete mSnapshot.load();
+		for (auto snapshot : mRetiredSnapshots)
+			delete snapshot;
+	}
+
+
+	template <typename SenderType>
+	void VBANTopologyApplier<SenderType>::apply(const VBANTopology& topology)
+	{
+		std::lock_guard<std::mutex> lock(mApplyLock);
+		auto snapshot = new Snapshot;
+
+		// Senders
+		std::map<std::string, const VBANTopology::Sender*> previousSenders;
+		for (auto& sender : mTopology.senders)
+			previousSenders[sender.id] = &sender;
+		std::map<std::string, std::shared_ptr<SenderStream>> senderStreams;
+		for (auto& sender : topology.senders)
+		{
+			assert(!sender.inputChannels.empty() && sender.inputChannels.size() <= VBAN_CHANNELS_MAX_NB);
+			auto previous = previousSenders.find(sender.id);
+			auto stream = mSenderStreams.find(sender.id);
+			const VBANTopology::Sender* previousSender = nullptr;
+			std::shared_ptr<SenderStream> senderStream;
+
+			// A stream that moved to another destination needs a new sender
+			if (previous != previousSenders.end() && previous->second->destination == sender.destination && previous->second->port == sender.port)
+			{
+				senderStream = stream->second;
+				previousSender = previous->second;
+			}
+			else {
+				senderStream = std::make_shared<SenderStream>();
+				senderStream->mSender = mSenderFactory(sender.destination, sender.port);
+				senderStream->mEncoder = std::make_unique<Encoder>(*senderStream->mSender);
+				senderStream->mEncoder->setBufferSize(mBufferSize);
+				mCreatedCount++;
+			}
+			configure(*senderStream->mEncoder, sender, previousSender);
+			senderStreams[sender.id] = senderStream;
+
+			SenderEntry entry;
+			entry.mStream = senderStream;
+			entry.mInputChannels = sender.inputChannels;
+			entry.mChannels.resize(sender.inputChannels.size());
+			snapshot->mSenders.emplace_back(std::move(entry));
+		}
+
+		// Receivers
+		std::map<std::string, const VBANTopology::Receiver*> previousReceivers;
+		for (auto& receiver : mTopology.receivers)
+			previousReceivers[receiver.id] = &receiver;
+		std::map<std::string, std::shared_ptr<VBANStreamDecoder>> decoders;
+		for (auto& receiver : topology.receivers)
+		{
+			assert(receiver.streamName.size() <= VBAN_STREAM_NAME_SIZE);
+			auto previous = previousReceivers.find(receiver.id);
+			const VBANTopology::Receiver* previousReceiver = nullptr;
+			std::shared_ptr<VBANStreamDecoder> decoder;
+			if (previous != previousReceivers.end())
+			{
+				decoder = mDecoders[receiver.id];
+				previousReceiver = previous->second;
+			}
+			else {
+				decoder = std::make_shared<VBANStreamDecoder>();
+				mCreatedCount++;
+			}
+			configure(*decoder, receiver, previousReceiver);
+			decoders[receiver.id] = decoder;
+
+			ReceiverEntry entry;
+			entry.mDecoder = decoder;
+			std::memcpy(entry.mStreamName, receiver.streamName.c_str(), receiver.streamName.size());
+			entry.mOutputChannels = receiver.outputChannels;
+			entry.mBuffer.resize(receiver.outputChannels.size(), std::vector<float>(mBufferSize));
+			snapshot->mReceivers.emplace_back(std::move(entry));
+		}
+
+		// Publish the new streams, the streams that were removed stay alive in the old snapshot until it is no longer read
+		mTopology = topology;
+		mSenderStreams = std::move(senderStreams);
+		mDecoders = std::move(decoders);
+		mRetiredSnapshots.emplace_back(mSnapshot.exchange(snapshot));
+		collect();
+	}
+
+
+	template <typename SenderType>
+	void VBANTopologyApplier<SenderType>::collect()
+	{
+		for (size_t i = 0; i < mRetiredSnapshots.size();)
+		{
+			auto snapshot = mRetiredSnapshots[i];
+			auto isRead = false;
+			for (auto& reader : mReaderSnapshots)
+				isRead |= reader.load() == snapshot;
+			if (!isRead)
+			{
+				delete snapshot;
+				mRetiredSnapshots[i] = mRetiredSnapshots.back();
+				mRetiredSnapshots.pop_back();
+			}
+			else
+				++i;
+		}
+	}
+
+
+	template <typename SenderType>
+	typename VBANTopologyApplier<SenderType>::Snapshot* VBANTopologyApplier<SenderType>::acquire(Reader reader)
+	{
+		auto snapshot = mSnapshot.load();
+		while (true)
+		{
+			mReaderSnapshots[reader].store(snapshot);
+			auto current = mSnapshot.load();
+			if (current == snapshot)
+				return snapshot;
+			snapshot = current;
+		}
+	}
+
+
+	template <typename SenderType> template <typename InputType, typename OutputType>
+	void VBANTopologyApplier<SenderType>::process(const InputType& input, int inputChannelCount, OutputType& output, int outputChannelCount, int sampleCount)
+	{
+		assert(sampleCount <= mBufferSize);
+		auto snapshot = acquire(Audio);
+
+		for (auto& sender : snapshot->mSenders)
+		{
+			for (size_t channel = 0; channel < sender.mChannels.size(); ++channel)
+			{
+				auto inputChannel = sender.mInputChannels[channel];
+				sender.mChannels[channel] = inputChannel >= 0 && inputChannel < inputChannelCount ? &input[inputChannel][0] : mSilence.data();
+			}
+			sender.mStream->mEncoder->process(sender.mChannels, sender.mChannels.size(), sampleCount);
+		}
+
+		for (auto channel = 0; channel < outputChannelCount; ++channel)
+			for (auto i = 0; i < sampleCount; ++i)
+				output[channel][i] = 0.f;
+
+		for (auto& receiver : snapshot->mReceivers)
+		{
+			receiver.mDecoder->process(receiver.mBuffer, receiver.mBuffer.size(), sampleCount);
+			for (size_t channel = 0; channel < receiver.mBuffer.size(); ++channel)
+			{
+				auto outputChannel = receiver.mOutputChannels[channel];
+				if (outputChannel < 0 || outputChannel >= outputChannelCount)
+					continue;
+				auto& buffer = receiver.mBuffer[channel];
+				for (auto i = 0; i < sampleCount; ++i)
+					output[outputChannel][i] += buffer[i];
+			}
+		}
+
+		mReaderSnapshots[Audio].store(nullptr);
+	}
+
+
+	template <typename SenderType>
+	bool VBANTopologyApplier<SenderType>::receivePacket(const char* data, int size)
+	{
+		if (size < VBAN_HEADER_SIZE)
+			return false;
+
+		auto snapshot = acquire(Network);
+		auto header = reinterpret_cast<const VBanHeader*>(data);
+		auto isAccepted = false;
+		for (auto& receiver : snapshot->mReceivers)
+			if (receiver.mStreamName[0] == 0 || std::strncmp(receiver.mStreamName, header->streamname, VBAN_STREAM_NAME_SIZE) == 0)
+				isAccepted |= receiver.mDecoder->receivePacket(data, size);
+
+		mReaderSnapshots[Network].store(nullptr);
+		return isAccepted;
+	}
+
+
+	template <typename SenderType>
+	void VBANTopologyApplier<SenderType>::configure(Encoder& encoder, const VBANTopology::Sender& sender, const VBANTopology::Sender* previous)
+	{
+		if (previous == nullptr || previous->streamName != sender.streamName)
+			encoder.setStreamName(sender.streamName);
+		if (previous == nullptr || previous->sampleRateFormat != sender.sampleRateFormat)
+			encoder.setSampleRateFormat(sender.sampleRateFormat);
+		if (previous == nullptr || previous->bitDepth != sender.bitDepth)
+			encoder.setBitDepth(sender.bitDepth);
+		if (previous == nullptr || previous->inputChannels.size() != sender.inputChannels.size())
+			encoder.setChannelCount(sender.inputChannels.size());
+		if (previous == nullptr)
+			encoder.setActive(true);
+	}
+
+
+	template <typename SenderType>
+	void VBANTopologyApplier<SenderType>::configure(VBANStreamDecoder& decoder, const VBANTopology::Receiver& receiver, const VBANTopology::Receiver* previous)
+	{
+		if (previous == nullptr || previous->streamName != receiver.streamName)
+			decoder.setStreamName(receiver.streamName);
+		if (previous == nullptr || previous->latency != receiver.latency)
+			decoder.setLatency(receiver.latency);
+		if (previous == nullptr || previous->timeout != receiver.timeout)
+			decoder.setTimeout(receiver.timeout);
+		if (previous == nullptr || previous->subscribedChannels != receiver.subscribedChannels)
+			decoder.setSubscribedChannels(receiver.subscribedChannels);
+		if (previous == nullptr || previous->channelMap != receiver.channelMap)
+			decoder.setChannelMap(receiver.channelMap);
+	}
+
+}
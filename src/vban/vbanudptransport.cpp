@@ -0,0 +1,232 @@
+#include "vbanudptransport.h"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+namespace vban
+{
+
+	// Largest number of segments the kernel accepts in one call
+	static constexpr int maxSegmentCount = 64;
+
+	// Largest payload of a UDP datagram over IPv4, also the limit for a segmented batch
+	static constexpr int maxBatchSize = 65507;
+
+
+	VBANUdpSender::~VBANUdpSender()
+	{
+		if (mSocket >= 0)
+			close(mSocket);
+	}
+
+
+	bool VBANUdpSender::open(const std::string& address, int port, std::string& error)
+	{
+		sockaddr_in destination = { };
+		destination.sin_family = AF_INET;
+		destination.sin_port = htons(port);
+		if (inet_pton(AF_INET, address.c_str(), &destination.sin_addr) != 1)
+		{
+			error = address + " is not a valid IPv4 address";
+			return false;
+		}
+
+		// Opening again replaces the socket, queued packets were meant for the previous destination
+		if (mSocket >= 0)
+			close(mSocket);
+		mBatch.clear();
+		mSegmentCount = 0;
+
+		mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+		if (mSocket < 0)
+		{
+			error = std::string("Failed to create socket: ") + std::strerror(errno);
+			return false;
+		}
+
+		mAddress.resize(sizeof(destination));
+		std::memcpy(mAddress.data(), &destination, sizeof(destination));
+		mBatch.reserve(maxBatchSize);
+#ifndef __linux__
+		mIsSegmenting = false;
+#endif
+		return true;
+	}
+
+
+	void VBANUdpSender::sendPacket(const std::vector<char>& data)
+	{
+		if (mSocket < 0)
+			return;
+
+		auto size = static_cast<int>(data.size());
+		if (mSegmentCount > 0 && size != mSegmentSize)
+			flush();
+		mBatch.insert(mBatch.end(), data.begin(), data.end());
+		mSegmentSize = size;
+		mSegmentCount++;
+		if (!mIsSegmenting || mSegmentCount == maxSegmentCount || mBatch.size() + size > maxBatchSize)
+			flush();
+	}
+
+
+	void VBANUdpSender::flush()
+	{
+		if (mSegmentCount == 0)
+			return;
+
+#ifdef __linux__
+		if (mIsSegmenting && mSegmentCount > 1)
+		{
+			// One call for the whole batch, the segment size is passed in a control message
+			iovec data = { mBatch.data(), mBatch.size() };
+			char control[CMSG_SPACE(sizeof(uint16_t))] = { };
+			msghdr message = { };
+			message.msg_name = mAddress.data();
+			message.msg_namelen = mAddress.size();
+			message.msg_iov = &data;
+			message.msg_iovlen = 1;
+			message.msg_control = control;
+			message.msg_controllen = sizeof(control);
+			auto header = CMSG_FIRSTHDR(&message);
+			header->cmsg_level = SOL_UDP;
+			header->cmsg_type = UDP_SEGMENT;
+			header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t segmentSize = mSegmentSize;
+			std::memcpy(CMSG_DATA(header), &segmentSize, sizeof(segmentSize));
+
+			mSendCallCount++;
+			if (sendmsg(mSocket, &message, 0) >= 0)
+			{
+				mPacketCount += mSegmentCount;
+				mBatch.clear();
+				mSegmentCount = 0;
+				return;
+			}
+
+			// Not supported by the kernel or the network card, fall back to sending the packets one by one
+			if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+				mIsSegmenting = false;
+		}
+#endif
+		sendSeparately();
+	}
+
+
+	void VBANUdpSender::sendSeparately()
+	{
+		for (auto i = 0; i < mSegmentCount; ++i)
+		{
+			mSendCallCount++;
+			if (sendto(mSocket, mBatch.data() + i * mSegmentSize, mSegmentSize, 0, reinterpret_cast<const sockaddr*>(mAddress.data()), mAddress.size()) >= 0)
+				mPacketCount++;
+			else
+				mErrorCount++;
+		}
+		mBatch.clear();
+		mSegmentCount = 0;
+	}
+
+
+	VBANUdpReceiver::~VBANUdpReceiver()
+	{
+		if (mSocket >= 0)
+			close(mSocket);
+	}
+
+
+	bool VBANUdpReceiver::open(int port, std::string& error, int timeout)
+	{
+		// Opening again replaces the socket
+		if (mSocket >= 0)
+			close(mSocket);
+
+		mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+		if (mSocket < 0)
+		{
+			error = std::string("Failed to create socket: ") + std::strerror(errno);
+			return false;
+		}
+
+		sockaddr_in address = { };
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		if (bind(mSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+		{
+			error = "Failed to bind to port " + std::to_string(port) + ": " + std::strerror(errno);
+			close(mSocket);
+			mSocket = -1;
+			return false;
+		}
+
+		timeval time;
+		time.tv_sec = timeout / 1000;
+		time.tv_usec = (timeout % 1000) * 1000;
+		setsockopt(mSocket, SOL_SOCKET, SO_RCVTIMEO, &time, sizeof(time));
+
+#ifdef __linux__
+		int enable = 1;
+		mIsCoalescing = setsockopt(mSocket, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+#endif
+		mBuffer.resize(mIsCoalescing ? 65536 : VBAN_PROTOCOL_MAX_SIZE);
+		return true;
+	}
+
+
+	int VBANUdpReceiver::receive(const PacketFunction& function)
+	{
+		if (mSocket < 0)
+			return -1;
+
+		iovec data = { mBuffer.data(), mBuffer.size() };
+		char control[CMSG_SPACE(sizeof(int))] = { };
+		msghdr message = { };
+		message.msg_iov = &data;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+		auto size = static_cast<int>(recvmsg(mSocket, &message, 0));
+		if (size < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+		mReceiveCallCount++;
+
+		// Coalesced datagrams all have the segment size, except for the last one which can be smaller
+		int segmentSize = size;
+#ifdef __linux__
+		for (auto header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+			if (header->cmsg_level == SOL_UDP && header->cmsg_type == UDP_GRO)
+				std::memcpy(&segmentSize, CMSG_DATA(header), sizeof(segmentSize));
+#endif
+		if (segmentSize <= 0)
+			segmentSize = size;
+
+		int count = 0;
+		for (auto position = 0; position < size; position += segmentSize)
+		{
+			function(mBuffer.data() + position, std::min(segmentSize, size - position));
+			count++;
+		}
+		return count;
+	}
+
+}
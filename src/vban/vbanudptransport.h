@@ -0,0 +1,145 @@
+#pragma once
+
+#include "vban.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace vban
+{
+
+	/**
+	 * Reference UDP sender for VBANStreamEncoder on POSIX systems.
+	 * Packets passed to sendPacket() are collected and sent by flush(), which the encoder calls at the end of every process() call.
+	 * All packets of one encoder have the same size, so on Linux a batch is sent with a single sendmsg() call using UDP generic segmentation offload (UDP_SEGMENT): the kernel or the network card splits the buffer into datagrams.
+	 * When the system does not support segmentation offload the packets are sent one by one.
+	 */
+	class VBANUdpSender
+	{
+	public:
+		// Default constructor
+		VBANUdpSender() = default;
+
+		// Closes the socket
+		virtual ~VBANUdpSender();
+
+		VBANUdpSender(const VBANUdpSender&) = delete;
+		VBANUdpSender& operator=(const VBANUdpSender&) = delete;
+
+		/**
+		 * Opens the socket.
+		 * @param address IPv4 address the packets are sent to
+		 * @param port Port the packets are sent to
+		 * @param error Contains the error message when opening fails
+		 * @return True on success
+		 */
+		bool open(const std::string& address, int port, std::string& error);
+
+		/**
+		 * Queues a packet, called by the encoder. A batch is sent as soon as it is full or a packet of another size comes in.
+		 * @param data The vban packet to be sent.
+		 */
+		void sendPacket(const std::vector<char>& data);
+
+		/**
+		 * Sends the queued packets, called by the encoder after every process() call.
+		 */
+		void flush();
+
+		/**
+		 * Enables or disables UDP segmentation offload. Enabled by default on Linux.
+		 * @param value True to send batches in one call
+		 */
+		void setSegmentationOffload(bool value) { mIsSegmenting = value; }
+
+		/**
+		 * @return Number of packets sent
+		 */
+		int getPacketCount() const { return mPacketCount; }
+
+		/**
+		 * @return Number of send system calls made
+		 */
+		int getSendCallCount() const { return mSendCallCount; }
+
+		/**
+		 * @return Number of packets that could not be sent
+		 */
+		int getErrorCount() const { return mErrorCount; }
+
+	private:
+		/**
+		 * Sends the queued packets one by one
+		 */
+		void sendSeparately();
+
+		int mSocket = -1;
+		std::vector<char> mAddress; // sockaddr_in of the destination
+		bool mIsSegmenting = true;
+
+		std::vector<char> mBatch; // Queued packets, back to back
+		int mSegmentSize = 0; // Size of the queued packets
+		int mSegmentCount = 0; // Number of queued packets
+
+		int mPacketCount = 0;
+		int mSendCallCount = 0;
+		int mErrorCount = 0;
+	};
+
+
+	/**
+	 * Reference UDP receiver that passes VBAN packets to a decoder on POSIX systems.
+	 * On Linux UDP generic receive offload (UDP_GRO) is enabled, so the kernel can hand over a number of same sized datagrams of one sender in a single buffer. receive() splits the buffer back into packets.
+	 */
+	class VBANUdpReceiver
+	{
+	public:
+		/**
+		 * Called for every received packet with the data and size of the packet.
+		 */
+		using PacketFunction = std::function<void(const char* data, int size)>;
+
+		// Default constructor
+		VBANUdpReceiver() = default;
+
+		// Closes the socket
+		virtual ~VBANUdpReceiver();
+
+		VBANUdpReceiver(const VBANUdpReceiver&) = delete;
+		VBANUdpReceiver& operator=(const VBANUdpReceiver&) = delete;
+
+		/**
+		 * Opens the socket.
+		 * @param port Port to receive on
+		 * @param error Contains the error message when opening fails
+		 * @param timeout Longest time receive() blocks, in milliseconds, so the receiving thread can be stopped.
+		 * @return True on success
+		 */
+		bool open(int port, std::string& error, int timeout = 100);
+
+		/**
+		 * Waits for incoming data and passes the packets to the function. Call this in a loop on the network thread.
+		 * @param function Called for every packet, usually passes it on to VBANStreamDecoder::receivePacket().
+		 * @return Number of packets received, 0 on timeout, -1 on error.
+		 */
+		int receive(const PacketFunction& function);
+
+		/**
+		 * @return Whether the kernel accepted to coalesce datagrams.
+		 */
+		bool isCoalescing() const { return mIsCoalescing; }
+
+		/**
+		 * @return Number of receive system calls that returned data
+		 */
+		int getReceiveCallCount() const { return mReceiveCallCount; }
+
+	private:
+		int mSocket = -1;
+		bool mIsCoalescing = false;
+		std::vector<char> mBuffer; // Holds the data of one receive call, up to 64 KB with coalescing
+		int mReceiveCallCount = 0;
+	};
+
+}
@@ -0,0 +1,75 @@
+#include "vbanusercodec.h"
+#include "vbanmdct.h"
+#include "vbanadpcm.h"
+
+#include <bitset>
+#include <cstddef>
+
+namespace vban
+{
+
+	bool validateUserPacket(const unsigned char* data, int size, int pcmSize)
+	{
+		if (size < VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE)
+			return false;
+
+		auto header = reinterpret_cast<const VBanUserHeader*>(data + VBAN_HEADER_SIZE);
+		switch (header->type)
+		{
+			case VBAN_USER_CODEC_AEAD:
+				return size == VBAN_HEADER_SIZE + VBAN_AEAD_OVERHEAD + pcmSize;
+			case VBAN_USER_CODEC_SPARSE:
+			{
+				auto channelCount = data[offsetof(VBanHeader, format_nbc)] + 1;
+				auto bitmapSize = getSparseBitmapSize(channelCount);
+				if (size < VBAN_SPARSE_BITMAP_OFFSET + bitmapSize)
+					return false;
+
+				// Bits beyond the channel count have to be clear
+				auto bitmap = data + VBAN_SPARSE_BITMAP_OFFSET;
+				if ((bitmap[bitmapSize - 1] >> (channelCount - (bitmapSize - 1) * 8)) != 0)
+					return false;
+				auto activeSize = pcmSize / channelCount * getSparseChannelCount(bitmap, channelCount);
+				return size == VBAN_SPARSE_BITMAP_OFFSET + bitmapSize + activeSize;
+			}
+			case VBAN_USER_CODEC_MDCT:
+			{
+				// Every packet holds one frame, all channels are coded into the same number of bytes
+				auto channelCount = data[offsetof(VBanHeader, format_nbc)] + 1;
+				auto channelSize = getMdctChannelSize(data);
+				return data[offsetof(VBanHeader, format_nbs)] + 1 == VBAN_MDCT_FRAME_SIZE && channelSize >= VBAN_MDCT_MIN_CHANNEL_SIZE && size == VBAN_MDCT_PAYLOAD_OFFSET + channelCount * channelSize;
+			}
+			case VBAN_USER_CODEC_ADPCM:
+			{
+				// Always decodes to 16 bit samples
+				auto sampleCount = data[offsetof(VBanHeader, format_nbs)] + 1;
+				auto channelCount = data[offsetof(VBanHeader, format_nbc)] + 1;
+				return (data[offsetof(VBanHeader, format_bit)] & VBAN_BIT_RESOLUTION_MASK) == VBAN_BITFMT_16_INT && size == VBAN_ADPCM_PAYLOAD_OFFSET + getAdpcmPayloadSize(sampleCount, channelCount);
+			}
+			default:
+				return false;
+		}
+	}
+
+
+	int getSparseChannelCount(const unsigned char* bitmap, int channelCount)
+	{
+		int count = 0;
+		for (auto i = 0; i < getSparseBitmapSize(channelCount); ++i)
+			count += std::bitset<8>(bitmap[i]).count();
+		return count;
+	}
+
+
+	int getSparseChannelIndex(const unsigned char* bitmap, int channelCount, int channel)
+	{
+		if (channel < 0 || channel >= channelCount || ((bitmap[channel / 8] >> (channel % 8)) & 1) == 0)
+			return -1;
+
+		int index = 0;
+		for (auto i = 0; i < channel / 8; ++i)
+			index += std::bitset<8>(bitmap[i]).count();
+		return index + std::bitset<8>(bitmap[channel / 8] & ((1u << (channel % 8)) - 1)).count();
+	}
+
+}
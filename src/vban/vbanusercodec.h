@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vban.h"
+
+#include <cstdint>
+
+namespace vban
+{
+
+	/**
+	 * Packets that use the VBAN_CODEC_USER codec slot start their payload with this header, telling which of the codecs of this library is used.
+	 * The format_nbs, format_nbc and the bit resolution in format_bit of the VBAN header still describe the decoded audio.
+	 */
+	struct VBanUserHeader
+	{
+		uint8_t type; // One of VBanUserCodec
+		uint8_t reserved[3];
+	};
+
+	#define VBAN_USER_HEADER_SIZE 4
+
+	enum VBanUserCodec
+	{
+		VBAN_USER_CODEC_AEAD = 1, // PCM payload encrypted with ChaCha20-Poly1305, see vbanaead.h
+		VBAN_USER_CODEC_SPARSE = 2, // Only the channels that carry signal, see below
+		VBAN_USER_CODEC_MDCT = 3, // Low delay lossy transform codec, see vbanmdct.h
+		VBAN_USER_CODEC_ADPCM = 4, // 16 bit samples coded into 4 bits with IMA-ADPCM, see vbanadpcm.h
+		VBAN_USER_CODEC_NACK = 5, // Request from a receiver to send lost packets again, carries no audio, see vbanretransmit.h
+		VBAN_USER_CODEC_TIMESTAMPS = 6, // Times the packets of a stream passed the stages of the sender, carries no audio, see vbanlatencyprobe.h
+	};
+
+	// Encrypted packets: user header, 8 byte session id, PCM payload encrypted, authentication tag
+	#define VBAN_AEAD_SESSION_SIZE 8
+	#define VBAN_AEAD_PAYLOAD_OFFSET (VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE + VBAN_AEAD_SESSION_SIZE)
+	#define VBAN_AEAD_OVERHEAD (VBAN_USER_HEADER_SIZE + VBAN_AEAD_SESSION_SIZE + 16)
+
+	// Sparse packets: user header, a bitmap with one bit per channel of the stream (bit n of byte n / 8), then the PCM samples of the channels with a set bit, interleaved in channel order
+	#define VBAN_SPARSE_BITMAP_OFFSET (VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE)
+
+	// Transform coded packets: user header with the size of a coded channel in the first two reserved bytes (little endian), then one coded frame of VBAN_MDCT_FRAME_SIZE samples for every channel
+	#define VBAN_MDCT_PAYLOAD_OFFSET (VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE)
+
+	// IMA-ADPCM packets: user header, the coder state of every channel, then for every sample the 4 bit codes of all channels, two per byte
+	#define VBAN_ADPCM_PAYLOAD_OFFSET (VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE)
+
+	// Retransmission requests: the stream name and nuFrame of the VBAN header give the stream and the first requested frame, the user header is followed by a bitmap where bit n of byte n / 8 requests frame nuFrame + n
+	#define VBAN_NACK_BITMAP_OFFSET (VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE)
+	#define VBAN_NACK_BITMAP_SIZE 8
+	#define VBAN_NACK_PACKET_SIZE (VBAN_NACK_BITMAP_OFFSET + VBAN_NACK_BITMAP_SIZE)
+
+	// Timestamp packets: nuFrame of the VBAN header is the first frame and format_nbs + 1 the number of consecutive frames described, the user header is followed by a record for every frame
+	// A record holds the start of the encoding, the time the packet was handed to the sender and the time it was sent, as 64 bit nanoseconds of the steady clock of the sender
+	#define VBAN_TIMESTAMP_OFFSET (VBAN_HEADER_SIZE + VBAN_USER_HEADER_SIZE)
+	#define VBAN_TIMESTAMP_RECORD_SIZE 24
+	#define VBAN_TIMESTAMP_MAX_RECORDS 32
+
+	/**
+	 * @return Number of bytes of every coded channel in a transform coded packet
+	 */
+	inline int getMdctChannelSize(const unsigned char* data) { return data[VBAN_HEADER_SIZE + 1] | (data[VBAN_HEADER_SIZE + 2] << 8); }
+
+	/**
+	 * @return Size of the channel bitmap of a sparse packet in bytes
+	 */
+	inline int getSparseBitmapSize(int channelCount) { return (channelCount + 7) / 8; }
+
+	/**
+	 * @return Number of channels present in a sparse packet
+	 */
+	int getSparseChannelCount(const unsigned char* bitmap, int channelCount);
+
+	/**
+	 * Finds the samples of a channel in the payload of a sparse packet.
+	 * @param bitmap The bitmap of the packet
+	 * @param channelCount Number of channels of the stream
+	 * @param channel Channel of the stream
+	 * @return Index of the channel within the channels present in the packet, or -1 when the channel is silent.
+	 */
+	int getSparseChannelIndex(const unsigned char* bitmap, int channelCount, int channel);
+
+	/**
+	 * Checks whether the payload of a packet with the VBAN_CODEC_USER codec is well formed.
+	 * @param data The full packet, the VBAN header has already been validated.
+	 * @param size Size of the packet in bytes
+	 * @param pcmSize Size of the PCM audio described by the VBAN header in bytes
+	 * @return True when the codec is known and the size of the packet matches.
+	 */
+	bool validateUserPacket(const unsigned char* data, int size, int pcmSize);
+
+}
@@ -0,0 +1,117 @@
+#include "vbanwavfile.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace vban
+{
+
+	static uint32_t readLittleEndian(const unsigned char* data, int size)
+	{
+		uint32_t value = 0;
+		for (auto i = 0; i < size; ++i)
+			value |= uint32_t(data[i]) << (i * 8);
+		return value;
+	}
+
+
+	bool VBANWavFile::open(const std::string& path, std::string& error)
+	{
+		mFile.open(path, std::ios::binary);
+		if (!mFile.is_open())
+		{
+			error = "Failed to open " + path;
+			return false;
+		}
+
+		unsigned char riff[12];
+		if (!mFile.read(reinterpret_cast<char*>(riff), sizeof(riff)) || (std::memcmp(riff, "RIFF", 4) != 0 && std::memcmp(riff, "RF64", 4) != 0) || std::memcmp(riff + 8, "WAVE", 4) != 0)
+		{
+			error = path + " is not a WAV or RF64 file";
+			return false;
+		}
+
+		// Walk the chunks until the data chunk, the fmt chunk and for RF64 the ds64 chunk come before it
+		int64_t dataSize64 = -1;
+		bool hasFormat = false;
+		unsigned char chunk[8];
+		while (mFile.read(reinterpret_cast<char*>(chunk), sizeof(chunk)))
+		{
+			int64_t size = readLittleEndian(chunk + 4, 4);
+			if (std::memcmp(chunk, "ds64", 4) == 0)
+			{
+				unsigned char ds64[16];
+				if (size < 16 || !mFile.read(reinterpret_cast<char*>(ds64), sizeof(ds64)))
+					break;
+				dataSize64 = int64_t(readLittleEndian(ds64 + 8, 4)) | (int64_t(readLittleEndian(ds64 + 12, 4)) << 32);
+				size -= 16;
+			}
+			else if (std::memcmp(chunk, "fmt ", 4) == 0)
+			{
+				unsigned char format[40] = { };
+				if (size < 16 || !mFile.read(reinterpret_cast<char*>(format), std::min<int64_t>(size, sizeof(format))))
+					break;
+				auto tag = readLittleEndian(format, 2);
+				if (tag == 0xFFFE && size >= 26)
+					tag = readLittleEndian(format + 24, 2); // first two bytes of the sub format GUID
+				mChannelCount = readLittleEndian(format + 2, 2);
+				mSampleRate = readLittleEndian(format + 4, 4);
+				auto bitDepth = readLittleEndian(format + 14, 2);
+
+				if (tag == 1 && bitDepth == 16)
+					mFormat = Format::Int16;
+				else if (tag == 1 && bitDepth == 24)
+					mFormat = Format::Int24;
+				else if (tag == 1 && bitDepth == 32)
+					mFormat = Format::Int32;
+				else if (tag == 3 && bitDepth == 32)
+					mFormat = Format::Float32;
+				else {
+					error = path + " has an unsupported sample format";
+					return false;
+				}
+				mFrameSize = mChannelCount * bitDepth / 8;
+				hasFormat = mChannelCount > 0;
+				size -= std::min<int64_t>(size, sizeof(format));
+			}
+			else if (std::memcmp(chunk, "data", 4) == 0)
+			{
+				if (!hasFormat)
+					break;
+				if (size == 0xFFFFFFFF && dataSize64 >= 0)
+					size = dataSize64;
+				mDataOffset = mFile.tellg();
+				mFrameCount = size / mFrameSize;
+				mFramesRead = 0;
+				return true;
+			}
+
+			// Chunks are padded to an even size
+			mFile.seekg(size + (size & 1), std::ios::cur);
+		}
+
+		error = path + " has no valid format and data chunk";
+		return false;
+	}
+
+
+	int VBANWavFile::read(char* data, int frameCount)
+	{
+		auto count = static_cast<int>(std::min<int64_t>(frameCount, mFrameCount - mFramesRead));
+		if (count <= 0)
+			return 0;
+		mFile.read(data, static_cast<std::streamsize>(count) * mFrameSize);
+		count = static_cast<int>(mFile.gcount() / mFrameSize);
+		mFramesRead += count;
+		return count;
+	}
+
+
+	void VBANWavFile::rewind()
+	{
+		mFile.clear();
+		mFile.seekg(mDataOffset);
+		mFramesRead = 0;
+	}
+
+}
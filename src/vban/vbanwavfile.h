@@ -0,0 +1,85 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <cstdint>
+
+namespace vban
+{
+
+	/**
+	 * Reads the interleaved PCM data of WAV and RF64 files, the format of pre rendered programs that are streamed by VBANFileStreamer.
+	 * Supports 16, 24 and 32 bit integer and 32 bit floating point samples, also in WAVE_FORMAT_EXTENSIBLE files.
+	 */
+	class VBANWavFile
+	{
+	public:
+		/**
+		 * Sample formats of the interleaved data
+		 */
+		enum class Format
+		{
+			Int16,
+			Int24,
+			Int32,
+			Float32
+		};
+
+		/**
+		 * Opens a file and reads its header.
+		 * @param path Path to the file
+		 * @param error Contains the error message when opening fails
+		 * @return True on success
+		 */
+		bool open(const std::string& path, std::string& error);
+
+		/**
+		 * Reads interleaved frames from the current position.
+		 * @param data Receives the frames, has to hold frameCount * getFrameSize() bytes.
+		 * @param frameCount Number of frames to read
+		 * @return Number of frames read, less than frameCount at the end of the data.
+		 */
+		int read(char* data, int frameCount);
+
+		/**
+		 * Moves the read position back to the first frame.
+		 */
+		void rewind();
+
+		/**
+		 * @return Number of interleaved channels
+		 */
+		int getChannelCount() const { return mChannelCount; }
+
+		/**
+		 * @return Sample rate in Hz
+		 */
+		int getSampleRate() const { return mSampleRate; }
+
+		/**
+		 * @return Format of the samples
+		 */
+		Format getFormat() const { return mFormat; }
+
+		/**
+		 * @return Size of one frame, a sample for every channel, in bytes
+		 */
+		int getFrameSize() const { return mFrameSize; }
+
+		/**
+		 * @return Total number of frames in the file
+		 */
+		int64_t getFrameCount() const { return mFrameCount; }
+
+	private:
+		std::ifstream mFile;
+		int mChannelCount = 0;
+		int mSampleRate = 0;
+		Format mFormat = Format::Int16;
+		int mFrameSize = 0;
+		int64_t mFrameCount = 0;
+		int64_t mDataOffset = 0; // Position of the first frame in the file
+		int64_t mFramesRead = 0;
+	};
+
+}
@@ -0,0 +1,101 @@
+#include <vban/vbanrtpgateway.h>
+#include <vban/vbanstreamencoder.h>
+
+#include <cstdio>
+#include <vector>
+
+/**
+ * Round trip of a VBAN stream through VBANToRtpGateway and RtpToVBANGateway on loopback, without sockets.
+ * The samples coming out have to be the samples that went in, also after the VBAN sender and the RTP sender restart their counters.
+ */
+
+namespace
+{
+
+	// Collects the payload of the VBAN packets at the end of the chain
+	struct VbanSink
+	{
+		std::vector<char> mSamples;
+		void sendPacket(const std::vector<char>& data) { mSamples.insert(mSamples.end(), data.begin() + VBAN_HEADER_SIZE, data.end()); }
+	};
+
+	// Passes the RTP packets on to the gateway back to VBAN
+	struct RtpLink
+	{
+		vban::RtpToVBANGateway<VbanSink>& mGateway;
+		void sendPacket(const std::vector<char>& data) { mGateway.receivePacket(data.data(), static_cast<int>(data.size())); }
+	};
+
+	// Passes the VBAN packets of the encoder on to the gateway to RTP, keeping a copy of the payload
+	struct VbanLink
+	{
+		vban::VBANToRtpGateway<RtpLink>* mGateway;
+		std::vector<char> mSamples;
+		void sendPacket(const std::vector<char>& data)
+		{
+			mSamples.insert(mSamples.end(), data.begin() + VBAN_HEADER_SIZE, data.end());
+			mGateway->receivePacket(data.data(), static_cast<int>(data.size()));
+		}
+	};
+
+
+	bool check(bool condition, const char* message)
+	{
+		if (!condition)
+			std::printf("FAILED: %s\n", message);
+		return condition;
+	}
+
+}
+
+
+int main()
+{
+	const int channelCount = 2;
+	const int bufferSize = 256;
+	const int blockCount = 399; // More than a second at 48kHz, so a restart jumps back further than a gap is filled. A multiple of 3 so every run ends on a full RTP packet of 48 samples.
+
+	VbanSink sink;
+	vban::RtpToVBANGateway<VbanSink> toVban(sink);
+	toVban.setFormat(channelCount, 3, 16);
+	toVban.setSamplesPerPacket(bufferSize);
+	RtpLink rtpLink { toVban };
+
+	VbanLink vbanLink { nullptr, { } };
+	std::vector<std::vector<float>> input(channelCount, std::vector<float>(bufferSize));
+	auto value = 0;
+	auto stream = [&](vban::VBANToRtpGateway<RtpLink>& toRtp)
+	{
+		// Every restart is a new encoder, its frame numbers start at 0 again
+		vbanLink.mGateway = &toRtp;
+		vban::VBANStreamEncoder<VbanLink> encoder(vbanLink);
+		encoder.setChannelCount(channelCount);
+		encoder.setBufferSize(bufferSize);
+		encoder.setActive(true);
+		for (auto block = 0; block < blockCount; ++block)
+		{
+			for (auto& channel : input)
+				for (auto& sample : channel)
+					sample = static_cast<float>(value++ % 2000 - 1000) / 1000.f;
+			encoder.process(input, channelCount, bufferSize);
+		}
+	};
+
+	// The VBAN sender restarts, then the RTP sender restarts and its timestamps jump back
+	vban::VBANToRtpGateway<RtpLink> toRtp(rtpLink);
+	stream(toRtp);
+	stream(toRtp);
+	vban::VBANToRtpGateway<RtpLink> restartedToRtp(rtpLink);
+	stream(restartedToRtp);
+
+	// RTP packets of 48 samples do not fill the last VBAN packet of 256 samples, the samples that came out have to match the start of the input
+	auto frameSize = channelCount * 2;
+	auto isPassed = true;
+	isPassed &= check(toRtp.getLatePacketCount() == 0 && restartedToRtp.getLatePacketCount() == 0, "VBAN packets dropped as late after the sender restarted");
+	isPassed &= check(toVban.getLatePacketCount() == 0, "RTP packets dropped as late after the RTP timestamps restarted");
+	isPassed &= check(sink.mSamples.size() + bufferSize * frameSize >= vbanLink.mSamples.size(), "samples are missing at the end of the round trip");
+	isPassed &= check(sink.mSamples.size() <= vbanLink.mSamples.size() && std::equal(sink.mSamples.begin(), sink.mSamples.end(), vbanLink.mSamples.begin()), "samples changed in the round trip");
+
+	std::printf("%zu of %zu bytes passed, %d RTP packets, %d VBAN packets\n", sink.mSamples.size(), vbanLink.mSamples.size(), toRtp.getPacketCount() + restartedToRtp.getPacketCount(), toVban.getPacketCount());
+	return isPassed ? 0 : 1;
+}
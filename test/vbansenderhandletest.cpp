@@ -0,0 +1,122 @@
+#include <vban/vbansenderhandle.h>
+#include <vban/vbanstreamencoder.h>
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * Swaps the sender of a VBANSenderHandle from the control thread many times while the audio thread keeps encoding.
+ * Every sender has to be destroyed exactly once after the audio thread left it, and all packets of a process() call have to go to one sender together with the flush after them.
+ * Build with -fsanitize=address or -fsanitize=thread to also catch use after free and data races.
+ */
+
+namespace
+{
+
+	const int packetsPerCall = 4;
+
+	std::atomic<int> gAliveCount = { 0 };
+	std::atomic<int> gPacketCount = { 0 };
+	std::atomic<int> gSplitBatchCount = { 0 };
+
+	// Owned sender, counts the packets between flushes
+	struct CountingSender
+	{
+		int mPending = 0;
+		CountingSender() { gAliveCount++; }
+		~CountingSender() { gAliveCount--; }
+		void sendPacket(const std::vector<char>&)
+		{
+			mPending++;
+			gPacketCount++;
+		}
+		void flush()
+		{
+			// Retired senders are flushed again by collect(), without new packets
+			if (mPending != 0 && mPending != packetsPerCall)
+				gSplitBatchCount++;
+			mPending = 0;
+		}
+	};
+
+	// Borrowed sender without flush()
+	struct PlainSender
+	{
+		std::atomic<int> mPacketCount = { 0 };
+		void sendPacket(const std::vector<char>&) { mPacketCount++; }
+	};
+
+
+	bool check(bool condition, const char* message)
+	{
+		if (!condition)
+			std::printf("FAILED: %s\n", message);
+		return condition;
+	}
+
+}
+
+
+int main()
+{
+	const int channelCount = 2;
+	const int bufferSize = 64;
+	const int swapCount = 20000;
+
+	vban::VBANSenderHandle handle;
+	vban::VBANStreamEncoder<vban::VBANSenderHandle> encoder(handle);
+	encoder.setActive(true);
+	encoder.setBufferSize(bufferSize);
+	encoder.setChannelCount(channelCount);
+
+	std::vector<std::vector<float>> input(channelCount, std::vector<float>(packetsPerCall * bufferSize, 0.25f));
+	std::atomic<bool> isRunning = { true };
+	std::atomic<int> callCount = { 0 };
+	std::thread audio([&]()
+	{
+		while (isRunning.load())
+		{
+			encoder.process(input, channelCount, packetsPerCall * bufferSize);
+			callCount++;
+		}
+	});
+
+	// Wait for the audio thread, then swap owned senders while it encodes
+	while (callCount.load() == 0)
+		std::this_thread::yield();
+	auto failedCount = 0;
+	for (auto i = 0; i < swapCount; ++i)
+	{
+		if (!handle.setSender(std::make_unique<CountingSender>()))
+			failedCount++;
+		if (i % 1000 == 0)
+			handle.collect();
+	}
+
+	// End on a borrowed sender, and drop the packets once it has seen some
+	PlainSender plain;
+	while (!handle.setSender(plain))
+		handle.collect();
+	while (plain.mPacketCount.load() == 0)
+		std::this_thread::yield();
+	while (!handle.setSender(std::unique_ptr<CountingSender>()))
+		handle.collect();
+	while (!handle.isReleased(&plain))
+		std::this_thread::yield();
+
+	isRunning.store(false);
+	audio.join();
+	handle.collect();
+
+	auto packetCount = gPacketCount.load() + plain.mPacketCount.load();
+	auto isPassed = true;
+	isPassed &= check(gAliveCount.load() == 0, "every owned sender is destroyed after collect()");
+	isPassed &= check(gSplitBatchCount.load() == 0, "the packets of a process() call go to one sender");
+	isPassed &= check(failedCount < swapCount, "senders can be bound while the audio thread encodes");
+	isPassed &= check(packetCount > 0 && packetCount <= packetsPerCall * callCount.load(), "packets are forwarded at most once");
+	std::printf("%d calls, %d packets, %d of %d swaps refused until collect()\n", callCount.load(), packetCount, failedCount, swapCount);
+	return isPassed ? 0 : 1;
+}